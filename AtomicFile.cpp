@@ -0,0 +1,118 @@
+#include "AtomicFile.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+bool WriteFileAtomically(const std::string& path, const std::string& contents, std::string& error)
+{
+    AtomicFileWriter writer;
+    return writer.Open(path, error) && writer.Write(0, contents.data(), contents.size(), error) && writer.Commit(error);
+}
+
+AtomicFileWriter::AtomicFileWriter():
+    file(nullptr)
+{
+}
+
+AtomicFileWriter::~AtomicFileWriter()
+{
+    Close();
+}
+
+bool AtomicFileWriter::Open(const std::string& path, std::string& error)
+{
+    Close();
+
+    this->path = path;
+    temporaryPath = path + ".tmp";
+    file = std::fopen(temporaryPath.c_str(), "wb");
+    if (file == nullptr)
+    {
+        error = "cannot create " + temporaryPath;
+        return false;
+    }
+
+    return true;
+}
+
+bool AtomicFileWriter::Write(uint64_t offset, const void* data, size_t size, std::string& error)
+{
+#ifdef _WIN32
+    bool positioned = _fseeki64(file, (long long) offset, SEEK_SET) == 0;
+#else
+    bool positioned = fseeko(file, (off_t) offset, SEEK_SET) == 0;
+#endif
+    if (!positioned || std::fwrite(data, 1, size, file) != size)
+    {
+        error = "writing " + temporaryPath + " failed";
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool AtomicFileWriter::Commit(std::string& error)
+{
+    bool written = std::fflush(file) == 0;
+#ifdef _WIN32
+    written = written && _commit(_fileno(file)) == 0;
+#else
+    written = written && fsync(fileno(file)) == 0;
+#endif
+    written = std::fclose(file) == 0 && written;
+    file = nullptr;
+
+    if (!written)
+    {
+        std::remove(temporaryPath.c_str());
+        error = "writing " + temporaryPath + " failed";
+        return false;
+    }
+
+#ifdef _WIN32
+    bool renamed = MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    bool renamed = std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+#endif
+    if (!renamed)
+    {
+        std::remove(temporaryPath.c_str());
+        error = "cannot replace " + path;
+        return false;
+    }
+
+    return true;
+}
+
+void AtomicFileWriter::Close()
+{
+    if (file != nullptr)
+    {
+        std::fclose(file);
+        file = nullptr;
+        std::remove(temporaryPath.c_str());
+    }
+}
+
+bool ReadFile(const std::string& path, std::string& contents)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#ifndef ATOMIC_FILE_H_
+#define ATOMIC_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Replaces path with contents so that readers, and a crash at any point, see either the
+// old file or the complete new one: the contents go to path + ".tmp", are flushed to disk,
+// and the temporary file is then renamed over path.
+bool WriteFileAtomically(const std::string& path, const std::string& contents, std::string& error);
+
+// Writes a file too large to assemble in memory with the same guarantee: the pieces go to
+// path + ".tmp" in any order, and Commit flushes it to disk and renames it over path. A
+// writer closed or destroyed without committing removes the temporary file.
+class AtomicFileWriter
+{
+public:
+    AtomicFileWriter();
+    ~AtomicFileWriter();
+
+    AtomicFileWriter(const AtomicFileWriter&) = delete;
+    AtomicFileWriter& operator=(const AtomicFileWriter&) = delete;
+
+    bool Open(const std::string& path, std::string& error);
+    // Writes size bytes at offset; bytes never written read as zeros.
+    bool Write(uint64_t offset, const void* data, size_t size, std::string& error);
+    bool Commit(std::string& error);
+    void Close();
+
+private:
+    std::FILE* file;
+    std::string path;
+    std::string temporaryPath;
+};
+
+// Reads a whole file. Returns false if it cannot be opened.
+bool ReadFile(const std::string& path, std::string& contents);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,447 @@
+// Microbenchmarks of the per-pyramid hot paths and end-to-end sweeps, with an optional
+// comparison against a baseline written by an earlier run.
+//
+// Built by the Benchmarks target of CMakeLists.txt, or by hand from every source but
+// PyramidExperiments.cpp:
+//   g++ -O2 -std=c++17 -pthread -o Benchmarks $(ls *.cpp | grep -v PyramidExperiments.cpp)
+// The benchmark-gate target runs it against BenchmarkBaseline.json.
+//
+// Usage: Benchmarks [--filter text] [--min-time seconds] [--repetitions count]
+//                   [--baseline BenchmarkBaseline.json [--max-regression fraction]]
+//                   [--write-baseline out.json]
+//
+// Every benchmark counts pyramids: one per constructed pyramid, per search or per (base length,
+// height) the sweep covers. Allocations are counted by the global operator new below. Each
+// benchmark is timed in --repetitions windows (5 by default) of at least --min-time seconds;
+// ns/pyramid is the median window, pyramids/s the best one and the spread how much slower
+// the worst window was than the best. Noise only ever slows a window down, so the best is
+// the steadiest figure to compare. With --baseline the run fails when a benchmark's best
+// pyramids per second drop by more than --max-regression (0.3 by default, above the spread
+// of repeated runs on a busy machine) against the baseline entry of the same name.
+#include "ClosestKernel.h"
+#include "MathUtilities.h"
+#include "Pyramid.h"
+#include "PyramidBatch.h"
+#include "RatioEvaluation.h"
+#include "Sweep.h"
+#include "TargetCatalog.h"
+#include "WorkStealingScheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::atomic<int64_t> allocationCount(0);
+
+// Keeps the optimizer from dropping the measured work.
+volatile double sink;
+
+constexpr int GRID_SIZE = 1000;
+constexpr double DEFAULT_MIN_TIME = 0.2;
+constexpr int DEFAULT_REPETITIONS = 5;
+constexpr double DEFAULT_MAX_REGRESSION = 0.3;
+
+struct BenchmarkResult
+{
+    std::string name;
+    // The median repetition.
+    double nanosecondsPerPyramid;
+    // The best repetition.
+    double pyramidsPerSecond;
+    // The slowest repetition's time over the fastest's, minus one.
+    double spread;
+    double allocationsPerPyramid;
+};
+
+struct BenchmarkOptions
+{
+    std::string filter;
+    double minTime = DEFAULT_MIN_TIME;
+    int repetitions = DEFAULT_REPETITIONS;
+    std::string baselinePath;
+    double maxRegression = DEFAULT_MAX_REGRESSION;
+    std::string writtenBaselinePath;
+};
+
+// Calls run, which returns how many pyramids it processed, until minTime has passed, in each
+// of repetitions separately timed windows.
+template <typename Run>
+BenchmarkResult Measure(const std::string& name, double minTime, int repetitions, Run run)
+{
+    // Once untimed, for the caches and the lazily built tables.
+    run();
+
+    std::vector<double> nanosecondsPerPyramid;
+    int64_t totalPyramidCount = 0;
+    int64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+    for (int repetition = 0; repetition < repetitions; ++repetition)
+    {
+        int64_t pyramidCount = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        double seconds = 0.0;
+        do
+        {
+            pyramidCount += run();
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        while (seconds < minTime);
+        nanosecondsPerPyramid.push_back(seconds * 1.0E9 / (double) pyramidCount);
+        totalPyramidCount += pyramidCount;
+    }
+    int64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+    std::sort(nanosecondsPerPyramid.begin(), nanosecondsPerPyramid.end());
+
+    BenchmarkResult result;
+    result.name = name;
+    result.nanosecondsPerPyramid = nanosecondsPerPyramid[nanosecondsPerPyramid.size() / 2];
+    result.pyramidsPerSecond = 1.0E9 / nanosecondsPerPyramid.front();
+    result.spread = nanosecondsPerPyramid.back() / nanosecondsPerPyramid.front() - 1.0;
+    result.allocationsPerPyramid = (double) allocations / (double) totalPyramidCount;
+    return result;
+}
+
+std::vector<std::pair<int, int>> CreateGrid(int size)
+{
+    std::vector<std::pair<int, int>> grid;
+    for (int baseLength = 1; baseLength <= size; ++baseLength)
+    {
+        for (int height = 1; height <= size; ++height)
+        {
+            grid.emplace_back(baseLength, height);
+        }
+    }
+    return grid;
+}
+
+// A sweep over every base length and height up to gridSize with no volume band, the default
+// targets and Khufu's errors as the reference.
+SweepOptions CreateSweepOptions(int gridSize, int threadCount)
+{
+    TargetCatalog targets = TargetCatalog::CreateDefault();
+    Pyramid khufu(440, 280);
+
+    SweepOptions options;
+    options.minBaseLength = 1;
+    options.maxBaseLength = gridSize;
+    options.minHeight = 1;
+    options.maxHeight = gridSize;
+    options.minVolume = 0.0;
+    options.maxVolume = std::numeric_limits<double>::max();
+    options.minHeightToBaseRatio = 1.0 / 3.0;
+    options.maxHeightToBaseRatio = 3.0;
+    options.excludedHeightToBaseRatio = MathUtilities::ReduceFraction(280, 440);
+    options.targets = targets;
+    options.khufuRelativeErrorSum = 0.0;
+    for (const Target& target : targets.GetTargets())
+    {
+        double relativeError = MathUtilities::CalculateRelativeError(khufu.GetClosest(target.value).value, target.value);
+        options.khufuRelativeErrors.push_back(relativeError);
+        options.khufuRelativeErrorSum += target.inCombinedSum ? relativeError : 0.0;
+    }
+    options.hitTolerance = 1.0E-4;
+    options.leaderboardSize = 0;
+    options.threadCount = threadCount;
+    return options;
+}
+
+std::vector<BenchmarkResult> RunBenchmarks(const BenchmarkOptions& options)
+{
+    std::vector<BenchmarkResult> results;
+    auto add = [&](const std::string& name, const std::function<int64_t()>& run)
+    {
+        if (name.find(options.filter) == std::string::npos)
+        {
+            return;
+        }
+        results.push_back(Measure(name, options.minTime, options.repetitions, run));
+        const BenchmarkResult& result = results.back();
+        std::cout << std::left << std::setw(36) << result.name << std::right << std::fixed << std::setprecision(2)
+            << std::setw(12) << result.nanosecondsPerPyramid << " ns/pyramid" << std::setw(16) << std::setprecision(0) << result.pyramidsPerSecond
+            << " pyramids/s" << std::setw(8) << std::setprecision(1) << result.spread * 100.0 << "% spread"
+            << std::setw(10) << std::setprecision(3) << result.allocationsPerPyramid << " allocations/pyramid\n";
+    };
+
+    std::vector<std::pair<int, int>> grid = CreateGrid(GRID_SIZE);
+    std::vector<Pyramid> pyramids;
+    for (const std::pair<int, int>& pyramid : grid)
+    {
+        pyramids.emplace_back(pyramid.first, pyramid.second);
+    }
+    TargetCatalog targets = TargetCatalog::CreateDefault();
+
+    add("pyramid/construct", [&]()
+    {
+        double sum = 0.0;
+        for (const std::pair<int, int>& pyramid : grid)
+        {
+            sum += Pyramid(pyramid.first, pyramid.second).GetVolume();
+        }
+        sink = sum;
+        return (int64_t) grid.size();
+    });
+
+    std::vector<int> baseLengths;
+    std::vector<int> heights;
+    for (const std::pair<int, int>& pyramid : grid)
+    {
+        baseLengths.push_back(pyramid.first);
+        heights.push_back(pyramid.second);
+    }
+    PyramidBatch batch;
+    add("pyramid/batch", [&]()
+    {
+        double sum = 0.0;
+        for (size_t begin = 0; begin < grid.size(); begin += 256)
+        {
+            size_t count = std::min<size_t>(256, grid.size() - begin);
+            batch.Calculate(baseLengths.data() + begin, heights.data() + begin, count);
+            sum += batch.GetColumn(PyramidDimension::VOLUME)[0];
+        }
+        sink = sum;
+        return (int64_t) grid.size();
+    });
+
+    add("math/reduce-fraction", [&]()
+    {
+        int64_t sum = 0;
+        for (const std::pair<int, int>& pyramid : grid)
+        {
+            sum += MathUtilities::ReduceFraction(pyramid.second, pyramid.first).first;
+        }
+        sink = (double) sum;
+        return (int64_t) grid.size();
+    });
+
+    ClosestKernelType defaultKernel = ClosestKernel::GetKernel();
+    for (int kernel = 0; kernel < (int) (sizeof(ClosestKernelTypeStrings) / sizeof(ClosestKernelTypeStrings[0])); ++kernel)
+    {
+        if (!ClosestKernel::SetKernel((ClosestKernelType) kernel))
+        {
+            continue;
+        }
+        add(std::string("closest/") + ClosestKernelTypeStrings[kernel], [&]()
+        {
+            int64_t sum = 0;
+            for (const Pyramid& pyramid : pyramids)
+            {
+                sum += ClosestKernel::FindClosestCandidate(pyramid.GetDimensions().data(), targets[0].value);
+            }
+            sink = (double) sum;
+            return (int64_t) pyramids.size();
+        });
+    }
+    ClosestKernel::SetKernel(defaultKernel);
+
+    add("closest/get-closest", [&]()
+    {
+        double sum = 0.0;
+        for (const Pyramid& pyramid : pyramids)
+        {
+            sum += pyramid.GetClosest(targets[0].value).value;
+        }
+        sink = sum;
+        return (int64_t) pyramids.size();
+    });
+
+    add("ratio/evaluate", [&]()
+    {
+        double sum = 0.0;
+        for (const Pyramid& pyramid : pyramids)
+        {
+            sum += RatioEvaluator::Evaluate(pyramid, targets).relativeErrorSum;
+        }
+        sink = sum;
+        return (int64_t) pyramids.size();
+    });
+
+    const int threadCounts[] = { 1, WorkStealingScheduler::GetDefaultThreadCount() };
+    for (int gridSize : { 250, 500, 1000 })
+    {
+        for (int t = 0; t < 2; ++t)
+        {
+            SweepOptions sweepOptions = CreateSweepOptions(gridSize, threadCounts[t]);
+            add("sweep/grid-" + std::to_string(gridSize) + (t == 0 ? "/threads-1" : "/threads-all"), [&]()
+            {
+                SweepEngine engine(sweepOptions);
+                SweepAccumulator accumulator = engine.Run();
+                sink = accumulator.minRelativeErrorSum;
+                return accumulator.pyramidCount;
+            });
+        }
+    }
+
+    return results;
+}
+
+void WriteBaseline(const std::string& path, const std::vector<BenchmarkResult>& results)
+{
+    std::ofstream file(path);
+    file << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchmarkResult& result = results[i];
+        file << "    { \"name\": \"" << result.name << "\", \"nsPerPyramid\": " << std::setprecision(6) << result.nanosecondsPerPyramid
+            << ", \"pyramidsPerSecond\": " << result.pyramidsPerSecond << ", \"spread\": " << result.spread << ", \"allocationsPerPyramid\": " << result.allocationsPerPyramid << " }"
+            << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+    file << "  ]\n}\n";
+}
+
+// Reads the name and pyramidsPerSecond of every entry of a file written by WriteBaseline.
+bool ReadBaseline(const std::string& path, std::map<std::string, double>& pyramidsPerSecond)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+
+    std::stringstream contents;
+    contents << file.rdbuf();
+    std::string text = contents.str();
+
+    const std::string nameKey = "\"name\": \"";
+    const std::string throughputKey = "\"pyramidsPerSecond\": ";
+    for (size_t position = text.find(nameKey); position != std::string::npos; position = text.find(nameKey, position))
+    {
+        position += nameKey.size();
+        size_t nameEnd = text.find('"', position);
+        size_t throughput = text.find(throughputKey, nameEnd);
+        if (nameEnd == std::string::npos || throughput == std::string::npos)
+        {
+            return false;
+        }
+        pyramidsPerSecond[text.substr(position, nameEnd - position)] = std::atof(text.c_str() + throughput + throughputKey.size());
+    }
+    return true;
+}
+
+}
+
+// GCC takes the free of a replaced operator delete for a mismatch with the built-in new.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size > 0 ? size : 1))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    operator delete(memory);
+}
+
+#pragma GCC diagnostic pop
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        if (argument == "--filter" && i + 1 < argc)
+        {
+            options.filter = argv[++i];
+        }
+        else if (argument == "--min-time" && i + 1 < argc)
+        {
+            options.minTime = std::atof(argv[++i]);
+        }
+        else if (argument == "--repetitions" && i + 1 < argc)
+        {
+            options.repetitions = std::atoi(argv[++i]);
+            if (options.repetitions < 1)
+            {
+                std::cerr << "--repetitions expects a positive count\n";
+                return 1;
+            }
+        }
+        else if (argument == "--baseline" && i + 1 < argc)
+        {
+            options.baselinePath = argv[++i];
+        }
+        else if (argument == "--max-regression" && i + 1 < argc)
+        {
+            options.maxRegression = std::atof(argv[++i]);
+        }
+        else if (argument == "--write-baseline" && i + 1 < argc)
+        {
+            options.writtenBaselinePath = argv[++i];
+        }
+        else
+        {
+            std::cerr << "unknown argument: " << argument << '\n';
+            return 1;
+        }
+    }
+
+    std::map<std::string, double> baseline;
+    if (!options.baselinePath.empty() && !ReadBaseline(options.baselinePath, baseline))
+    {
+        std::cerr << "cannot read the baseline " << options.baselinePath << '\n';
+        return 1;
+    }
+
+    std::vector<BenchmarkResult> results = RunBenchmarks(options);
+
+    if (!options.writtenBaselinePath.empty())
+    {
+        WriteBaseline(options.writtenBaselinePath, results);
+    }
+
+    if (options.baselinePath.empty())
+    {
+        return 0;
+    }
+
+    int regressionCount = 0;
+    std::cout << '\n';
+    for (const BenchmarkResult& result : results)
+    {
+        std::map<std::string, double>::const_iterator entry = baseline.find(result.name);
+        if (entry == baseline.end() || entry->second <= 0.0)
+        {
+            std::cout << std::left << std::setw(36) << result.name << " not in the baseline\n";
+            continue;
+        }
+
+        double change = result.pyramidsPerSecond / entry->second - 1.0;
+        bool regressed = change < -options.maxRegression;
+        regressionCount += regressed ? 1 : 0;
+        std::cout << std::left << std::setw(36) << result.name << std::right << std::showpos << std::setw(9) << std::setprecision(1) << change * 100.0
+            << std::noshowpos << "% pyramids/s" << (regressed ? "  REGRESSION" : "") << '\n';
+    }
+
+    if (regressionCount > 0)
+    {
+        std::cerr << regressionCount << " benchmarks regressed by more than " << options.maxRegression * 100.0 << "%\n";
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
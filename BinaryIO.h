@@ -0,0 +1,53 @@
+#ifndef BINARY_IO_H_
+#define BINARY_IO_H_
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <type_traits>
+#include <vector>
+
+// Raw native-byte-order reads and writes of plain values and vectors of them, for the
+// snapshot files. Readers return false on a short read or an implausible vector size.
+namespace BinaryIO
+{
+
+constexpr uint64_t MAX_VECTOR_SIZE = 1ull << 32;
+
+template <typename T>
+void Write(std::ostream& stream, const T& value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "BinaryIO writes plain values only");
+    stream.write((const char*) &value, sizeof(value));
+}
+
+template <typename T>
+bool Read(std::istream& stream, T& value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "BinaryIO reads plain values only");
+    return (bool) stream.read((char*) &value, sizeof(value));
+}
+
+template <typename T>
+void WriteVector(std::ostream& stream, const std::vector<T>& values)
+{
+    Write(stream, (uint64_t) values.size());
+    stream.write((const char*) values.data(), (std::streamsize) (values.size() * sizeof(T)));
+}
+
+template <typename T>
+bool ReadVector(std::istream& stream, std::vector<T>& values)
+{
+    uint64_t size;
+    if (!Read(stream, size) || size > MAX_VECTOR_SIZE)
+    {
+        return false;
+    }
+
+    values.resize((size_t) size);
+    return (bool) stream.read((char*) values.data(), (std::streamsize) (values.size() * sizeof(T)));
+}
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include "CandidateIndex.h"
+
+#include <algorithm>
+
+CandidateIndex::CandidateIndex(const Pyramid& pyramid):
+    pyramid(pyramid)
+{
+    const double* dimensions = pyramid.GetDimensions().data();
+    std::array<IndexedCandidate, ClosestKernel::CANDIDATE_COUNT> buffer;
+    int varyingCount = 0;
+    for (int n = 0; n < ClosestKernel::CANDIDATE_COUNT; ++n)
+    {
+        if (!ClosestKernel::IsInvariantCandidate(n))
+        {
+            buffer[varyingCount].value = ClosestKernel::CalculateCandidateValue(dimensions, n);
+            buffer[varyingCount].candidate = n;
+            ++varyingCount;
+        }
+    }
+
+    auto lessByValue = [](const IndexedCandidate& a, const IndexedCandidate& b)
+    {
+        return a.value < b.value;
+    };
+
+    // A pair's candidates are its ratio times the ascending allowedFactors, so the varying
+    // candidates are already made of sorted runs. Merge them bottom-up.
+    std::array<IndexedCandidate, ClosestKernel::CANDIDATE_COUNT>* source = &buffer;
+    std::array<IndexedCandidate, ClosestKernel::CANDIDATE_COUNT>* destination = &candidates;
+    for (int runLength = (int) allowedFactors.size(); runLength < varyingCount; runLength *= 2)
+    {
+        for (int left = 0; left < varyingCount; left += 2 * runLength)
+        {
+            int middle = std::min(left + runLength, varyingCount);
+            int right = std::min(left + 2 * runLength, varyingCount);
+            std::merge(source->begin() + left, source->begin() + middle, source->begin() + middle, source->begin() + right, destination->begin() + left, lessByValue);
+        }
+
+        std::swap(source, destination);
+    }
+
+    // The invariant candidates come presorted; one last merge adds them.
+    const IndexedCandidate* invariantCandidates = ClosestKernel::GetInvariantCandidates();
+    std::merge(source->begin(), source->begin() + varyingCount, invariantCandidates, invariantCandidates + ClosestKernel::GetInvariantCandidateCount(), destination->begin(), lessByValue);
+
+    if (destination != &candidates)
+    {
+        candidates = *destination;
+    }
+}
+
+const Pyramid& CandidateIndex::GetPyramid() const
+{
+    return pyramid;
+}
+
+const std::array<IndexedCandidate, ClosestKernel::CANDIDATE_COUNT>& CandidateIndex::GetCandidates() const
+{
+    return candidates;
+}
+
+GetClosestResult CandidateIndex::GetClosest(double target) const
+{
+    return pyramid.GetCandidateResult(FindClosestCandidate(target));
+}
+
+int CandidateIndex::FindClosestCandidate(double target) const
+{
+    return ClosestKernel::FindClosestInSorted(candidates.data(), (int) candidates.size(), target);
+}
+
+void CandidateIndex::FindClosestCandidates(const double* sortedTargets, size_t targetCount, int* closestCandidates) const
+{
+    const int size = (int) candidates.size();
+
+    int position = 0;
+    for (size_t i = 0; i < targetCount; ++i)
+    {
+        while (position < size && candidates[position].value < sortedTargets[i])
+        {
+            ++position;
+        }
+
+        closestCandidates[i] = ResolveClosest(position, sortedTargets[i]);
+    }
+}
+
+int CandidateIndex::ResolveClosest(int position, double target) const
+{
+    return ClosestKernel::ResolveClosest(candidates.data(), (int) candidates.size(), position, target);
+}
\ No newline at end of file
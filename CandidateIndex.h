@@ -0,0 +1,37 @@
+#ifndef CANDIDATE_INDEX_H_
+#define CANDIDATE_INDEX_H_
+
+#include "ClosestKernel.h"
+#include "Pyramid.h"
+
+#include <array>
+
+// Every value GetClosest can return for one pyramid, sorted once so that each target is a
+// binary search instead of a scan over all pairs and factors. Candidates are tagged with
+// their ClosestKernel candidate number, which gives their (dimension1, dimension2, factor)
+// provenance and, among equally close values, the one GetClosest would pick.
+class CandidateIndex
+{
+public:
+    explicit CandidateIndex(const Pyramid& pyramid);
+
+    GetClosestResult GetClosest(double target) const;
+    int FindClosestCandidate(double target) const;
+
+    // Scores targets given in ascending order in a single merge pass over the sorted
+    // candidates, so a whole catalog costs one walk rather than one search per target.
+    void FindClosestCandidates(const double* sortedTargets, size_t targetCount, int* closestCandidates) const;
+
+    const Pyramid& GetPyramid() const;
+    const std::array<IndexedCandidate, ClosestKernel::CANDIDATE_COUNT>& GetCandidates() const;
+
+    // Returns the candidate GetClosest would pick among the equally close candidates around
+    // position, the index of the first sorted value >= target.
+    int ResolveClosest(int position, double target) const;
+
+private:
+    Pyramid pyramid;
+    std::array<IndexedCandidate, ClosestKernel::CANDIDATE_COUNT> candidates;
+};
+
+#endif
\ No newline at end of file
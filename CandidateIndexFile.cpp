@@ -0,0 +1,435 @@
+#include "CandidateIndexFile.h"
+#include "AtomicFile.h"
+#include "ClosestKernel.h"
+#include "MathUtilities.h"
+#include "Sweep.h"
+#include "WorkStealingScheduler.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <utility>
+
+namespace
+{
+
+constexpr char FILE_MAGIC[8] = { 'P', 'Y', 'R', 'I', 'D', 'X', '1', '\0' };
+
+size_t PadTo8(size_t bytes)
+{
+    return (bytes + 7) & ~(size_t) 7;
+}
+
+}
+
+CandidateIndexFile::Layout CandidateIndexFile::CalculateLayout(uint64_t ratioCount, uint32_t pairCount)
+{
+    Layout layout;
+    layout.pairs = PadTo8(sizeof(Header));
+    layout.reducedHeight = layout.pairs + PadTo8(2 * (size_t) pairCount);
+    layout.reducedBaseLength = layout.reducedHeight + PadTo8(ratioCount * sizeof(int32_t));
+    layout.dimensions = layout.reducedBaseLength + PadTo8(ratioCount * sizeof(int32_t));
+    layout.sortedPairs = layout.dimensions + ratioCount * PYRAMID_DIMENSION_COUNT * sizeof(double);
+    layout.size = layout.sortedPairs + PadTo8(ratioCount * pairCount);
+    return layout;
+}
+
+CandidateIndexFile::VaryingPairs CandidateIndexFile::FindVaryingPairs()
+{
+    VaryingPairs varyingPairs;
+    for (int candidate = 0; candidate < ClosestKernel::CANDIDATE_COUNT; ++candidate)
+    {
+        const ClosestKernel::Candidate& c = ClosestKernel::GetCandidate(candidate);
+        if (c.factorIndex == 0 && !ClosestKernel::IsInvariantCandidate(candidate))
+        {
+            varyingPairs.dimension1.push_back((uint8_t) c.dimension1);
+            varyingPairs.dimension2.push_back((uint8_t) c.dimension2);
+            varyingPairs.firstCandidates.push_back(candidate);
+            varyingPairs.groups.push_back(ClosestKernel::GetCandidateGroup(candidate));
+        }
+    }
+    return varyingPairs;
+}
+
+bool CandidateIndexFile::Build(const std::string& path, const SweepOptions& options, std::string& error)
+{
+    // The coprime ratios in the window whose multiples reach inside the dimension bounds, in
+    // the order the sweep's Farey walk visits them.
+    SweepEngine engine(options);
+    std::vector<int32_t> heights;
+    std::vector<int32_t> baseLengths;
+    if (options.maxBaseLength >= 1 && options.maxBaseLength >= options.minBaseLength && options.maxHeight >= options.minHeight)
+    {
+        std::pair<int64_t, int64_t> start = MathUtilities::FindFareyFloor(std::max(0.0, options.minHeightToBaseRatio), options.maxBaseLength);
+        MathUtilities::FareySequence ratios(options.maxBaseLength, start.first, start.second);
+        for (; (double) ratios.GetNumerator() / (double) ratios.GetDenominator() <= options.maxHeightToBaseRatio; ratios.Next())
+        {
+            int64_t height = ratios.GetNumerator();
+            int64_t baseLength = ratios.GetDenominator();
+            std::pair<int64_t, int64_t> multiples = engine.FindDimensionMultiples(height, baseLength);
+            if (height >= 1 && height <= options.maxHeight && (double) height / (double) baseLength >= options.minHeightToBaseRatio && multiples.first <= multiples.second)
+            {
+                heights.push_back((int32_t) height);
+                baseLengths.push_back((int32_t) baseLength);
+            }
+        }
+    }
+
+    VaryingPairs varyingPairs = FindVaryingPairs();
+    uint32_t pairCount = (uint32_t) varyingPairs.firstCandidates.size();
+    uint64_t ratioCount = heights.size();
+    Layout layout = CalculateLayout(ratioCount, pairCount);
+
+    Header header = {};
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version = VERSION;
+    header.dimensionCount = PYRAMID_DIMENSION_COUNT;
+    header.pairCount = pairCount;
+    header.ratioCount = ratioCount;
+    header.minBaseLength = options.minBaseLength;
+    header.maxBaseLength = options.maxBaseLength;
+    header.minHeight = options.minHeight;
+    header.maxHeight = options.maxHeight;
+    header.minHeightToBaseRatio = options.minHeightToBaseRatio;
+    header.maxHeightToBaseRatio = options.maxHeightToBaseRatio;
+
+    // The gaps between sections read as zeros, but the last section's padding has to be
+    // written for the file to reach layout.size.
+    AtomicFileWriter writer;
+    const uint8_t padding[8] = {};
+    size_t tailPadding = layout.size - (layout.sortedPairs + ratioCount * pairCount);
+    if (!writer.Open(path, error)
+        || !writer.Write(0, &header, sizeof(header), error)
+        || !writer.Write(layout.pairs, varyingPairs.dimension1.data(), pairCount, error)
+        || !writer.Write(layout.pairs + pairCount, varyingPairs.dimension2.data(), pairCount, error)
+        || !writer.Write(layout.reducedHeight, heights.data(), ratioCount * sizeof(int32_t), error)
+        || !writer.Write(layout.reducedBaseLength, baseLengths.data(), ratioCount * sizeof(int32_t), error)
+        || !writer.Write(layout.size - tailPadding, padding, tailPadding, error))
+    {
+        return false;
+    }
+
+    // The dimensions and sortedPairs sections are filled a round of batches at a time and
+    // written out before the next round, so the build holds a few batches, not the index.
+    uint32_t batchCount = (uint32_t) ((ratioCount + BUILD_BATCH_SIZE - 1) / BUILD_BATCH_SIZE);
+    WorkStealingScheduler scheduler(options.threadCount);
+    uint32_t roundBatchCount = BUILD_BATCHES_PER_THREAD * (uint32_t) scheduler.GetThreadCount();
+    std::vector<double> dimensionColumn((size_t) roundBatchCount * BUILD_BATCH_SIZE * PYRAMID_DIMENSION_COUNT);
+    std::vector<uint8_t> sortedPairColumn((size_t) roundBatchCount * BUILD_BATCH_SIZE * pairCount);
+    for (uint32_t roundBegin = 0; roundBegin < batchCount; roundBegin += roundBatchCount)
+    {
+        // The batches fill disjoint ranges of the round's columns.
+        size_t roundRatioBegin = (size_t) roundBegin * BUILD_BATCH_SIZE;
+        size_t roundRatioCount = std::min<size_t>((size_t) roundBatchCount * BUILD_BATCH_SIZE, ratioCount - roundRatioBegin);
+        scheduler.Run(std::min(roundBatchCount, batchCount - roundBegin), [&](int, uint32_t batch)
+        {
+            size_t begin = (size_t) batch * BUILD_BATCH_SIZE;
+            size_t count = std::min<size_t>(BUILD_BATCH_SIZE, roundRatioCount - begin);
+            PyramidBatch pyramids;
+            pyramids.Calculate(baseLengths.data() + roundRatioBegin + begin, heights.data() + roundRatioBegin + begin, count);
+
+            std::vector<double> pairRatios(pairCount);
+            std::vector<uint8_t> order(pairCount);
+            for (size_t i = 0; i < count; ++i)
+            {
+                double* entryDimensions = dimensionColumn.data() + (begin + i) * PYRAMID_DIMENSION_COUNT;
+                for (int d = 0; d < PYRAMID_DIMENSION_COUNT; ++d)
+                {
+                    entryDimensions[d] = pyramids.GetColumn((PyramidDimension) d)[i];
+                }
+
+                for (uint32_t p = 0; p < pairCount; ++p)
+                {
+                    pairRatios[p] = entryDimensions[varyingPairs.dimension1[p]] / entryDimensions[varyingPairs.dimension2[p]];
+                }
+                std::iota(order.begin(), order.end(), (uint8_t) 0);
+                std::stable_sort(order.begin(), order.end(), [&](uint8_t a, uint8_t b) { return pairRatios[a] < pairRatios[b]; });
+                std::memcpy(sortedPairColumn.data() + (begin + i) * pairCount, order.data(), pairCount);
+            }
+        });
+
+        if (!writer.Write(layout.dimensions + roundRatioBegin * PYRAMID_DIMENSION_COUNT * sizeof(double), dimensionColumn.data(), roundRatioCount * PYRAMID_DIMENSION_COUNT * sizeof(double), error)
+            || !writer.Write(layout.sortedPairs + roundRatioBegin * pairCount, sortedPairColumn.data(), roundRatioCount * pairCount, error))
+        {
+            return false;
+        }
+    }
+
+    return writer.Commit(error);
+}
+
+bool CandidateIndexFile::Open(const std::string& path, std::string& error)
+{
+    Close();
+
+    if (!file.Open(path, "candidate index", error))
+    {
+        return false;
+    }
+
+    if (!Parse(error))
+    {
+        Close();
+        error = path + ": " + error;
+        return false;
+    }
+
+    return true;
+}
+
+void CandidateIndexFile::Close()
+{
+    file.Close();
+    header = {};
+    pairs = VaryingPairs();
+    reducedHeight = nullptr;
+    reducedBaseLength = nullptr;
+    dimensions = nullptr;
+    sortedPairs = nullptr;
+}
+
+bool CandidateIndexFile::Parse(std::string& error)
+{
+    const uint8_t* data = file.GetData();
+    if (file.GetSize() < sizeof(Header) || std::memcmp(data, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0)
+    {
+        error = "not a candidate index";
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+
+    if (header.version != VERSION)
+    {
+        error = "unsupported candidate index version " + std::to_string(header.version);
+        return false;
+    }
+
+    Layout layout = CalculateLayout(header.ratioCount, header.pairCount);
+    if (header.ratioCount > file.GetSize() || file.GetSize() != layout.size)
+    {
+        error = "truncated or corrupt candidate index";
+        return false;
+    }
+
+    // The pairs and the dimensions are this binary's, or the stored order means nothing.
+    pairs = FindVaryingPairs();
+    if (header.dimensionCount != PYRAMID_DIMENSION_COUNT || header.pairCount != pairs.firstCandidates.size()
+        || std::memcmp(data + layout.pairs, pairs.dimension1.data(), header.pairCount) != 0
+        || std::memcmp(data + layout.pairs + header.pairCount, pairs.dimension2.data(), header.pairCount) != 0)
+    {
+        error = "the candidate index was built for different pyramid dimensions or candidates; rebuild it";
+        return false;
+    }
+
+    reducedHeight = (const int32_t*) (data + layout.reducedHeight);
+    reducedBaseLength = (const int32_t*) (data + layout.reducedBaseLength);
+    dimensions = (const double*) (data + layout.dimensions);
+    sortedPairs = data + layout.sortedPairs;
+
+    // Spot check the stored dimensions against the formulas of this binary.
+    for (uint64_t entry : { (uint64_t) 0, header.ratioCount / 2, header.ratioCount - 1 })
+    {
+        if (entry >= header.ratioCount)
+        {
+            continue;
+        }
+        Pyramid pyramid(reducedBaseLength[entry], reducedHeight[entry]);
+        if (std::memcmp(pyramid.GetDimensions().data(), dimensions + entry * PYRAMID_DIMENSION_COUNT, PYRAMID_DIMENSION_COUNT * sizeof(double)) != 0)
+        {
+            error = "the candidate index was built with different dimension formulas; rebuild it";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool CandidateIndexFile::Covers(const SweepOptions& options, std::string& error) const
+{
+    // A ratio the sweep accepts is inside the sweep's window and has a multiple inside the
+    // sweep's bounds, so it is in an index whose window and bounds contain the sweep's.
+    if (options.minBaseLength < header.minBaseLength || options.maxBaseLength > header.maxBaseLength
+        || options.minHeight < header.minHeight || options.maxHeight > header.maxHeight
+        || options.minHeightToBaseRatio < header.minHeightToBaseRatio || options.maxHeightToBaseRatio > header.maxHeightToBaseRatio)
+    {
+        error = "the candidate index covers base lengths " + std::to_string(header.minBaseLength) + ".." + std::to_string(header.maxBaseLength)
+            + ", heights " + std::to_string(header.minHeight) + ".." + std::to_string(header.maxHeight)
+            + " and height to base ratios " + std::to_string(header.minHeightToBaseRatio) + ".." + std::to_string(header.maxHeightToBaseRatio)
+            + ", not all of the sweep";
+        return false;
+    }
+
+    return true;
+}
+
+uint64_t CandidateIndexFile::GetRatioCount() const
+{
+    return header.ratioCount;
+}
+
+size_t CandidateIndexFile::GetSize() const
+{
+    return file.GetSize();
+}
+
+int64_t CandidateIndexFile::Find(int height, int baseLength) const
+{
+    // Ratios are in increasing order; compare them exactly by cross-multiplying.
+    uint64_t low = 0;
+    uint64_t high = header.ratioCount;
+    while (low < high)
+    {
+        uint64_t middle = low + (high - low) / 2;
+        if ((int64_t) reducedHeight[middle] * baseLength < (int64_t) height * reducedBaseLength[middle])
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    if (low < header.ratioCount && reducedHeight[low] == height && reducedBaseLength[low] == baseLength)
+    {
+        return (int64_t) low;
+    }
+    return -1;
+}
+
+int CandidateIndexFile::GetReducedHeight(uint64_t entry) const
+{
+    return reducedHeight[entry];
+}
+
+int CandidateIndexFile::GetReducedBaseLength(uint64_t entry) const
+{
+    return reducedBaseLength[entry];
+}
+
+const double* CandidateIndexFile::GetDimensions(uint64_t entry) const
+{
+    return dimensions + entry * PYRAMID_DIMENSION_COUNT;
+}
+
+int CandidateIndexFile::FindClosestCandidate(uint64_t entry, double target) const
+{
+    double pairRatios[ClosestKernel::PAIR_COUNT];
+    CalculatePairRatios(entry, pairRatios);
+    return FindClosestCandidate(entry, pairRatios, target);
+}
+
+RatioEvaluation CandidateIndexFile::Evaluate(uint64_t entry, const TargetCatalog& targets) const
+{
+    double pairRatios[ClosestKernel::PAIR_COUNT];
+    CalculatePairRatios(entry, pairRatios);
+
+    std::vector<int> candidates(targets.GetSize());
+    for (size_t i = 0; i < targets.GetSize(); ++i)
+    {
+        candidates[i] = FindClosestCandidate(entry, pairRatios, targets[i].value);
+    }
+
+    std::array<double, PYRAMID_DIMENSION_COUNT> entryDimensions;
+    std::memcpy(entryDimensions.data(), dimensions + entry * PYRAMID_DIMENSION_COUNT, sizeof(entryDimensions));
+    return RatioEvaluator::EvaluateCandidates(Pyramid(entryDimensions), std::move(candidates), targets);
+}
+
+void CandidateIndexFile::CalculatePairRatios(uint64_t entry, double* pairRatios) const
+{
+    const double* entryDimensions = dimensions + entry * PYRAMID_DIMENSION_COUNT;
+    const uint8_t* order = sortedPairs + entry * header.pairCount;
+    for (uint32_t p = 0; p < header.pairCount; ++p)
+    {
+        pairRatios[p] = entryDimensions[pairs.dimension1[order[p]]] / entryDimensions[pairs.dimension2[order[p]]];
+    }
+}
+
+int CandidateIndexFile::FindClosestCandidate(uint64_t entry, const double* pairRatios, double target) const
+{
+    const uint8_t* order = sortedPairs + entry * header.pairCount;
+    int pairCount = (int) header.pairCount;
+
+    // Tallied per group, for the search statistics.
+    int groupCandidateCounts[DIMENSION_GROUPS.size()] = {};
+    auto score = [&](int p, double factor)
+    {
+        ++groupCandidateCounts[pairs.groups[order[p]]];
+        return pairRatios[p] * factor;
+    };
+
+    int closest = -1;
+    double minAbsoluteError = std::numeric_limits<double>::max();
+    for (int k = 0; k < (int) allowedFactors.size(); ++k)
+    {
+        // The first pair whose candidate of this factor is >= target.
+        double factor = allowedFactors[k];
+        int low = 0;
+        int high = pairCount;
+        while (low < high)
+        {
+            int middle = (low + high) / 2;
+            if (score(middle, factor) < target)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+
+        double factorMinAbsoluteError = std::numeric_limits<double>::max();
+        if (low < pairCount)
+        {
+            factorMinAbsoluteError = std::abs(score(low, factor) - target);
+        }
+        if (low > 0)
+        {
+            factorMinAbsoluteError = std::min(factorMinAbsoluteError, std::abs(score(low - 1, factor) - target));
+        }
+        if (factorMinAbsoluteError > minAbsoluteError)
+        {
+            continue;
+        }
+
+        // As in ClosestKernel::ResolveClosest, the candidates that tie for this factor's
+        // minimum sit in an unbroken run on either side of low.
+        auto consider = [&](int p)
+        {
+            int candidate = pairs.firstCandidates[order[p]] + k;
+            if (factorMinAbsoluteError < minAbsoluteError || candidate < closest)
+            {
+                closest = candidate;
+                minAbsoluteError = factorMinAbsoluteError;
+            }
+        };
+        for (int p = low - 1; p >= 0 && std::abs(score(p, factor) - target) == factorMinAbsoluteError; --p)
+        {
+            consider(p);
+        }
+        for (int p = low; p < pairCount && std::abs(score(p, factor) - target) == factorMinAbsoluteError; ++p)
+        {
+            consider(p);
+        }
+    }
+
+    ClosestKernel::CountSearches(1, groupCandidateCounts);
+
+    // Merge in the best invariant candidate the way FindClosestCandidate does.
+    int closestInvariant = ClosestKernel::FindClosestInSorted(ClosestKernel::GetInvariantCandidates(), ClosestKernel::GetInvariantCandidateCount(), target);
+    if (closestInvariant < 0)
+    {
+        return closest;
+    }
+    double invariantAbsoluteError = std::abs(ClosestKernel::CalculateCandidateValue(dimensions + entry * PYRAMID_DIMENSION_COUNT, closestInvariant) - target);
+    if (closest < 0 || invariantAbsoluteError < minAbsoluteError || (invariantAbsoluteError == minAbsoluteError && closestInvariant < closest))
+    {
+        return closestInvariant;
+    }
+
+    return closest;
+}
\ No newline at end of file
@@ -0,0 +1,122 @@
+#ifndef CANDIDATE_INDEX_FILE_H_
+#define CANDIDATE_INDEX_FILE_H_
+
+#include "MappedFile.h"
+#include "RatioEvaluation.h"
+#include "TargetCatalog.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SweepOptions;
+
+// Every coprime height:base ratio of a sweep domain with what GetClosest needs to score it, in
+// a file that later sweeps map instead of recomputing the pyramids. Native byte order.
+//
+//   header:   char magic[8] = "PYRIDX1", uint32 version, uint32 dimensionCount,
+//             uint32 pairCount, uint32 padding, uint64 ratioCount, int32 minBaseLength,
+//             maxBaseLength, minHeight, maxHeight, double minHeightToBaseRatio,
+//             maxHeightToBaseRatio
+//   pairs:    uint8 dimension1[pairCount], uint8 dimension2[pairCount], the varying pairs
+//             of ClosestKernel in candidate order
+//   columns:  reducedHeight, reducedBaseLength (int32), dimensions (double,
+//             dimensionCount per ratio), sortedPairs (uint8, pairCount per ratio)
+//
+// Every section starts 8-byte aligned, and ratios are in increasing order. sortedPairs orders
+// a ratio's varying pairs by dimension1 / dimension2. Multiplying by a factor is monotonic, so
+// the same order sorts the candidates of every factor, and a search is one binary search per
+// factor plus one over ClosestKernel's invariant candidates. It returns the candidate
+// ClosestKernel::FindClosestCandidate does.
+//
+// The domain is the dimension bounds and the height to base ratio window; the volume band and
+// the excluded ratio are left to the sweep, so one index serves any of them.
+class CandidateIndexFile
+{
+public:
+    CandidateIndexFile() = default;
+
+    CandidateIndexFile(const CandidateIndexFile&) = delete;
+    CandidateIndexFile& operator=(const CandidateIndexFile&) = delete;
+
+    static bool Build(const std::string& path, const SweepOptions& options, std::string& error);
+
+    bool Open(const std::string& path, std::string& error);
+    void Close();
+
+    // Fails unless every ratio a sweep with options can accept is in the index.
+    bool Covers(const SweepOptions& options, std::string& error) const;
+
+    uint64_t GetRatioCount() const;
+    size_t GetSize() const;
+
+    // The entry of the coprime ratio height:baseLength, or -1 if it is not in the index.
+    int64_t Find(int height, int baseLength) const;
+    int GetReducedHeight(uint64_t entry) const;
+    int GetReducedBaseLength(uint64_t entry) const;
+    // The entry's PYRAMID_DIMENSION_COUNT dimensions.
+    const double* GetDimensions(uint64_t entry) const;
+
+    int FindClosestCandidate(uint64_t entry, double target) const;
+    RatioEvaluation Evaluate(uint64_t entry, const TargetCatalog& targets) const;
+
+private:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t BUILD_BATCH_SIZE = 1024;
+    static constexpr uint32_t BUILD_BATCHES_PER_THREAD = 16;
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t dimensionCount;
+        uint32_t pairCount;
+        uint32_t padding;
+        uint64_t ratioCount;
+        int32_t minBaseLength;
+        int32_t maxBaseLength;
+        int32_t minHeight;
+        int32_t maxHeight;
+        double minHeightToBaseRatio;
+        double maxHeightToBaseRatio;
+    };
+
+    // Where each section of a file with ratioCount ratios starts.
+    struct Layout
+    {
+        size_t pairs;
+        size_t reducedHeight;
+        size_t reducedBaseLength;
+        size_t dimensions;
+        size_t sortedPairs;
+        size_t size;
+    };
+
+    // ClosestKernel's varying pairs in candidate order, and the number of the first
+    // candidate of each; the candidate of factor k is that number plus k.
+    struct VaryingPairs
+    {
+        std::vector<uint8_t> dimension1;
+        std::vector<uint8_t> dimension2;
+        std::vector<int> firstCandidates;
+        // The position in DIMENSION_GROUPS of each pair's group.
+        std::vector<int> groups;
+    };
+
+    MappedFile file;
+    Header header = {};
+    VaryingPairs pairs;
+    const int32_t* reducedHeight = nullptr;
+    const int32_t* reducedBaseLength = nullptr;
+    const double* dimensions = nullptr;
+    const uint8_t* sortedPairs = nullptr;
+
+    static Layout CalculateLayout(uint64_t ratioCount, uint32_t pairCount);
+    static VaryingPairs FindVaryingPairs();
+    bool Parse(std::string& error);
+    // The entry's pair ratios in sorted order.
+    void CalculatePairRatios(uint64_t entry, double* pairRatios) const;
+    int FindClosestCandidate(uint64_t entry, const double* pairRatios, double target) const;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,868 @@
+#include "ClosestKernel.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CLOSEST_KERNEL_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+// Keeps the compiler from fusing a multiply into the following subtract (AVX-512 implies FMA).
+#define PREVENT_CONTRACTION(x) __asm__("" : "+v"(x))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#define PREVENT_CONTRACTION(x)
+#endif
+
+namespace
+{
+
+using ClosestKernel::Candidate;
+using ClosestKernel::CANDIDATE_COUNT;
+using ClosestKernel::INVARIANT_PROBES;
+using ClosestKernel::INVARIANT_PROBE_TOLERANCE;
+using ClosestKernel::PAIR_COUNT;
+
+// Round the varying pair and candidate lists up to whole float32 AVX-512 vectors.
+constexpr int PADDED_PAIR_COUNT = (PAIR_COUNT + 15) / 16 * 16;
+constexpr int PADDED_CANDIDATE_COUNT = (CANDIDATE_COUNT + 15) / 16 * 16;
+constexpr int PADDED_FACTOR_COUNT = ((int) allowedFactors.size() + 15) / 16 * 16;
+
+// Rounding the dimensions, the factor and the target to float, and the float division,
+// multiplication and subtraction, each move a screened error by at most 2^-24 times the
+// value or the target. So it is within 6 * 2^-24 * (|value| + |target|) of the double error
+// while the dimensions are normal floats; 2^-20 leaves room for rounding the bound itself.
+constexpr float SCREENING_TOLERANCE = 1.0f / (1 << 20);
+
+struct CandidateTable
+{
+    Candidate candidates[CANDIDATE_COUNT];
+    bool invariant[CANDIDATE_COUNT];
+    double invariantValues[CANDIDATE_COUNT];
+
+    // Candidates whose ratio is the same for every pyramid, e.g. BASE_PERIMETER / BASE_LENGTH,
+    // valued once on the unit pyramid and sorted by value.
+    IndexedCandidate invariantCandidates[CANDIDATE_COUNT];
+    int invariantCandidateCount;
+
+    // The remaining pairs divide dimension pairNumerators[p] by pairDenominators[p]; varying
+    // candidate n is pair varyingPairs[n] times factors[varyingFactors[n]] and has candidate
+    // number varyingNumbers[n]. Padding repeats the last entry, which cannot change a minimum.
+    alignas(64) int32_t pairNumerators[PADDED_PAIR_COUNT];
+    alignas(64) int32_t pairDenominators[PADDED_PAIR_COUNT];
+    // A varying pair's candidates are numbered consecutively by factor from this one.
+    alignas(64) double pairFirstNumbers[PADDED_PAIR_COUNT];
+    int varyingPairCount;
+
+    // Varying pairs [groupPairBegin[g], groupPairEnd[g]) belong to DIMENSION_GROUPS[g].
+    int groupPairBegin[DIMENSION_GROUPS.size()];
+    int groupPairEnd[DIMENSION_GROUPS.size()];
+    int groupVaryingCandidateCounts[DIMENSION_GROUPS.size()];
+
+    alignas(64) int32_t varyingPairs[PADDED_CANDIDATE_COUNT];
+    alignas(64) int32_t varyingFactors[PADDED_CANDIDATE_COUNT];
+    alignas(64) double varyingNumbers[PADDED_CANDIDATE_COUNT];
+    int varyingCandidateCount;
+
+    alignas(64) double factors[allowedFactors.size()];
+    // Padded to whole float32 vectors.
+    alignas(64) float floatFactors[PADDED_FACTOR_COUNT];
+
+    CandidateTable():
+        invariantCandidateCount(0),
+        varyingPairCount(0),
+        varyingCandidateCount(0)
+    {
+        for (int k = 0; k < (int) allowedFactors.size(); ++k)
+        {
+            factors[k] = allowedFactors[k];
+        }
+        for (int k = 0; k < PADDED_FACTOR_COUNT; ++k)
+        {
+            floatFactors[k] = k < (int) allowedFactors.size() ? (float) allowedFactors[k] : 0.0f;
+        }
+
+        std::vector<Pyramid> probes;
+        for (const std::pair<int, int>& probe : INVARIANT_PROBES)
+        {
+            probes.emplace_back(probe.first, probe.second);
+        }
+
+        int candidate = 0;
+        for (size_t g = 0; g < DIMENSION_GROUPS.size(); ++g)
+        {
+            const DimensionGroup& group = DIMENSION_GROUPS[g];
+            groupPairBegin[g] = varyingPairCount;
+            for (int i = group.begin; i < group.end; ++i)
+            {
+                for (int j = group.begin; j < group.end; ++j)
+                {
+                    if (i == j)
+                    {
+                        continue;
+                    }
+
+                    double unitRatio = probes[0].GetDimensions()[i] / probes[0].GetDimensions()[j];
+                    bool isInvariant = true;
+                    for (const Pyramid& probe : probes)
+                    {
+                        double ratio = probe.GetDimensions()[i] / probe.GetDimensions()[j];
+                        isInvariant = isInvariant && std::abs(ratio - unitRatio) <= INVARIANT_PROBE_TOLERANCE * unitRatio;
+                    }
+
+                    if (!isInvariant)
+                    {
+                        pairNumerators[varyingPairCount] = i;
+                        pairDenominators[varyingPairCount] = j;
+                        pairFirstNumbers[varyingPairCount] = candidate;
+                    }
+
+                    for (int k = 0; k < (int) allowedFactors.size(); ++k)
+                    {
+                        candidates[candidate] = { (PyramidDimension) i, (PyramidDimension) j, k };
+                        invariant[candidate] = isInvariant;
+                        invariantValues[candidate] = unitRatio * factors[k];
+
+                        if (isInvariant)
+                        {
+                            invariantCandidates[invariantCandidateCount++] = { invariantValues[candidate], candidate };
+                        }
+                        else
+                        {
+                            varyingPairs[varyingCandidateCount] = varyingPairCount;
+                            varyingFactors[varyingCandidateCount] = k;
+                            varyingNumbers[varyingCandidateCount] = candidate;
+                            ++varyingCandidateCount;
+                        }
+
+                        ++candidate;
+                    }
+
+                    if (!isInvariant)
+                    {
+                        ++varyingPairCount;
+                    }
+                }
+            }
+            groupPairEnd[g] = varyingPairCount;
+            groupVaryingCandidateCounts[g] = (groupPairEnd[g] - groupPairBegin[g]) * (int) allowedFactors.size();
+        }
+
+        std::sort(invariantCandidates, invariantCandidates + invariantCandidateCount, [](const IndexedCandidate& a, const IndexedCandidate& b)
+        {
+            return a.value < b.value || (a.value == b.value && a.candidate < b.candidate);
+        });
+
+        for (int p = varyingPairCount; p < PADDED_PAIR_COUNT; ++p)
+        {
+            pairNumerators[p] = varyingPairCount > 0 ? pairNumerators[varyingPairCount - 1] : 0;
+            pairDenominators[p] = varyingPairCount > 0 ? pairDenominators[varyingPairCount - 1] : 0;
+            pairFirstNumbers[p] = varyingPairCount > 0 ? pairFirstNumbers[varyingPairCount - 1] : -1.0;
+        }
+
+        for (int n = varyingCandidateCount; n < PADDED_CANDIDATE_COUNT; ++n)
+        {
+            varyingPairs[n] = varyingCandidateCount > 0 ? varyingPairs[varyingCandidateCount - 1] : 0;
+            varyingFactors[n] = varyingCandidateCount > 0 ? varyingFactors[varyingCandidateCount - 1] : 0;
+            varyingNumbers[n] = varyingCandidateCount > 0 ? varyingNumbers[varyingCandidateCount - 1] : -1.0;
+        }
+    }
+};
+
+const CandidateTable& GetCandidateTable()
+{
+    static const CandidateTable table;
+    return table;
+}
+
+// The vector kernels search the varying candidates only and return the winning candidate
+// number, or -1 when every candidate is invariant.
+int FindClosestVaryingCandidate_Scalar(const double* dimensions, double target)
+{
+    const CandidateTable& table = GetCandidateTable();
+
+    double ratios[PADDED_PAIR_COUNT];
+    for (int p = 0; p < table.varyingPairCount; ++p)
+    {
+        ratios[p] = dimensions[table.pairNumerators[p]] / dimensions[table.pairDenominators[p]];
+    }
+
+    int closest = -1;
+    double minAbsoluteError = std::numeric_limits<double>::max();
+    for (int n = 0; n < table.varyingCandidateCount; ++n)
+    {
+        double scaled = ratios[table.varyingPairs[n]] * table.factors[table.varyingFactors[n]];
+        double absoluteError = std::abs(scaled - target);
+        if (absoluteError < minAbsoluteError)
+        {
+            closest = (int) table.varyingNumbers[n];
+            minAbsoluteError = absoluteError;
+        }
+    }
+
+    return closest;
+}
+
+thread_local ClosestKernel::SearchStatistics threadSearchStatistics;
+
+// How far target lies outside [low, high], rounded the way a candidate's absolute error is.
+// Rounding is monotonic, so no candidate value inside the interval has a smaller error.
+double DistanceToInterval(double low, double high, double target)
+{
+    if (target < low)
+    {
+        return low - target;
+    }
+    if (target > high)
+    {
+        return target - high;
+    }
+    return 0.0;
+}
+
+// Branch and bound over the varying candidates, starting from the best candidate found so
+// far. A group is skipped when the interval between its smallest and largest possible value
+// cannot beat the best absolute error, likewise each pair with its own ratio. Inside a pair
+// the values ascend with the factor, so only the two candidates around the target are
+// scored. Only intervals that are strictly worse are skipped, and ties still go to the lower
+// candidate number, so the result is the exhaustive search's.
+int FindClosestCandidate_Pruned(const double* dimensions, double target, int closest, double minAbsoluteError)
+{
+    const CandidateTable& table = GetCandidateTable();
+    constexpr int factorCount = (int) allowedFactors.size();
+    const double lowestFactor = table.factors[0];
+    const double highestFactor = table.factors[factorCount - 1];
+
+    int64_t evaluatedCount = 0;
+    auto consider = [&](double value, int candidate)
+    {
+        ++evaluatedCount;
+        double absoluteError = std::abs(value - target);
+        if (absoluteError < minAbsoluteError || (absoluteError == minAbsoluteError && candidate < closest))
+        {
+            closest = candidate;
+            minAbsoluteError = absoluteError;
+        }
+        return absoluteError;
+    };
+
+    for (size_t g = 0; g < DIMENSION_GROUPS.size(); ++g)
+    {
+        if (table.groupPairBegin[g] == table.groupPairEnd[g])
+        {
+            continue;
+        }
+
+        const DimensionGroup& group = DIMENSION_GROUPS[g];
+        double minDimension = dimensions[group.begin];
+        double maxDimension = dimensions[group.begin];
+        for (int i = group.begin + 1; i < group.end; ++i)
+        {
+            minDimension = std::min(minDimension, dimensions[i]);
+            maxDimension = std::max(maxDimension, dimensions[i]);
+        }
+
+        double groupLow = (minDimension / maxDimension) * lowestFactor;
+        double groupHigh = (maxDimension / minDimension) * highestFactor;
+        if (DistanceToInterval(groupLow, groupHigh, target) > minAbsoluteError)
+        {
+            Metrics::CountGroup(Metrics::GroupCounter::SKIPPED, (int) g);
+            continue;
+        }
+
+        int64_t groupBeginEvaluatedCount = evaluatedCount;
+
+        for (int p = table.groupPairBegin[g]; p < table.groupPairEnd[g]; ++p)
+        {
+            double ratio = dimensions[table.pairNumerators[p]] / dimensions[table.pairDenominators[p]];
+            if (DistanceToInterval(ratio * lowestFactor, ratio * highestFactor, target) > minAbsoluteError)
+            {
+                continue;
+            }
+
+            // The first factor whose value reaches the target.
+            int low = 0;
+            int high = factorCount;
+            while (low < high)
+            {
+                int middle = (low + high) / 2;
+                if (ratio * table.factors[middle] < target)
+                {
+                    low = middle + 1;
+                }
+                else
+                {
+                    high = middle;
+                }
+            }
+
+            int firstCandidate = (int) table.varyingNumbers[p * factorCount];
+            if (low < factorCount)
+            {
+                consider(ratio * table.factors[low], firstCandidate + low);
+            }
+            if (low > 0)
+            {
+                // Below the target the rounded errors can only tie moving down, and a tie goes
+                // to the lower factor.
+                double absoluteError = consider(ratio * table.factors[low - 1], firstCandidate + low - 1);
+                for (int k = low - 2; k >= 0 && std::abs(ratio * table.factors[k] - target) == absoluteError; --k)
+                {
+                    consider(ratio * table.factors[k], firstCandidate + k);
+                }
+            }
+        }
+
+        Metrics::CountGroup(Metrics::GroupCounter::SEARCHED, (int) g);
+        Metrics::CountGroup(Metrics::GroupCounter::EVALUATED_CANDIDATES, (int) g, (uint64_t) (evaluatedCount - groupBeginEvaluatedCount));
+    }
+
+    threadSearchStatistics.evaluatedCandidateCount += evaluatedCount;
+    threadSearchStatistics.prunedCandidateCount += table.varyingCandidateCount - evaluatedCount;
+    return closest;
+}
+
+// Picks the smallest error across lanes, breaking ties on the smaller candidate number.
+int ReduceLanes(const double* laneErrors, const double* laneNumbers, int laneCount)
+{
+    double minAbsoluteError = laneErrors[0];
+    double closest = laneNumbers[0];
+    for (int lane = 1; lane < laneCount; ++lane)
+    {
+        if (laneErrors[lane] < minAbsoluteError || (laneErrors[lane] == minAbsoluteError && laneNumbers[lane] < closest))
+        {
+            minAbsoluteError = laneErrors[lane];
+            closest = laneNumbers[lane];
+        }
+    }
+
+    return (int) closest;
+}
+
+#ifdef CLOSEST_KERNEL_X86
+
+// Walks the candidates factor by factor, so each step scores four contiguous pair ratios
+// against one broadcast factor without gathers. That is not candidate order, so ties are
+// broken on the candidate number explicitly.
+TARGET_AVX2 int FindClosestVaryingCandidate_Avx2(const double* dimensions, double target)
+{
+    const CandidateTable& table = GetCandidateTable();
+
+    alignas(32) double numerators[PADDED_PAIR_COUNT];
+    alignas(32) double denominators[PADDED_PAIR_COUNT];
+    alignas(32) double ratios[PADDED_PAIR_COUNT];
+    int vectorPairCount = (table.varyingPairCount + 3) / 4 * 4;
+    for (int p = 0; p < vectorPairCount; ++p)
+    {
+        numerators[p] = dimensions[table.pairNumerators[p]];
+        denominators[p] = dimensions[table.pairDenominators[p]];
+    }
+    for (int p = 0; p < vectorPairCount; p += 4)
+    {
+        _mm256_store_pd(&ratios[p], _mm256_div_pd(_mm256_load_pd(&numerators[p]), _mm256_load_pd(&denominators[p])));
+    }
+
+    // Independent minima for consecutive vectors of pairs, so the compare and blend chains
+    // overlap instead of waiting on each other.
+    constexpr int CHAIN_COUNT = 4;
+    const __m256d signMask = _mm256_set1_pd(-0.0);
+    const __m256d targets = _mm256_set1_pd(target);
+    __m256d minAbsoluteErrors[CHAIN_COUNT];
+    __m256d closest[CHAIN_COUNT];
+    for (int chain = 0; chain < CHAIN_COUNT; ++chain)
+    {
+        minAbsoluteErrors[chain] = _mm256_set1_pd(std::numeric_limits<double>::max());
+        closest[chain] = _mm256_set1_pd(-1.0);
+    }
+
+    for (int k = 0; k < (int) allowedFactors.size(); ++k)
+    {
+        const __m256d factor = _mm256_set1_pd(table.factors[k]);
+        const __m256d factorIndex = _mm256_set1_pd((double) k);
+        for (int p = 0; p < vectorPairCount; p += 4)
+        {
+            int chain = (p / 4) % CHAIN_COUNT;
+            __m256d scaled = _mm256_mul_pd(_mm256_load_pd(&ratios[p]), factor);
+            PREVENT_CONTRACTION(scaled);
+            __m256d absoluteErrors = _mm256_andnot_pd(signMask, _mm256_sub_pd(scaled, targets));
+            __m256d numbers = _mm256_add_pd(_mm256_load_pd(&table.pairFirstNumbers[p]), factorIndex);
+
+            __m256d better = _mm256_or_pd(_mm256_cmp_pd(absoluteErrors, minAbsoluteErrors[chain], _CMP_LT_OQ),
+                _mm256_and_pd(_mm256_cmp_pd(absoluteErrors, minAbsoluteErrors[chain], _CMP_EQ_OQ), _mm256_cmp_pd(numbers, closest[chain], _CMP_LT_OQ)));
+            minAbsoluteErrors[chain] = _mm256_blendv_pd(minAbsoluteErrors[chain], absoluteErrors, better);
+            closest[chain] = _mm256_blendv_pd(closest[chain], numbers, better);
+        }
+    }
+
+    alignas(32) double laneErrors[4 * CHAIN_COUNT];
+    alignas(32) double laneNumbers[4 * CHAIN_COUNT];
+    for (int chain = 0; chain < CHAIN_COUNT; ++chain)
+    {
+        _mm256_store_pd(&laneErrors[4 * chain], minAbsoluteErrors[chain]);
+        _mm256_store_pd(&laneNumbers[4 * chain], closest[chain]);
+    }
+    return ReduceLanes(laneErrors, laneNumbers, 4 * CHAIN_COUNT);
+}
+
+// GCC 12 starts the unmasked AVX-512 gathers, permutes and minimums from a self-initialized
+// _mm512_undefined_*() value and -Wall reports it as maybe uninitialized, so these use the
+// masked forms with every lane set and a defined source. They compile to the same instructions.
+TARGET_AVX512 inline __m512d GatherDoubles(__m256i indices, const double* base)
+{
+    return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), (__mmask8) 0xFF, indices, base, 8);
+}
+
+TARGET_AVX512 inline __m512 GatherFloats(__m512i indices, const float* base)
+{
+    return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), (__mmask16) 0xFFFF, indices, base, 4);
+}
+
+TARGET_AVX512 inline __m512 PermuteFloats(__m512i indices, __m512 table)
+{
+    return _mm512_mask_permutexvar_ps(table, (__mmask16) 0xFFFF, indices, table);
+}
+
+TARGET_AVX512 inline __m512 MinFloats(__m512 a, __m512 b)
+{
+    return _mm512_mask_min_ps(b, (__mmask16) 0xFFFF, a, b);
+}
+
+TARGET_AVX512 int FindClosestVaryingCandidate_Avx512(const double* dimensions, double target)
+{
+    const CandidateTable& table = GetCandidateTable();
+
+    alignas(64) double ratios[PADDED_PAIR_COUNT];
+    for (int p = 0; p < table.varyingPairCount; p += 8)
+    {
+        __m256i numerators = _mm256_load_si256((const __m256i*) &table.pairNumerators[p]);
+        __m256i denominators = _mm256_load_si256((const __m256i*) &table.pairDenominators[p]);
+        __m512d quotient = _mm512_div_pd(GatherDoubles(numerators, dimensions), GatherDoubles(denominators, dimensions));
+        _mm512_store_pd(&ratios[p], quotient);
+    }
+
+    const __m512d targets = _mm512_set1_pd(target);
+    __m512d minAbsoluteErrors = _mm512_set1_pd(std::numeric_limits<double>::max());
+    __m512d closest = _mm512_set1_pd(-1.0);
+
+    for (int n = 0; n < table.varyingCandidateCount; n += 8)
+    {
+        __m256i pairs = _mm256_load_si256((const __m256i*) &table.varyingPairs[n]);
+        __m256i factorIndices = _mm256_load_si256((const __m256i*) &table.varyingFactors[n]);
+        __m512d scaled = _mm512_mul_pd(GatherDoubles(pairs, ratios), GatherDoubles(factorIndices, table.factors));
+        PREVENT_CONTRACTION(scaled);
+        __m512d absoluteErrors = _mm512_abs_pd(_mm512_sub_pd(scaled, targets));
+
+        __mmask8 better = _mm512_cmp_pd_mask(absoluteErrors, minAbsoluteErrors, _CMP_LT_OQ);
+        minAbsoluteErrors = _mm512_mask_blend_pd(better, minAbsoluteErrors, absoluteErrors);
+        closest = _mm512_mask_blend_pd(better, closest, _mm512_load_pd(&table.varyingNumbers[n]));
+    }
+
+    alignas(64) double laneErrors[8];
+    alignas(64) double laneNumbers[8];
+    _mm512_store_pd(laneErrors, minAbsoluteErrors);
+    _mm512_store_pd(laneNumbers, closest);
+    return ReduceLanes(laneErrors, laneNumbers, 8);
+}
+
+// Picks entry indices[i] of a table held sixteen floats to a vector. Each permute covers two
+// vectors, and a blend keeps the lanes whose index falls in its range.
+template <int VectorCount>
+TARGET_AVX512 inline __m512 PermuteTable(const __m512 (&vectors)[VectorCount], __m512i indices)
+{
+    if (VectorCount == 1)
+    {
+        return PermuteFloats(indices, vectors[0]);
+    }
+
+    __m512 values = _mm512_permutex2var_ps(vectors[0], indices, vectors[std::min(1, VectorCount - 1)]);
+    for (int v = 2; v < VectorCount; v += 2)
+    {
+        __m512 block = v + 1 < VectorCount ? _mm512_permutex2var_ps(vectors[v], indices, vectors[std::min(v + 1, VectorCount - 1)]) : PermuteFloats(indices, vectors[v]);
+        values = _mm512_mask_blend_ps(_mm512_cmpge_epi32_mask(indices, _mm512_set1_epi32(16 * v)), values, block);
+    }
+    return values;
+}
+
+// Screens the varying candidates in float32 and scores the survivors in double, in candidate
+// order so ties still go to the lower candidate number.
+TARGET_AVX512 int FindClosestVaryingCandidate_Screened(const double* dimensions, double target)
+{
+    const CandidateTable& table = GetCandidateTable();
+
+    // The bound only holds for normal floats; anything else takes the double kernel.
+    float floatDimensions[PYRAMID_DIMENSION_COUNT];
+    for (int i = 0; i < PYRAMID_DIMENSION_COUNT; ++i)
+    {
+        floatDimensions[i] = (float) dimensions[i];
+        if (!std::isnormal(floatDimensions[i]))
+        {
+            return FindClosestVaryingCandidate_Avx512(dimensions, target);
+        }
+    }
+    float floatTarget = (float) target;
+    if (!std::isnormal(floatTarget))
+    {
+        return FindClosestVaryingCandidate_Avx512(dimensions, target);
+    }
+
+    // The ratios and factors fit in a few registers, so candidates pick theirs with permutes
+    // instead of gathers.
+    alignas(64) float ratios[PADDED_PAIR_COUNT] = {};
+    for (int p = 0; p < table.varyingPairCount; p += 16)
+    {
+        __m512i numerators = _mm512_load_si512((const __m512i*) &table.pairNumerators[p]);
+        __m512i denominators = _mm512_load_si512((const __m512i*) &table.pairDenominators[p]);
+        __m512 quotient = _mm512_div_ps(GatherFloats(numerators, floatDimensions), GatherFloats(denominators, floatDimensions));
+        _mm512_store_ps(&ratios[p], quotient);
+    }
+    __m512 ratioVectors[PADDED_PAIR_COUNT / 16];
+    for (int v = 0; v < PADDED_PAIR_COUNT / 16; ++v)
+    {
+        ratioVectors[v] = _mm512_load_ps(&ratios[16 * v]);
+    }
+    __m512 factorVectors[PADDED_FACTOR_COUNT / 16];
+    for (int v = 0; v < PADDED_FACTOR_COUNT / 16; ++v)
+    {
+        factorVectors[v] = _mm512_load_ps(&table.floatFactors[16 * v]);
+    }
+
+    const __m512 targets = _mm512_set1_ps(floatTarget);
+    const __m512 tolerances = _mm512_set1_ps(SCREENING_TOLERANCE);
+    const __m512 targetSlack = _mm512_set1_ps(SCREENING_TOLERANCE * std::abs(floatTarget));
+    __m512 minUpperErrors = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+
+    alignas(64) float lowerErrors[PADDED_CANDIDATE_COUNT];
+    for (int n = 0; n < table.varyingCandidateCount; n += 16)
+    {
+        __m512i pairs = _mm512_load_si512((const __m512i*) &table.varyingPairs[n]);
+        __m512i factorIndices = _mm512_load_si512((const __m512i*) &table.varyingFactors[n]);
+        __m512 pairRatios = PermuteTable(ratioVectors, pairs);
+        __m512 scaled = _mm512_mul_ps(pairRatios, PermuteTable(factorVectors, factorIndices));
+        __m512 absoluteErrors = _mm512_abs_ps(_mm512_sub_ps(scaled, targets));
+        __m512 slack = _mm512_add_ps(_mm512_mul_ps(_mm512_abs_ps(scaled), tolerances), targetSlack);
+
+        minUpperErrors = MinFloats(_mm512_add_ps(absoluteErrors, slack), minUpperErrors);
+        _mm512_store_ps(&lowerErrors[n], _mm512_sub_ps(absoluteErrors, slack));
+    }
+
+    // The lanes never hold NaN, since MinFloats keeps its second operand when the first is NaN. Not greater also keeps the lanes whose lower bound came out NaN.
+    alignas(64) float laneUpperErrors[16];
+    _mm512_store_ps(laneUpperErrors, minUpperErrors);
+    float minUpperError = laneUpperErrors[0];
+    for (int lane = 1; lane < 16; ++lane)
+    {
+        minUpperError = std::min(minUpperError, laneUpperErrors[lane]);
+    }
+    const __m512 maxMinErrors = _mm512_set1_ps(minUpperError);
+    int closest = -1;
+    double minAbsoluteError = std::numeric_limits<double>::max();
+    for (int n = 0; n < table.varyingCandidateCount; n += 16)
+    {
+        __mmask16 survivors = _mm512_cmp_ps_mask(_mm512_load_ps(&lowerErrors[n]), maxMinErrors, _CMP_NGT_UQ);
+        for (int lane = 0; survivors != 0 && lane < 16 && n + lane < table.varyingCandidateCount; ++lane, survivors >>= 1)
+        {
+            if ((survivors & 1) == 0)
+            {
+                continue;
+            }
+
+            int pair = table.varyingPairs[n + lane];
+            double ratio = dimensions[table.pairNumerators[pair]] / dimensions[table.pairDenominators[pair]];
+            double scaled = ratio * table.factors[table.varyingFactors[n + lane]];
+            PREVENT_CONTRACTION(scaled);
+            double absoluteError = std::abs(scaled - target);
+            if (absoluteError < minAbsoluteError)
+            {
+                closest = (int) table.varyingNumbers[n + lane];
+                minAbsoluteError = absoluteError;
+            }
+        }
+    }
+
+    return closest;
+}
+
+#if defined(_MSC_VER) && !defined(__clang__)
+bool CpuSupports(ClosestKernelType kernel)
+{
+    int registers[4];
+    __cpuid(registers, 0);
+    if (registers[0] < 7)
+    {
+        return false;
+    }
+
+    __cpuid(registers, 1);
+    bool osSavesAvx = (registers[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+    if (!osSavesAvx)
+    {
+        return false;
+    }
+
+    __cpuidex(registers, 7, 0);
+    if (kernel == ClosestKernelType::AVX2)
+    {
+        return (registers[1] & (1 << 5)) != 0;
+    }
+
+    return (registers[1] & (1 << 16)) != 0 && (_xgetbv(0) & 0xe6) == 0xe6;
+}
+#else
+bool CpuSupports(ClosestKernelType kernel)
+{
+    __builtin_cpu_init();
+    if (kernel == ClosestKernelType::AVX2)
+    {
+        return __builtin_cpu_supports("avx2");
+    }
+
+    return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+#else
+
+bool CpuSupports(ClosestKernelType)
+{
+    return false;
+}
+
+#endif
+
+ClosestKernelType DetectKernel()
+{
+    if (CpuSupports(ClosestKernelType::SCREENED))
+    {
+        return ClosestKernelType::SCREENED;
+    }
+
+    if (CpuSupports(ClosestKernelType::AVX2))
+    {
+        return ClosestKernelType::AVX2;
+    }
+
+    return ClosestKernelType::SCALAR;
+}
+
+std::atomic<ClosestKernelType>& ActiveKernel()
+{
+    static std::atomic<ClosestKernelType> kernel(DetectKernel());
+    return kernel;
+}
+
+}
+
+namespace ClosestKernel
+{
+
+const Candidate& GetCandidate(int candidate)
+{
+    return GetCandidateTable().candidates[candidate];
+}
+
+bool IsInvariantCandidate(int candidate)
+{
+    return GetCandidateTable().invariant[candidate];
+}
+
+const IndexedCandidate* GetInvariantCandidates()
+{
+    return GetCandidateTable().invariantCandidates;
+}
+
+int GetInvariantCandidateCount()
+{
+    return GetCandidateTable().invariantCandidateCount;
+}
+
+double CalculateCandidateValue(const double* dimensions, int candidate)
+{
+    const CandidateTable& table = GetCandidateTable();
+    if (table.invariant[candidate])
+    {
+        return table.invariantValues[candidate];
+    }
+
+    const Candidate& c = table.candidates[candidate];
+    double ratio = dimensions[(int) c.dimension1] / dimensions[(int) c.dimension2];
+    return ratio * allowedFactors[c.factorIndex];
+}
+
+int FindClosestInSorted(const IndexedCandidate* sorted, int size, double target)
+{
+    const IndexedCandidate* position = std::lower_bound(sorted, sorted + size, target, [](const IndexedCandidate& a, double value)
+    {
+        return a.value < value;
+    });
+
+    return ResolveClosest(sorted, size, (int) (position - sorted), target);
+}
+
+int ResolveClosest(const IndexedCandidate* sorted, int size, int position, double target)
+{
+    double minAbsoluteError = std::numeric_limits<double>::max();
+    if (position < size)
+    {
+        minAbsoluteError = std::abs(sorted[position].value - target);
+    }
+    if (position > 0)
+    {
+        minAbsoluteError = std::min(minAbsoluteError, std::abs(sorted[position - 1].value - target));
+    }
+
+    // The rounded error only grows moving away from the target, so every candidate that ties
+    // for the minimum sits in an unbroken run on either side of position.
+    int closest = -1;
+    for (int i = position - 1; i >= 0 && std::abs(sorted[i].value - target) == minAbsoluteError; --i)
+    {
+        closest = closest < 0 ? sorted[i].candidate : std::min(closest, sorted[i].candidate);
+    }
+    for (int i = position; i < size && std::abs(sorted[i].value - target) == minAbsoluteError; ++i)
+    {
+        closest = closest < 0 ? sorted[i].candidate : std::min(closest, sorted[i].candidate);
+    }
+
+    return closest;
+}
+
+int FindClosestCandidate(const double* dimensions, double target)
+{
+    const CandidateTable& table = GetCandidateTable();
+    int closestInvariant = FindClosestInSorted(table.invariantCandidates, table.invariantCandidateCount, target);
+
+    ClosestKernelType kernel = ActiveKernel().load(std::memory_order_relaxed);
+    if (kernel == ClosestKernelType::PRUNED)
+    {
+        double invariantAbsoluteError = closestInvariant < 0 ? std::numeric_limits<double>::max() : std::abs(table.invariantValues[closestInvariant] - target);
+        return FindClosestCandidate_Pruned(dimensions, target, closestInvariant, invariantAbsoluteError);
+    }
+
+    // The exhaustive kernels score every varying candidate.
+    CountSearches(1, table.groupVaryingCandidateCounts);
+
+    int closest;
+    switch (kernel)
+    {
+#ifdef CLOSEST_KERNEL_X86
+    case ClosestKernelType::AVX512:
+        closest = FindClosestVaryingCandidate_Avx512(dimensions, target);
+        break;
+    case ClosestKernelType::AVX2:
+        closest = FindClosestVaryingCandidate_Avx2(dimensions, target);
+        break;
+    case ClosestKernelType::SCREENED:
+        closest = FindClosestVaryingCandidate_Screened(dimensions, target);
+        break;
+#endif
+    default:
+        closest = FindClosestVaryingCandidate_Scalar(dimensions, target);
+        break;
+    }
+
+    // Merge in the best of the precomputed invariant candidates.
+    if (closestInvariant < 0)
+    {
+        return closest;
+    }
+    if (closest < 0)
+    {
+        return closestInvariant;
+    }
+
+    double absoluteError = std::abs(CalculateCandidateValue(dimensions, closest) - target);
+    double invariantAbsoluteError = std::abs(CalculateCandidateValue(dimensions, closestInvariant) - target);
+    if (invariantAbsoluteError < absoluteError || (invariantAbsoluteError == absoluteError && closestInvariant < closest))
+    {
+        return closestInvariant;
+    }
+
+    return closest;
+}
+
+int GetCandidateGroup(int candidate)
+{
+    int dimension = (int) GetCandidate(candidate).dimension1;
+    for (int g = 0; g < (int) DIMENSION_GROUPS.size(); ++g)
+    {
+        if (dimension >= DIMENSION_GROUPS[g].begin && dimension < DIMENSION_GROUPS[g].end)
+        {
+            return g;
+        }
+    }
+    return -1;
+}
+
+void CountSearches(int searchCount, const int* groupCandidateCounts)
+{
+    const CandidateTable& table = GetCandidateTable();
+    int64_t evaluatedCount = 0;
+    for (int g = 0; g < (int) DIMENSION_GROUPS.size(); ++g)
+    {
+        evaluatedCount += groupCandidateCounts[g];
+        if (!Metrics::ENABLED || table.groupPairBegin[g] == table.groupPairEnd[g])
+        {
+            continue;
+        }
+
+        if (groupCandidateCounts[g] > 0)
+        {
+            Metrics::CountGroup(Metrics::GroupCounter::SEARCHED, g, (uint64_t) searchCount);
+            Metrics::CountGroup(Metrics::GroupCounter::EVALUATED_CANDIDATES, g, (uint64_t) groupCandidateCounts[g]);
+        }
+        else
+        {
+            Metrics::CountGroup(Metrics::GroupCounter::SKIPPED, g, (uint64_t) searchCount);
+        }
+    }
+
+    threadSearchStatistics.evaluatedCandidateCount += evaluatedCount;
+    threadSearchStatistics.prunedCandidateCount += (int64_t) searchCount * table.varyingCandidateCount - evaluatedCount;
+}
+
+const int* GetGroupVaryingCandidateCounts()
+{
+    return GetCandidateTable().groupVaryingCandidateCounts;
+}
+
+SearchStatistics TakeSearchStatistics()
+{
+    SearchStatistics statistics = threadSearchStatistics;
+    threadSearchStatistics = SearchStatistics();
+    return statistics;
+}
+
+ClosestKernelType GetKernel()
+{
+    return ActiveKernel().load();
+}
+
+bool IsKernelSupported(ClosestKernelType kernel)
+{
+    return kernel == ClosestKernelType::SCALAR || kernel == ClosestKernelType::PRUNED || CpuSupports(kernel);
+}
+
+bool SetKernel(ClosestKernelType kernel)
+{
+    if (!IsKernelSupported(kernel))
+    {
+        return false;
+    }
+
+    ActiveKernel().store(kernel);
+    return true;
+}
+
+}
\ No newline at end of file
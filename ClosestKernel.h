@@ -0,0 +1,123 @@
+#ifndef CLOSEST_KERNEL_H_
+#define CLOSEST_KERNEL_H_
+
+#include "Pyramid.h"
+
+#include <cstdint>
+#include <utility>
+
+enum class ClosestKernelType
+{
+    SCALAR = 0,
+    AVX2,
+    AVX512,
+    PRUNED,
+    SCREENED
+};
+
+constexpr const char* const ClosestKernelTypeStrings[] =
+{
+    "scalar",
+    "avx2",
+    "avx512",
+    "pruned",
+    "screened"
+};
+
+struct IndexedCandidate
+{
+    double value;
+    int candidate;
+};
+
+// The search behind Pyramid::GetClosest. Every (dimension1, dimension2, factor) candidate
+// of every group is numbered in the order the group-by-group scan visits them, and the
+// search returns the lowest numbered candidate with the smallest absolute error, which is
+// exactly the candidate the scan picks.
+//
+// Some pairs have the same ratio for every pyramid (the base length, perimeter and diagonal
+// are fixed multiples of each other). Their candidates are valued once, on the unit pyramid,
+// and kept sorted, so a search only divides and scans the pairs that depend on the shape and
+// then binary searches the invariant ones. The vector kernels keep a per-lane minimum and
+// break ties on the candidate number, so every kernel returns the same candidate. The pruned
+// kernel instead skips the groups and pairs whose value range cannot beat the best match so
+// far, which pays off when the target sits far from most candidates.
+//
+// The screened kernel scores the varying candidates in float32, sixteen to a vector, with a
+// bound on how far each float error can be from the double one. Only the candidates whose
+// lower bound does not exceed the smallest upper bound can still be the closest, and only
+// those are scored again in double, so it returns the same candidate as the other kernels.
+//
+// The vector kernels never fuse the multiply and subtract. If the build enables FMA
+// contraction globally (e.g. -march=native with GCC), also pass -ffp-contract=off so the
+// scalar kernel rounds the same way.
+namespace ClosestKernel
+{
+
+constexpr int CountPairs()
+{
+    int count = 0;
+    for (const DimensionGroup& group : DIMENSION_GROUPS)
+    {
+        int size = group.end - group.begin;
+        count += size * (size - 1);
+    }
+    return count;
+}
+
+constexpr int PAIR_COUNT = CountPairs();
+constexpr int CANDIDATE_COUNT = PAIR_COUNT * (int) allowedFactors.size();
+
+struct Candidate
+{
+    PyramidDimension dimension1;
+    PyramidDimension dimension2;
+    int factorIndex;
+};
+
+// The (base length, height) shapes the invariant probe compares. They span aspect ratios
+// from 1:1000 to 1000:1, so any pair whose ratio depends on the shape at all shows up as
+// varying.
+constexpr std::pair<int, int> INVARIANT_PROBES[] = { { 1, 1 }, { 1, 1000 }, { 1000, 1 }, { 7, 5 }, { 5, 7 }, { 123, 457 } };
+constexpr double INVARIANT_PROBE_TOLERANCE = 1.0E-12;
+
+const Candidate& GetCandidate(int candidate);
+// The position in DIMENSION_GROUPS of the group the candidate's dimensions belong to.
+int GetCandidateGroup(int candidate);
+int FindClosestCandidate(const double* dimensions, double target);
+double CalculateCandidateValue(const double* dimensions, int candidate);
+
+// Per-thread tally of the varying candidates the searches scored or skipped since the last
+// TakeSearchStatistics on this thread.
+struct SearchStatistics
+{
+    int64_t evaluatedCandidateCount = 0;
+    int64_t prunedCandidateCount = 0;
+};
+
+SearchStatistics TakeSearchStatistics();
+
+// Counts in SearchStatistics and Metrics, as FindClosestCandidate does, searchCount searches
+// answered outside the kernels that between them scored groupCandidateCounts[g] varying
+// candidates of each group g of DIMENSION_GROUPS.
+void CountSearches(int searchCount, const int* groupCandidateCounts);
+// The varying candidates of each group of DIMENSION_GROUPS.
+const int* GetGroupVaryingCandidateCounts();
+
+bool IsInvariantCandidate(int candidate);
+const IndexedCandidate* GetInvariantCandidates();
+int GetInvariantCandidateCount();
+
+// Searches candidates sorted by value. ResolveClosest picks among the equally close
+// candidates around position, the index of the first value >= target; both return -1
+// when there are no candidates.
+int FindClosestInSorted(const IndexedCandidate* sorted, int size, double target);
+int ResolveClosest(const IndexedCandidate* sorted, int size, int position, double target);
+
+ClosestKernelType GetKernel();
+bool IsKernelSupported(ClosestKernelType kernel);
+bool SetKernel(ClosestKernelType kernel);
+
+}
+
+#endif
\ No newline at end of file
@@ -2,4 +2,10 @@
 
 double const_pi() { return atan(1) * 4; };
 double const_phi() { return (1.0 + sqrt(5)) / 2.0; };
-double const_e() { return exp(1); };
\ No newline at end of file
+double const_e() { return exp(1); };
+double const_sqrt2() { return sqrt(2.0); };
+double const_sqrt3() { return sqrt(3.0); };
+double const_ln2() { return log(2.0); };
+double const_feigenbaum_delta() { return 4.669201609102990; };
+double const_feigenbaum_alpha() { return 2.502907875095892; };
+double const_fine_structure() { return 1.37035999206; };
\ No newline at end of file
@@ -6,5 +6,11 @@
 double const_pi();
 double const_phi();
 double const_e();
+double const_sqrt2();
+double const_sqrt3();
+double const_ln2();
+double const_feigenbaum_delta();
+double const_feigenbaum_alpha();
+double const_fine_structure();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,50 @@
+#include "CounterRandom.h"
+
+namespace
+{
+
+constexpr uint32_t PHILOX_M0 = 0xD2511F53;
+constexpr uint32_t PHILOX_M1 = 0xCD9E8D57;
+constexpr uint32_t PHILOX_W0 = 0x9E3779B9;
+constexpr uint32_t PHILOX_W1 = 0xBB67AE85;
+constexpr int PHILOX_ROUNDS = 10;
+
+}
+
+CounterRandom::CounterRandom(uint64_t seed):
+    key{ (uint32_t) seed, (uint32_t) (seed >> 32) }
+{
+}
+
+std::array<uint64_t, 2> CounterRandom::Generate(uint64_t draw, uint32_t block) const
+{
+    uint32_t counter[4] = { (uint32_t) draw, (uint32_t) (draw >> 32), block, 0 };
+    uint32_t roundKey[2] = { key[0], key[1] };
+
+    for (int round = 0; round < PHILOX_ROUNDS; ++round)
+    {
+        uint64_t product0 = (uint64_t) PHILOX_M0 * counter[0];
+        uint64_t product1 = (uint64_t) PHILOX_M1 * counter[2];
+        uint32_t next[4] =
+        {
+            (uint32_t) (product1 >> 32) ^ counter[1] ^ roundKey[0],
+            (uint32_t) product1,
+            (uint32_t) (product0 >> 32) ^ counter[3] ^ roundKey[1],
+            (uint32_t) product0
+        };
+
+        counter[0] = next[0];
+        counter[1] = next[1];
+        counter[2] = next[2];
+        counter[3] = next[3];
+        roundKey[0] += PHILOX_W0;
+        roundKey[1] += PHILOX_W1;
+    }
+
+    return { ((uint64_t) counter[1] << 32) | counter[0], ((uint64_t) counter[3] << 32) | counter[2] };
+}
+
+double CounterRandom::ToUnitInterval(uint64_t bits)
+{
+    return (double) (bits >> 11) * (1.0 / 9007199254740992.0);
+}
\ No newline at end of file
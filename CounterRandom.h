@@ -0,0 +1,26 @@
+#ifndef COUNTER_RANDOM_H_
+#define COUNTER_RANDOM_H_
+
+#include <array>
+#include <cstdint>
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"). The output
+// is a pure function of the key and a 128-bit counter, so every draw of a Monte Carlo run
+// is addressed by its number and comes out the same no matter which thread makes it or in
+// which order.
+class CounterRandom
+{
+public:
+    explicit CounterRandom(uint64_t seed);
+
+    // 128 random bits for (draw, block); a draw that needs more takes further blocks.
+    std::array<uint64_t, 2> Generate(uint64_t draw, uint32_t block) const;
+
+    // Uniform on [0, 1) with 53 random bits.
+    static double ToUnitInterval(uint64_t bits);
+
+private:
+    uint32_t key[2];
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,343 @@
+#include "ErrorRaster.h"
+#include "MathUtilities.h"
+#include "PyramidBatch.h"
+#include "RatioEvaluation.h"
+#include "WorkStealingScheduler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace
+{
+
+constexpr size_t TILE_CELL_COUNT = (size_t) ErrorRaster::TILE_SIZE * ErrorRaster::TILE_SIZE;
+
+uint32_t CountTiles(int cells, int level)
+{
+    int64_t tileCells = (int64_t) ErrorRaster::TILE_SIZE << level;
+    return (uint32_t) ((cells + tileCells - 1) / tileCells);
+}
+
+}
+
+ErrorRasterWriter::TileReduction::TileReduction():
+    sum(TILE_CELL_COUNT, 0.0),
+    min(TILE_CELL_COUNT, std::numeric_limits<float>::infinity()),
+    count(TILE_CELL_COUNT, 0)
+{
+}
+
+void ErrorRasterWriter::TileReduction::Reduce(const TileReduction& child, int quadrantX, int quadrantY)
+{
+    // The child's cells pair up into the parent quadrant it sits in.
+    for (int y = 0; y < ErrorRaster::TILE_SIZE; ++y)
+    {
+        size_t parentRow = (size_t) ((quadrantY * ErrorRaster::TILE_SIZE + y) / 2) * ErrorRaster::TILE_SIZE;
+        for (int x = 0; x < ErrorRaster::TILE_SIZE; ++x)
+        {
+            size_t cell = (size_t) y * ErrorRaster::TILE_SIZE + x;
+            if (child.count[cell] == 0)
+            {
+                continue;
+            }
+
+            size_t parentCell = parentRow + (quadrantX * ErrorRaster::TILE_SIZE + x) / 2;
+            sum[parentCell] += child.sum[cell];
+            min[parentCell] = std::min(min[parentCell], child.min[cell]);
+            count[parentCell] += child.count[cell];
+        }
+    }
+}
+
+ErrorRasterWriter::ErrorRasterWriter(const ErrorRasterOptions& options):
+    options(options),
+    width(std::max(0, options.maxBaseLength - options.minBaseLength + 1)),
+    height(std::max(0, options.maxHeight - options.minHeight + 1)),
+    writeFailed(false)
+{
+    // Only the combined targets make up the error sum, so only they are evaluated, in
+    // catalog order as the sweep adds them.
+    std::vector<std::string> combinedNames;
+    for (const Target& target : options.targets.GetTargets())
+    {
+        if (target.inCombinedSum)
+        {
+            combinedTargets.Add(target.name, target.value);
+            combinedNames.push_back(target.name);
+        }
+    }
+    std::string error;
+    combinedTargets.SetCombined(combinedNames, error);
+
+    uint64_t offset = sizeof(ErrorRaster::FILE_MAGIC) + 2 * sizeof(uint32_t) + 4 * sizeof(int32_t) + 2 * sizeof(uint32_t);
+    for (int level = 0; width > 0 && height > 0; ++level)
+    {
+        ErrorRaster::Level rasterLevel = { CountTiles(width, level), CountTiles(height, level), level == 0 ? 1u : 2u, 0 };
+        levels.push_back(rasterLevel);
+        offset += 4 * sizeof(uint32_t) + sizeof(uint64_t);
+        if (rasterLevel.tilesX == 1 && rasterLevel.tilesY == 1)
+        {
+            break;
+        }
+    }
+
+    for (ErrorRaster::Level& level : levels)
+    {
+        level.offset = offset;
+        offset += (uint64_t) level.tilesX * level.tilesY * level.bandCount * TILE_CELL_COUNT * sizeof(float);
+    }
+}
+
+const std::vector<ErrorRaster::Level>& ErrorRasterWriter::GetLevels() const
+{
+    return levels;
+}
+
+bool ErrorRasterWriter::Write(const std::string& path, std::string& error)
+{
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        error = "cannot open raster file " + path;
+        return false;
+    }
+
+    int32_t bounds[4] = { options.minBaseLength, options.maxBaseLength, options.minHeight, options.maxHeight };
+    uint32_t header[2] = { ErrorRaster::VERSION, (uint32_t) ErrorRaster::TILE_SIZE };
+    uint32_t levelCount[2] = { (uint32_t) levels.size(), 0 };
+    file.write(ErrorRaster::FILE_MAGIC, sizeof(ErrorRaster::FILE_MAGIC));
+    file.write((const char*) header, sizeof(header));
+    file.write((const char*) bounds, sizeof(bounds));
+    file.write((const char*) levelCount, sizeof(levelCount));
+    for (const ErrorRaster::Level& level : levels)
+    {
+        uint32_t tiles[4] = { level.tilesX, level.tilesY, level.bandCount, 0 };
+        file.write((const char*) tiles, sizeof(tiles));
+        file.write((const char*) &level.offset, sizeof(level.offset));
+    }
+
+    if (!levels.empty())
+    {
+        // The lowest level with few enough tiles to hold in memory is where the threads
+        // hand over; each of its tiles is one work item.
+        int nodeLevel = 0;
+        while (nodeLevel + 1 < (int) levels.size() && (uint64_t) levels[nodeLevel].tilesX * levels[nodeLevel].tilesY > MAX_NODE_TILES)
+        {
+            ++nodeLevel;
+        }
+
+        std::vector<TileReduction> tiles(levels[nodeLevel].tilesX * levels[nodeLevel].tilesY);
+        WorkStealingScheduler scheduler(options.threadCount);
+        scheduler.Run((uint32_t) tiles.size(), [&](int, uint32_t item)
+        {
+            BuildNode(nodeLevel, item % levels[nodeLevel].tilesX, item / levels[nodeLevel].tilesX, tiles[item]);
+        });
+
+        for (int level = nodeLevel + 1; level < (int) levels.size(); ++level)
+        {
+            const ErrorRaster::Level& childLevel = levels[level - 1];
+            std::vector<TileReduction> parents(levels[level].tilesX * levels[level].tilesY);
+            for (uint32_t tileY = 0; tileY < levels[level].tilesY; ++tileY)
+            {
+                for (uint32_t tileX = 0; tileX < levels[level].tilesX; ++tileX)
+                {
+                    TileReduction& parent = parents[tileY * levels[level].tilesX + tileX];
+                    for (int quadrant = 0; quadrant < 4; ++quadrant)
+                    {
+                        uint32_t childX = 2 * tileX + (quadrant & 1);
+                        uint32_t childY = 2 * tileY + (quadrant >> 1);
+                        if (childX < childLevel.tilesX && childY < childLevel.tilesY)
+                        {
+                            parent.Reduce(tiles[childY * childLevel.tilesX + childX], quadrant & 1, quadrant >> 1);
+                        }
+                    }
+                    WriteTile(level, tileX, tileY, parent);
+                }
+            }
+            tiles = std::move(parents);
+        }
+    }
+
+    file.close();
+    if (writeFailed || file.fail())
+    {
+        error = "writing raster file " + path + " failed";
+        return false;
+    }
+
+    return true;
+}
+
+void ErrorRasterWriter::EvaluateTile(uint32_t tileX, uint32_t tileY, TileReduction& tile) const
+{
+    int64_t firstBaseLength = (int64_t) options.minBaseLength + (int64_t) tileX * ErrorRaster::TILE_SIZE;
+    int rowWidth = (int) std::min<int64_t>(ErrorRaster::TILE_SIZE, options.maxBaseLength - firstBaseLength + 1);
+
+    // Each row's coprime pyramids are computed as one batch.
+    int reducedHeights[ErrorRaster::TILE_SIZE];
+    int reducedBaseLengths[ErrorRaster::TILE_SIZE];
+    PyramidBatch reducedPyramids;
+
+    for (int y = 0; y < ErrorRaster::TILE_SIZE; ++y)
+    {
+        int64_t height = (int64_t) options.minHeight + (int64_t) tileY * ErrorRaster::TILE_SIZE + y;
+        if (height > options.maxHeight)
+        {
+            break;
+        }
+
+        for (int x = 0; x < rowWidth; ++x)
+        {
+            std::pair<int, int> heightToBaseRatio = MathUtilities::ReduceFraction((int) height, (int) (firstBaseLength + x));
+            reducedHeights[x] = heightToBaseRatio.first;
+            reducedBaseLengths[x] = heightToBaseRatio.second;
+        }
+        reducedPyramids.Calculate(reducedBaseLengths, reducedHeights, rowWidth);
+
+        for (int x = 0; x < rowWidth; ++x)
+        {
+            double relativeErrorSum = RatioEvaluator::Evaluate(reducedPyramids.GetPyramid(x), combinedTargets).relativeErrorSum;
+
+            size_t cell = (size_t) y * ErrorRaster::TILE_SIZE + x;
+            tile.sum[cell] = relativeErrorSum;
+            tile.min[cell] = (float) relativeErrorSum;
+            tile.count[cell] = 1;
+        }
+    }
+}
+
+void ErrorRasterWriter::BuildNode(int level, uint32_t tileX, uint32_t tileY, TileReduction& tile)
+{
+    if (level == 0)
+    {
+        EvaluateTile(tileX, tileY, tile);
+    }
+    else
+    {
+        const ErrorRaster::Level& childLevel = levels[level - 1];
+        TileReduction child;
+        for (int quadrant = 0; quadrant < 4; ++quadrant)
+        {
+            uint32_t childX = 2 * tileX + (quadrant & 1);
+            uint32_t childY = 2 * tileY + (quadrant >> 1);
+            if (childX < childLevel.tilesX && childY < childLevel.tilesY)
+            {
+                child = TileReduction();
+                BuildNode(level - 1, childX, childY, child);
+                tile.Reduce(child, quadrant & 1, quadrant >> 1);
+            }
+        }
+    }
+
+    WriteTile(level, tileX, tileY, tile);
+}
+
+void ErrorRasterWriter::WriteTile(int level, uint32_t tileX, uint32_t tileY, const TileReduction& tile)
+{
+    const ErrorRaster::Level& rasterLevel = levels[level];
+    std::vector<float> cells(rasterLevel.bandCount * TILE_CELL_COUNT);
+    for (size_t cell = 0; cell < TILE_CELL_COUNT; ++cell)
+    {
+        bool empty = tile.count[cell] == 0;
+        cells[cell] = empty ? std::numeric_limits<float>::quiet_NaN() : tile.min[cell];
+        if (rasterLevel.bandCount > 1)
+        {
+            cells[TILE_CELL_COUNT + cell] = empty ? std::numeric_limits<float>::quiet_NaN() : (float) (tile.sum[cell] / tile.count[cell]);
+        }
+    }
+
+    uint64_t offset = rasterLevel.offset + ((uint64_t) tileY * rasterLevel.tilesX + tileX) * cells.size() * sizeof(float);
+
+    std::lock_guard<std::mutex> lock(fileMutex);
+    file.seekp((std::streamoff) offset);
+    file.write((const char*) cells.data(), (std::streamsize) (cells.size() * sizeof(float)));
+    writeFailed = writeFailed || !file;
+}
+
+bool ErrorRasterReader::Open(const std::string& path, std::string& error)
+{
+    file.open(path, std::ios::binary);
+    if (!file)
+    {
+        error = "cannot open raster file " + path;
+        return false;
+    }
+
+    char magic[sizeof(ErrorRaster::FILE_MAGIC)];
+    uint32_t header[2];
+    uint32_t levelCount[2];
+    file.read(magic, sizeof(magic));
+    file.read((char*) header, sizeof(header));
+    file.read((char*) bounds, sizeof(bounds));
+    file.read((char*) levelCount, sizeof(levelCount));
+    if (!file || std::memcmp(magic, ErrorRaster::FILE_MAGIC, sizeof(magic)) != 0 || header[0] != ErrorRaster::VERSION || header[1] != (uint32_t) ErrorRaster::TILE_SIZE)
+    {
+        error = path + " is not a raster file of this version";
+        return false;
+    }
+
+    levels.clear();
+    for (uint32_t i = 0; i < levelCount[0]; ++i)
+    {
+        uint32_t tiles[4];
+        ErrorRaster::Level level;
+        file.read((char*) tiles, sizeof(tiles));
+        file.read((char*) &level.offset, sizeof(level.offset));
+        level.tilesX = tiles[0];
+        level.tilesY = tiles[1];
+        level.bandCount = tiles[2];
+        levels.push_back(level);
+    }
+
+    if (!file)
+    {
+        error = path + ": truncated level table";
+        return false;
+    }
+
+    return true;
+}
+
+int ErrorRasterReader::GetMinBaseLength() const
+{
+    return bounds[0];
+}
+
+int ErrorRasterReader::GetMaxBaseLength() const
+{
+    return bounds[1];
+}
+
+int ErrorRasterReader::GetMinHeight() const
+{
+    return bounds[2];
+}
+
+int ErrorRasterReader::GetMaxHeight() const
+{
+    return bounds[3];
+}
+
+const std::vector<ErrorRaster::Level>& ErrorRasterReader::GetLevels() const
+{
+    return levels;
+}
+
+bool ErrorRasterReader::ReadTile(int level, uint32_t tileX, uint32_t tileY, ErrorRaster::Band band, std::vector<float>& cells)
+{
+    if (level < 0 || level >= (int) levels.size() || tileX >= levels[level].tilesX || tileY >= levels[level].tilesY || (uint32_t) band >= levels[level].bandCount)
+    {
+        return false;
+    }
+
+    const ErrorRaster::Level& rasterLevel = levels[level];
+    uint64_t offset = rasterLevel.offset + (((uint64_t) tileY * rasterLevel.tilesX + tileX) * rasterLevel.bandCount + (uint32_t) band) * TILE_CELL_COUNT * sizeof(float);
+
+    cells.resize(TILE_CELL_COUNT);
+    file.clear();
+    file.seekg((std::streamoff) offset);
+    file.read((char*) cells.data(), (std::streamsize) (cells.size() * sizeof(float)));
+    return (bool) file;
+}
\ No newline at end of file
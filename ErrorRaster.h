@@ -0,0 +1,122 @@
+#ifndef ERROR_RASTER_H_
+#define ERROR_RASTER_H_
+
+#include "TargetCatalog.h"
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// The combined relative error sum of every (base length, height) in a grid, stored as a
+// tiled image pyramid so a viewer can read just the tiles it shows at any zoom.
+//
+//   header:  char magic[8] = "PYRRAS1", uint32 version, uint32 tileSize, int32 minBaseLength,
+//            maxBaseLength, minHeight, maxHeight, uint32 levelCount, uint32 zero, then per
+//            level: uint32 tilesX, tilesY, bandCount, zero, uint64 offset
+//   tiles:   level by level, row-major by tile, each tileSize * tileSize float32 cells
+//            per band, row-major with the height along the rows
+//
+// A cell of level k covers 2^k * 2^k cells of level 0, where one cell is one pyramid with
+// base length minBaseLength + x and height minHeight + y. Level 0 has one band, the error
+// sum itself; higher levels have a min band and a mean band. Cells outside the grid are NaN.
+namespace ErrorRaster
+{
+
+constexpr char FILE_MAGIC[8] = { 'P', 'Y', 'R', 'R', 'A', 'S', '1', '\0' };
+constexpr uint32_t VERSION = 1;
+
+// 128 * 128 cells keeps a tile's working set inside a per-core cache.
+constexpr int TILE_SIZE = 128;
+
+struct Level
+{
+    uint32_t tilesX;
+    uint32_t tilesY;
+    uint32_t bandCount;
+    uint64_t offset;
+};
+
+enum class Band
+{
+    MIN = 0,
+    MEAN = 1
+};
+
+}
+
+struct ErrorRasterOptions
+{
+    int minBaseLength;
+    int maxBaseLength;
+    int minHeight;
+    int maxHeight;
+    TargetCatalog targets;
+    int threadCount;
+};
+
+// Evaluates the grid tile by tile on a work-stealing pool. Each work item is a quadtree node
+// whose subtree of tiles one thread evaluates and reduces; the few levels above those nodes
+// are reduced at the end. Memory is a few tiles per thread plus the node tiles, however
+// large the grid is.
+class ErrorRasterWriter
+{
+public:
+    explicit ErrorRasterWriter(const ErrorRasterOptions& options);
+
+    bool Write(const std::string& path, std::string& error);
+
+    const std::vector<ErrorRaster::Level>& GetLevels() const;
+
+private:
+    // The cells of one tile while its level is being reduced.
+    struct TileReduction
+    {
+        std::vector<double> sum;
+        std::vector<float> min;
+        std::vector<uint32_t> count;
+
+        TileReduction();
+        void Reduce(const TileReduction& child, int quadrantX, int quadrantY);
+    };
+
+    static constexpr uint32_t MAX_NODE_TILES = 256;
+
+    ErrorRasterOptions options;
+    TargetCatalog combinedTargets;
+    int width;
+    int height;
+    std::vector<ErrorRaster::Level> levels;
+
+    std::ofstream file;
+    std::mutex fileMutex;
+    bool writeFailed;
+
+    void EvaluateTile(uint32_t tileX, uint32_t tileY, TileReduction& tile) const;
+    void BuildNode(int level, uint32_t tileX, uint32_t tileY, TileReduction& tile);
+    void WriteTile(int level, uint32_t tileX, uint32_t tileY, const TileReduction& tile);
+};
+
+// Reads single tiles of a raster file.
+class ErrorRasterReader
+{
+public:
+    bool Open(const std::string& path, std::string& error);
+
+    int GetMinBaseLength() const;
+    int GetMaxBaseLength() const;
+    int GetMinHeight() const;
+    int GetMaxHeight() const;
+    const std::vector<ErrorRaster::Level>& GetLevels() const;
+
+    // Level 0 only has the MIN band, which holds the error sum itself.
+    bool ReadTile(int level, uint32_t tileX, uint32_t tileY, ErrorRaster::Band band, std::vector<float>& cells);
+
+private:
+    std::ifstream file;
+    int32_t bounds[4];
+    std::vector<ErrorRaster::Level> levels;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,188 @@
+#include "Leaderboard.h"
+#include "BinaryIO.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+
+bool IsBetter(double relativeErrorSum, int baseLength, int height, const LeaderboardEntry& entry)
+{
+    return relativeErrorSum < entry.relativeErrorSum ||
+        (relativeErrorSum == entry.relativeErrorSum && std::make_pair(baseLength, height) < std::make_pair(entry.baseLength, entry.height));
+}
+
+bool IsBetterEntry(const LeaderboardEntry& a, const LeaderboardEntry& b)
+{
+    return IsBetter(a.relativeErrorSum, a.baseLength, a.height, b);
+}
+
+void WriteClosestResult(std::ostream& stream, const GetClosestResult& closest)
+{
+    BinaryIO::Write(stream, (int32_t) closest.dimension1.first);
+    BinaryIO::Write(stream, closest.dimension1.second);
+    BinaryIO::Write(stream, (int32_t) closest.dimension2.first);
+    BinaryIO::Write(stream, closest.dimension2.second);
+    BinaryIO::Write(stream, closest.value);
+    BinaryIO::Write(stream, closest.relativeError);
+}
+
+bool ReadClosestResult(std::istream& stream, GetClosestResult& closest)
+{
+    int32_t dimension1;
+    int32_t dimension2;
+    bool read = BinaryIO::Read(stream, dimension1) && BinaryIO::Read(stream, closest.dimension1.second) &&
+        BinaryIO::Read(stream, dimension2) && BinaryIO::Read(stream, closest.dimension2.second) &&
+        BinaryIO::Read(stream, closest.value) && BinaryIO::Read(stream, closest.relativeError);
+    if (!read || dimension1 < 0 || dimension1 >= PYRAMID_DIMENSION_COUNT || dimension2 < 0 || dimension2 >= PYRAMID_DIMENSION_COUNT)
+    {
+        return false;
+    }
+
+    closest.dimension1.first = (PyramidDimension) dimension1;
+    closest.dimension2.first = (PyramidDimension) dimension2;
+    return true;
+}
+
+}
+
+Leaderboard::Leaderboard(size_t capacity):
+    capacity(capacity)
+{
+}
+
+size_t Leaderboard::GetCapacity() const
+{
+    return capacity;
+}
+
+size_t Leaderboard::GetSize() const
+{
+    return entries.size();
+}
+
+bool Leaderboard::Admits(int baseLength, int height, double relativeErrorSum) const
+{
+    if (entries.size() < capacity)
+    {
+        return true;
+    }
+
+    return capacity > 0 && IsBetter(relativeErrorSum, baseLength, height, entries.front());
+}
+
+void Leaderboard::AddMultiples(int baseLength, int height, int reducedBaseLength, int reducedHeight, uint32_t count,
+    double relativeErrorSum, const std::vector<GetClosestResult>& closest)
+{
+    // The multiples share an error sum and grow in (base length, height), so once one is
+    // turned away so are all that follow.
+    for (uint32_t i = 0; i < count && Admits(baseLength, height, relativeErrorSum); ++i)
+    {
+        Pyramid pyramid(baseLength, height);
+
+        LeaderboardEntry entry;
+        entry.baseLength = baseLength;
+        entry.height = height;
+        entry.relativeErrorSum = relativeErrorSum;
+        entry.closest = closest;
+        for (GetClosestResult& result : entry.closest)
+        {
+            result.dimension1.second = pyramid.GetDimension(result.dimension1.first);
+            result.dimension2.second = pyramid.GetDimension(result.dimension2.first);
+        }
+
+        Add(std::move(entry));
+
+        baseLength += reducedBaseLength;
+        height += reducedHeight;
+    }
+}
+
+void Leaderboard::Add(LeaderboardEntry entry)
+{
+    if (!Admits(entry.baseLength, entry.height, entry.relativeErrorSum))
+    {
+        return;
+    }
+
+    if (entries.size() == capacity)
+    {
+        std::pop_heap(entries.begin(), entries.end(), IsBetterEntry);
+        entries.pop_back();
+    }
+
+    entries.push_back(std::move(entry));
+    std::push_heap(entries.begin(), entries.end(), IsBetterEntry);
+}
+
+void Leaderboard::Merge(const Leaderboard& other)
+{
+    capacity = std::max(capacity, other.capacity);
+    for (const LeaderboardEntry& entry : other.entries)
+    {
+        if (Admits(entry.baseLength, entry.height, entry.relativeErrorSum))
+        {
+            Add(entry);
+        }
+    }
+}
+
+std::vector<LeaderboardEntry> Leaderboard::GetSortedEntries() const
+{
+    std::vector<LeaderboardEntry> sortedEntries = entries;
+    std::sort(sortedEntries.begin(), sortedEntries.end(), IsBetterEntry);
+    return sortedEntries;
+}
+
+void Leaderboard::Write(std::ostream& stream) const
+{
+    BinaryIO::Write(stream, (uint64_t) capacity);
+    BinaryIO::Write(stream, (uint64_t) entries.size());
+    for (const LeaderboardEntry& entry : entries)
+    {
+        BinaryIO::Write(stream, entry.baseLength);
+        BinaryIO::Write(stream, entry.height);
+        BinaryIO::Write(stream, entry.relativeErrorSum);
+        BinaryIO::Write(stream, (uint64_t) entry.closest.size());
+        for (const GetClosestResult& closest : entry.closest)
+        {
+            WriteClosestResult(stream, closest);
+        }
+    }
+}
+
+bool Leaderboard::Read(std::istream& stream)
+{
+    uint64_t storedCapacity;
+    uint64_t entryCount;
+    if (!BinaryIO::Read(stream, storedCapacity) || !BinaryIO::Read(stream, entryCount) || entryCount > storedCapacity)
+    {
+        return false;
+    }
+
+    capacity = (size_t) storedCapacity;
+    entries.clear();
+    for (uint64_t i = 0; i < entryCount; ++i)
+    {
+        LeaderboardEntry entry;
+        uint64_t closestCount;
+        if (!BinaryIO::Read(stream, entry.baseLength) || !BinaryIO::Read(stream, entry.height) || !BinaryIO::Read(stream, entry.relativeErrorSum) ||
+            !BinaryIO::Read(stream, closestCount) || closestCount > BinaryIO::MAX_VECTOR_SIZE)
+        {
+            return false;
+        }
+
+        entry.closest.resize((size_t) closestCount);
+        for (GetClosestResult& closest : entry.closest)
+        {
+            if (!ReadClosestResult(stream, closest))
+            {
+                return false;
+            }
+        }
+        Add(std::move(entry));
+    }
+
+    return true;
+}
\ No newline at end of file
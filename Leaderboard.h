@@ -0,0 +1,56 @@
+#ifndef LEADERBOARD_H_
+#define LEADERBOARD_H_
+
+#include "Pyramid.h"
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+struct LeaderboardEntry
+{
+public:
+    int baseLength;
+    int height;
+    double relativeErrorSum;
+
+    // The closest match for every catalog target, in catalog order.
+    std::vector<GetClosestResult> closest;
+};
+
+// The best pyramids of a sweep by combined relative error sum, ties going to the smaller
+// (base length, height) as with the single winner. It holds at most its capacity in entries
+// however many pyramids are offered: a max-heap keeps the worst kept entry on top, and an
+// offer that cannot displace it is turned away before its breakdown is copied.
+class Leaderboard
+{
+public:
+    explicit Leaderboard(size_t capacity = 0);
+
+    size_t GetCapacity() const;
+    size_t GetSize() const;
+
+    // True if a pyramid with this error sum would currently be kept.
+    bool Admits(int baseLength, int height, double relativeErrorSum) const;
+
+    // Offers count multiples of a reduced ratio, starting at (baseLength, height) and
+    // stepping by (reducedBaseLength, reducedHeight). closest are the ratio's matches; each
+    // kept entry gets them with the dimensions of its own pyramid.
+    void AddMultiples(int baseLength, int height, int reducedBaseLength, int reducedHeight, uint32_t count,
+        double relativeErrorSum, const std::vector<GetClosestResult>& closest);
+    void Add(LeaderboardEntry entry);
+    void Merge(const Leaderboard& other);
+
+    // The kept entries, best first.
+    std::vector<LeaderboardEntry> GetSortedEntries() const;
+
+    void Write(std::ostream& stream) const;
+    bool Read(std::istream& stream);
+
+private:
+    size_t capacity;
+    std::vector<LeaderboardEntry> entries;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile():
+#ifdef _WIN32
+    fileHandle(nullptr),
+    mappingHandle(nullptr),
+#endif
+    data(nullptr),
+    size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path, const std::string& description, std::string& error)
+{
+    Close();
+
+#ifdef _WIN32
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER fileSize;
+    if (fileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(fileHandle, &fileSize))
+    {
+        fileHandle = nullptr;
+        error = "cannot open " + description + " " + path;
+        return false;
+    }
+
+    size = (size_t) fileSize.QuadPart;
+    mappingHandle = size > 0 ? CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    data = mappingHandle != nullptr ? (const uint8_t*) MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+    int descriptor = open(path.c_str(), O_RDONLY);
+    struct stat status;
+    if (descriptor < 0 || fstat(descriptor, &status) != 0)
+    {
+        if (descriptor >= 0)
+        {
+            close(descriptor);
+        }
+        error = "cannot open " + description + " " + path;
+        return false;
+    }
+
+    size = (size_t) status.st_size;
+    void* mapping = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0) : MAP_FAILED;
+    close(descriptor);
+    data = mapping != MAP_FAILED ? (const uint8_t*) mapping : nullptr;
+#endif
+
+    if (data == nullptr)
+    {
+        Close();
+        error = "cannot map " + description + " " + path;
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+    if (data != nullptr)
+    {
+        UnmapViewOfFile(data);
+    }
+    if (mappingHandle != nullptr)
+    {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle != nullptr)
+    {
+        CloseHandle(fileHandle);
+    }
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    if (data != nullptr)
+    {
+        munmap((void*) data, size);
+    }
+#endif
+
+    data = nullptr;
+    size = 0;
+}
+
+const uint8_t* MappedFile::GetData() const
+{
+    return data;
+}
+
+size_t MappedFile::GetSize() const
+{
+    return size;
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A whole file mapped read-only. The pages are shared with the page cache, so opening is
+// cheap however large the file is and any number of threads can read it.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Fails for a missing or empty file; description names the file in the error.
+    bool Open(const std::string& path, const std::string& description, std::string& error);
+    void Close();
+
+    const uint8_t* GetData() const;
+    size_t GetSize() const;
+
+private:
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+    const uint8_t* data;
+    size_t size;
+};
+
+#endif
\ No newline at end of file
@@ -1,4 +1,8 @@
 #include "MathUtilities.h"
+#include "BinaryIO.h"
+
+#include <algorithm>
+#include <cmath>
 
 namespace
 {
@@ -12,6 +16,40 @@ int gcd(int a, int b)
     return gcd(b, a % b);
 }
 
+int64_t gcd(int64_t a, int64_t b)
+{
+    while (b != 0)
+    {
+        int64_t remainder = a % b;
+        a = b;
+        b = remainder;
+    }
+    return a;
+}
+
+// Returns x in [0, modulus) with a * x == 1 (mod modulus), for coprime a and modulus.
+int64_t ModularInverse(int64_t a, int64_t modulus)
+{
+    int64_t oldR = a % modulus;
+    int64_t r = modulus;
+    int64_t oldS = 1;
+    int64_t s = 0;
+
+    while (r != 0)
+    {
+        int64_t quotient = oldR / r;
+        int64_t temp = oldR - quotient * r;
+        oldR = r;
+        r = temp;
+        temp = oldS - quotient * s;
+        oldS = s;
+        s = temp;
+    }
+
+    oldS %= modulus;
+    return oldS < 0 ? oldS + modulus : oldS;
+}
+
 }
 
 namespace MathUtilities
@@ -27,4 +65,205 @@ std::pair<int, int> ReduceFraction(int x, int y)
     return std::make_pair(x, y);
 }
 
+double CalculateRelativeError(double actual, double expected)
+{
+    return std::abs(actual - expected) / expected;
+}
+
+std::pair<int64_t, int64_t> FindFareyFloor(double x, int64_t order)
+{
+    // Fused, so the sign is exact: positive when numerator / denominator < x.
+    auto gapBelow = [x](int64_t numerator, int64_t denominator)
+    {
+        return std::fma(x, (double) denominator, -(double) numerator);
+    };
+
+    // Descends the Stern-Brocot tree between low <= x and high > x, taking every step in the
+    // same direction at once, until neither can move without passing x or the order.
+    int64_t lowNumerator = (int64_t) std::floor(x);
+    int64_t lowDenominator = 1;
+    int64_t highNumerator = lowNumerator + 1;
+    int64_t highDenominator = 1;
+
+    while (gapBelow(lowNumerator, lowDenominator) > 0.0)
+    {
+        double lowGap = gapBelow(lowNumerator, lowDenominator);
+        double highGap = -gapBelow(highNumerator, highDenominator);
+
+        // low + k * high stays <= x while k * highGap <= lowGap. The quotient is rounded, so
+        // back off a step if it overshoots.
+        int64_t lowSteps = (int64_t) std::min(std::floor(lowGap / highGap), (double) ((order - lowDenominator) / highDenominator));
+        if (lowSteps > 0 && gapBelow(lowNumerator + lowSteps * highNumerator, lowDenominator + lowSteps * highDenominator) < 0.0)
+        {
+            --lowSteps;
+        }
+        if (lowSteps > 0)
+        {
+            lowNumerator += lowSteps * highNumerator;
+            lowDenominator += lowSteps * highDenominator;
+            continue;
+        }
+
+        // high + k * low stays > x while k * lowGap < highGap.
+        int64_t highSteps = (int64_t) std::min(std::ceil(highGap / lowGap) - 1.0, (double) ((order - highDenominator) / lowDenominator));
+        if (highSteps > 0 && gapBelow(highNumerator + highSteps * lowNumerator, highDenominator + highSteps * lowDenominator) >= 0.0)
+        {
+            --highSteps;
+        }
+        if (highSteps <= 0)
+        {
+            break;
+        }
+        highNumerator += highSteps * lowNumerator;
+        highDenominator += highSteps * lowDenominator;
+    }
+
+    return std::make_pair(lowNumerator, lowDenominator);
+}
+
+FareySequence::FareySequence(int64_t order, int64_t startNumerator, int64_t startDenominator):
+    order(order)
+{
+    int64_t d = gcd(startNumerator, startDenominator);
+    numerator = startNumerator / d;
+    denominator = startDenominator / d;
+
+    // The successor c/d of a/b is the one with b * c - a * d = 1 and the largest d <= order.
+    int64_t successorDenominator = denominator == 1 ? order : (denominator - ModularInverse(numerator, denominator)) % denominator;
+    successorDenominator += (order - successorDenominator) / denominator * denominator;
+    nextNumerator = (1 + numerator * successorDenominator) / denominator;
+    nextDenominator = successorDenominator;
+}
+
+int64_t FareySequence::GetNumerator() const
+{
+    return numerator;
+}
+
+int64_t FareySequence::GetDenominator() const
+{
+    return denominator;
+}
+
+void FareySequence::Next()
+{
+    int64_t k = (order + denominator) / nextDenominator;
+    int64_t followingNumerator = k * nextNumerator - numerator;
+    int64_t followingDenominator = k * nextDenominator - denominator;
+
+    numerator = nextNumerator;
+    denominator = nextDenominator;
+    nextNumerator = followingNumerator;
+    nextDenominator = followingDenominator;
+}
+
+ExactSum::ExactSum():
+    pendingAdds(0)
+{
+    limbs.fill(0);
+}
+
+void ExactSum::Add(double value)
+{
+    AddMultiple(value, 1);
+}
+
+void ExactSum::AddMultiple(double value, uint32_t count)
+{
+    if (value == 0.0 || count == 0)
+    {
+        return;
+    }
+
+    int exponent;
+    double fraction = std::frexp(std::abs(value), &exponent);
+    uint64_t mantissa = (uint64_t) std::ldexp(fraction, 53);
+    AddMantissa(mantissa, exponent - 53, count, value < 0.0);
+}
+
+void ExactSum::AddMantissa(uint64_t mantissa, int exponent, uint32_t count, bool negative)
+{
+    int bitPosition = exponent + BIT_OFFSET;
+    int limb = bitPosition / LIMB_BITS;
+    int shift = bitPosition % LIMB_BITS;
+    const uint64_t mask = (1ull << LIMB_BITS) - 1;
+
+    // Each 32-bit chunk times a 32-bit count fits in 64 bits; its two halves go into
+    // neighbouring limbs, so no limb grows by more than 2^33 per call.
+    uint64_t remaining = mantissa;
+    uint64_t chunk = (remaining << shift) & mask;
+    remaining >>= (LIMB_BITS - shift);
+
+    while (chunk != 0 || remaining != 0)
+    {
+        uint64_t product = chunk * count;
+        int64_t low = (int64_t) (product & mask);
+        int64_t high = (int64_t) (product >> LIMB_BITS);
+        limbs[limb] += negative ? -low : low;
+        limbs[limb + 1] += negative ? -high : high;
+
+        ++limb;
+        chunk = remaining & mask;
+        remaining >>= LIMB_BITS;
+    }
+
+    if (++pendingAdds >= NORMALIZE_INTERVAL)
+    {
+        Normalize();
+    }
+}
+
+void ExactSum::Merge(const ExactSum& other)
+{
+    Normalize();
+    other.Normalize();
+
+    for (int i = 0; i < LIMB_COUNT; ++i)
+    {
+        limbs[i] += other.limbs[i];
+    }
+
+    Normalize();
+}
+
+void ExactSum::Normalize() const
+{
+    for (int i = 0; i < LIMB_COUNT - 1; ++i)
+    {
+        int64_t carry = limbs[i] >> LIMB_BITS;
+        limbs[i] -= carry * (1ll << LIMB_BITS);
+        limbs[i + 1] += carry;
+    }
+
+    pendingAdds = 0;
+}
+
+void ExactSum::Write(std::ostream& stream) const
+{
+    Normalize();
+    BinaryIO::Write(stream, limbs);
+}
+
+bool ExactSum::Read(std::istream& stream)
+{
+    pendingAdds = 0;
+    return BinaryIO::Read(stream, limbs);
+}
+
+double ExactSum::ToDouble() const
+{
+    Normalize();
+
+    double result = 0.0;
+    for (int i = 0; i < LIMB_COUNT; ++i)
+    {
+        if (limbs[i] != 0)
+        {
+            result += std::ldexp((double) limbs[i], i * LIMB_BITS - BIT_OFFSET);
+        }
+    }
+
+    return result;
+}
+
 }
\ No newline at end of file
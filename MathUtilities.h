@@ -2,12 +2,70 @@
 #define MATH_UTILITIES_H_
 
 #include <utility>
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <ostream>
 
 namespace MathUtilities
 {
 
 std::pair<int, int> ReduceFraction(int x, int y);
 
+double CalculateRelativeError(double actual, double expected);
+
+// The largest fraction numerator / denominator <= x with 1 <= denominator <= order, in lowest
+// terms, for x >= 0. A term of the Farey sequence of that order, so it can start one.
+std::pair<int64_t, int64_t> FindFareyFloor(double x, int64_t order);
+
+// Walks the Farey sequence of the given order upwards from the first fraction that is
+// >= startNumerator / startDenominator. Fractions above 1 are included, so this enumerates
+// every reduced numerator / denominator with denominator <= order in increasing order.
+class FareySequence
+{
+public:
+    FareySequence(int64_t order, int64_t startNumerator, int64_t startDenominator);
+
+    int64_t GetNumerator() const;
+    int64_t GetDenominator() const;
+    void Next();
+
+private:
+    int64_t order;
+    int64_t numerator;
+    int64_t denominator;
+    int64_t nextNumerator;
+    int64_t nextDenominator;
+};
+
+// Accumulates doubles exactly in a wide fixed-point register, so the total does not
+// depend on the order of the additions or on how partial sums are merged.
+class ExactSum
+{
+public:
+    ExactSum();
+
+    void Add(double value);
+    void AddMultiple(double value, uint32_t count);
+    void Merge(const ExactSum& other);
+    double ToDouble() const;
+
+    void Write(std::ostream& stream) const;
+    bool Read(std::istream& stream);
+
+private:
+    static constexpr int LIMB_BITS = 32;
+    static constexpr int LIMB_COUNT = 72;
+    static constexpr int BIT_OFFSET = 1074 + 53;
+    static constexpr uint32_t NORMALIZE_INTERVAL = 1u << 29;
+
+    mutable std::array<int64_t, LIMB_COUNT> limbs;
+    mutable uint32_t pendingAdds;
+
+    void AddMantissa(uint64_t mantissa, int exponent, uint32_t count, bool negative);
+    void Normalize() const;
+};
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,280 @@
+#include "Metrics.h"
+#include "AtomicFile.h"
+
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+#define METRIC_NAME_ENTRY(name, metricName, detail) metricName,
+#define METRIC_DETAIL_ENTRY(name, metricName, detail) detail,
+
+const char* COUNTER_NAMES[] = { METRIC_COUNTERS(METRIC_NAME_ENTRY) };
+const char* COUNTER_HELP[] = { METRIC_COUNTERS(METRIC_DETAIL_ENTRY) };
+const char* GROUP_COUNTER_NAMES[] = { METRIC_GROUP_COUNTERS(METRIC_NAME_ENTRY) };
+const char* GROUP_COUNTER_HELP[] = { METRIC_GROUP_COUNTERS(METRIC_DETAIL_ENTRY) };
+const char* PHASE_NAMES[] = { METRIC_PHASES(METRIC_NAME_ENTRY) };
+const bool PHASE_TRACED[] = { METRIC_PHASES(METRIC_DETAIL_ENTRY) };
+
+#undef METRIC_DETAIL_ENTRY
+#undef METRIC_NAME_ENTRY
+
+// Traces stop growing here, about 32 MB of events.
+constexpr size_t MAX_TRACE_EVENTS = 1 << 20;
+
+// The tick count is calibrated against steady_clock over at least this long.
+constexpr double MIN_CALIBRATION_SECONDS = 0.01;
+
+struct TraceEvent
+{
+    Metrics::Phase phase;
+    int threadIndex;
+    uint64_t beginTicks;
+    uint64_t endTicks;
+};
+
+struct ClockPoint
+{
+    std::chrono::steady_clock::time_point time;
+    uint64_t ticks;
+};
+
+ClockPoint ReadClockPoint()
+{
+    ClockPoint point;
+    point.time = std::chrono::steady_clock::now();
+    point.ticks = Metrics::ReadTicks();
+    return point;
+}
+
+const ClockPoint startPoint = ReadClockPoint();
+
+thread_local std::vector<TraceEvent> threadTraceEvents;
+
+std::mutex totalsMutex;
+Metrics::Tallies totals;
+std::vector<TraceEvent> traceEvents;
+uint64_t droppedTraceEventCount = 0;
+
+double ToSeconds(uint64_t ticks, double ticksPerSecond)
+{
+    return (double) ticks / ticksPerSecond;
+}
+
+}
+
+namespace Metrics
+{
+
+thread_local Tallies threadTallies;
+std::atomic<bool> tracing(false);
+
+void Tallies::Merge(const Tallies& other)
+{
+    for (int i = 0; i < COUNTER_COUNT; ++i)
+    {
+        counters[i] += other.counters[i];
+    }
+    for (int i = 0; i < GROUP_COUNTER_COUNT; ++i)
+    {
+        for (int group = 0; group < GROUP_COUNT; ++group)
+        {
+            groupCounters[i][group] += other.groupCounters[i][group];
+        }
+    }
+    for (int i = 0; i < PHASE_COUNT; ++i)
+    {
+        phaseTicks[i] += other.phaseTicks[i];
+        phaseCalls[i] += other.phaseCalls[i];
+    }
+}
+
+bool IsTraced(Phase phase)
+{
+    return PHASE_TRACED[(int) phase];
+}
+
+void RecordTraceEvent(Phase phase, uint64_t beginTicks, uint64_t endTicks)
+{
+    TraceEvent event;
+    event.phase = phase;
+    event.threadIndex = 0;
+    event.beginTicks = beginTicks;
+    event.endTicks = endTicks;
+    threadTraceEvents.push_back(event);
+}
+
+void SetTracing(bool enabled)
+{
+    tracing.store(enabled);
+}
+
+void FlushThread(int threadIndex)
+{
+    if (!ENABLED)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    totals.Merge(threadTallies);
+    threadTallies = Tallies();
+
+    for (TraceEvent& event : threadTraceEvents)
+    {
+        if (traceEvents.size() < MAX_TRACE_EVENTS)
+        {
+            event.threadIndex = threadIndex;
+            traceEvents.push_back(event);
+        }
+        else
+        {
+            ++droppedTraceEventCount;
+        }
+    }
+    threadTraceEvents.clear();
+}
+
+void DiscardThread()
+{
+    threadTallies = Tallies();
+    threadTraceEvents.clear();
+}
+
+Tallies GetTotals()
+{
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    return totals;
+}
+
+double GetTicksPerSecond()
+{
+    ClockPoint now = ReadClockPoint();
+    while (std::chrono::duration<double>(now.time - startPoint.time).count() < MIN_CALIBRATION_SECONDS)
+    {
+        std::this_thread::yield();
+        now = ReadClockPoint();
+    }
+
+    return (double) (now.ticks - startPoint.ticks) / std::chrono::duration<double>(now.time - startPoint.time).count();
+}
+
+bool WriteJson(const std::string& path, std::string& error)
+{
+    Tallies tallies = GetTotals();
+    double ticksPerSecond = GetTicksPerSecond();
+
+    std::ostringstream stream;
+    stream << std::setprecision(9);
+    stream << "{\n";
+    stream << "  \"enabled\": " << (ENABLED ? "true" : "false") << ",\n";
+#ifdef METRICS_TSC
+    stream << "  \"timer\": \"tsc\",\n";
+#else
+    stream << "  \"timer\": \"steady_clock\",\n";
+#endif
+    stream << "  \"ticksPerSecond\": " << ticksPerSecond << ",\n";
+
+    stream << "  \"counters\": {\n";
+    for (int i = 0; i < COUNTER_COUNT; ++i)
+    {
+        stream << "    \"" << COUNTER_NAMES[i] << "\": " << tallies.counters[i] << (i + 1 < COUNTER_COUNT ? ",\n" : "\n");
+    }
+    stream << "  },\n";
+
+    stream << "  \"groups\": {\n";
+    for (int group = 0; group < GROUP_COUNT; ++group)
+    {
+        stream << "    \"" << DimensionGroupLabels[group] << "\": { ";
+        for (int i = 0; i < GROUP_COUNTER_COUNT; ++i)
+        {
+            stream << "\"" << GROUP_COUNTER_NAMES[i] << "\": " << tallies.groupCounters[i][group] << (i + 1 < GROUP_COUNTER_COUNT ? ", " : " }");
+        }
+        stream << (group + 1 < GROUP_COUNT ? ",\n" : "\n");
+    }
+    stream << "  },\n";
+
+    stream << "  \"phases\": {\n";
+    for (int i = 0; i < PHASE_COUNT; ++i)
+    {
+        stream << "    \"" << PHASE_NAMES[i] << "\": { \"calls\": " << tallies.phaseCalls[i] << ", \"seconds\": "
+            << ToSeconds(tallies.phaseTicks[i], ticksPerSecond) << " }" << (i + 1 < PHASE_COUNT ? ",\n" : "\n");
+    }
+    stream << "  }\n";
+    stream << "}\n";
+
+    return WriteFileAtomically(path, stream.str(), error);
+}
+
+bool WritePrometheus(const std::string& path, std::string& error)
+{
+    Tallies tallies = GetTotals();
+    double ticksPerSecond = GetTicksPerSecond();
+
+    std::ostringstream stream;
+    stream << std::setprecision(9);
+    for (int i = 0; i < COUNTER_COUNT; ++i)
+    {
+        std::string name = std::string("pyramid_") + COUNTER_NAMES[i] + "_total";
+        stream << "# HELP " << name << ' ' << COUNTER_HELP[i] << '\n';
+        stream << "# TYPE " << name << " counter\n";
+        stream << name << ' ' << tallies.counters[i] << '\n';
+    }
+
+    for (int i = 0; i < GROUP_COUNTER_COUNT; ++i)
+    {
+        std::string name = std::string("pyramid_") + GROUP_COUNTER_NAMES[i] + "_total";
+        stream << "# HELP " << name << ' ' << GROUP_COUNTER_HELP[i] << '\n';
+        stream << "# TYPE " << name << " counter\n";
+        for (int group = 0; group < GROUP_COUNT; ++group)
+        {
+            stream << name << "{group=\"" << DimensionGroupLabels[group] << "\"} " << tallies.groupCounters[i][group] << '\n';
+        }
+    }
+
+    stream << "# HELP pyramid_phase_seconds_total time spent in each phase, summed over threads\n";
+    stream << "# TYPE pyramid_phase_seconds_total counter\n";
+    for (int i = 0; i < PHASE_COUNT; ++i)
+    {
+        stream << "pyramid_phase_seconds_total{phase=\"" << PHASE_NAMES[i] << "\"} " << ToSeconds(tallies.phaseTicks[i], ticksPerSecond) << '\n';
+    }
+    stream << "# HELP pyramid_phase_calls_total times each phase ran\n";
+    stream << "# TYPE pyramid_phase_calls_total counter\n";
+    for (int i = 0; i < PHASE_COUNT; ++i)
+    {
+        stream << "pyramid_phase_calls_total{phase=\"" << PHASE_NAMES[i] << "\"} " << tallies.phaseCalls[i] << '\n';
+    }
+
+    return WriteFileAtomically(path, stream.str(), error);
+}
+
+// The Trace Event Format's complete events, with microsecond timestamps from the start of the
+// process, as chrome://tracing and Perfetto read them.
+bool WriteChromeTrace(const std::string& path, std::string& error)
+{
+    double ticksPerSecond = GetTicksPerSecond();
+
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(3);
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    {
+        std::lock_guard<std::mutex> lock(totalsMutex);
+        for (size_t i = 0; i < traceEvents.size(); ++i)
+        {
+            const TraceEvent& event = traceEvents[i];
+            stream << "{\"name\":\"" << PHASE_NAMES[(int) event.phase] << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.threadIndex
+                << ",\"ts\":" << ToSeconds(event.beginTicks - startPoint.ticks, ticksPerSecond) * 1.0E6
+                << ",\"dur\":" << ToSeconds(event.endTicks - event.beginTicks, ticksPerSecond) * 1.0E6 << "}"
+                << (i + 1 < traceEvents.size() ? ",\n" : "\n");
+        }
+        stream << "],\"otherData\":{\"droppedEvents\":" << droppedTraceEventCount << "}}\n";
+    }
+
+    return WriteFileAtomically(path, stream.str(), error);
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,205 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include "Pyramid.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define METRICS_TSC 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+// Build with -DPYRAMID_METRICS=0 to compile every count and timer below away.
+#ifndef PYRAMID_METRICS
+#define PYRAMID_METRICS 1
+#endif
+
+// X(name, metric name, help)
+#define METRIC_COUNTERS(X) \
+    X(FAREY_TERMS, "farey_terms", "Farey terms the sweep stepped past") \
+    X(ACCEPTED_RATIOS, "accepted_ratios", "coprime ratios with pyramids inside the bounds") \
+    X(ACCEPTED_PAIRS, "accepted_pairs", "(base length, height) pairs inside the bounds") \
+    X(KHUFU_RATIO_REJECTED_PAIRS, "khufu_ratio_rejected_pairs", "pairs inside the dimension bounds with Khufu's height to base ratio") \
+    X(RATIO_WINDOW_REJECTED_PAIRS, "ratio_window_rejected_pairs", "pairs inside the dimension bounds outside the height to base ratio window, counted by the sweep's first shard") \
+    X(VOLUME_REJECTED_PAIRS, "volume_rejected_pairs", "pairs of the swept ratio window inside the dimension bounds outside the volume band") \
+    X(CLOSEST_SEARCHES, "closest_searches", "closest-match searches")
+
+// Counted per group of DIMENSION_GROUPS. X(name, metric name, help)
+#define METRIC_GROUP_COUNTERS(X) \
+    X(SEARCHED, "group_searched", "searches that scored candidates of the group") \
+    X(SKIPPED, "group_skipped", "searches that pruned the whole group") \
+    X(EVALUATED_CANDIDATES, "group_evaluated_candidates", "varying candidates of the group that were scored") \
+    X(WINS, "group_wins", "searches whose closest match is a candidate of the group")
+
+// X(name, metric name, traced): traced phases also go into the Chrome trace.
+#define METRIC_PHASES(X) \
+    X(SEGMENT, "segment", true) \
+    X(PYRAMIDS, "pyramids", false) \
+    X(CLOSEST, "closest", false) \
+    X(ACCUMULATE, "accumulate", false) \
+    X(CHECKPOINT, "checkpoint", true) \
+    X(MERGE, "merge", true) \
+    X(SOLVER_PIECE, "solver_piece", true)
+
+#define METRIC_ENUM_ENTRY(name, metricName, detail) name,
+
+// Low-overhead counters and phase timers for the sweep's hot paths. Every thread tallies into
+// its own thread-local block without synchronization; FlushThread adds a thread's block to the
+// process totals, which the writers export. Phases are timed with the time stamp counter where
+// there is one and with steady_clock otherwise.
+namespace Metrics
+{
+
+enum class Counter
+{
+    METRIC_COUNTERS(METRIC_ENUM_ENTRY)
+    COUNT
+};
+
+enum class GroupCounter
+{
+    METRIC_GROUP_COUNTERS(METRIC_ENUM_ENTRY)
+    COUNT
+};
+
+enum class Phase
+{
+    METRIC_PHASES(METRIC_ENUM_ENTRY)
+    COUNT
+};
+
+constexpr int COUNTER_COUNT = (int) Counter::COUNT;
+constexpr int GROUP_COUNTER_COUNT = (int) GroupCounter::COUNT;
+constexpr int GROUP_COUNT = (int) DIMENSION_GROUPS.size();
+constexpr int PHASE_COUNT = (int) Phase::COUNT;
+
+constexpr bool ENABLED = PYRAMID_METRICS != 0;
+
+struct Tallies
+{
+    uint64_t counters[COUNTER_COUNT];
+    uint64_t groupCounters[GROUP_COUNTER_COUNT][GROUP_COUNT];
+    uint64_t phaseTicks[PHASE_COUNT];
+    uint64_t phaseCalls[PHASE_COUNT];
+
+    void Merge(const Tallies& other);
+};
+
+// Trivially constructible, so reaching it costs no thread_local initialization check.
+extern thread_local Tallies threadTallies;
+extern std::atomic<bool> tracing;
+
+inline uint64_t ReadTicks()
+{
+#ifdef METRICS_TSC
+    return __rdtsc();
+#else
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline void Count(Counter counter, uint64_t count = 1)
+{
+#if PYRAMID_METRICS
+    threadTallies.counters[(int) counter] += count;
+#else
+    (void) counter;
+    (void) count;
+#endif
+}
+
+inline void CountGroup(GroupCounter counter, int group, uint64_t count = 1)
+{
+#if PYRAMID_METRICS
+    threadTallies.groupCounters[(int) counter][group] += count;
+#else
+    (void) counter;
+    (void) group;
+    (void) count;
+#endif
+}
+
+bool IsTraced(Phase phase);
+void RecordTraceEvent(Phase phase, uint64_t beginTicks, uint64_t endTicks);
+
+// Times the enclosing scope, or up to End, as one call of phase.
+class ScopedPhase
+{
+public:
+#if PYRAMID_METRICS
+    explicit ScopedPhase(Phase phase):
+        phase(phase),
+        beginTicks(ReadTicks()),
+        running(true)
+    {
+    }
+
+    ~ScopedPhase()
+    {
+        End();
+    }
+
+    void End()
+    {
+        if (!running)
+        {
+            return;
+        }
+
+        running = false;
+        uint64_t endTicks = ReadTicks();
+        threadTallies.phaseTicks[(int) phase] += endTicks - beginTicks;
+        ++threadTallies.phaseCalls[(int) phase];
+        if (tracing.load(std::memory_order_relaxed) && IsTraced(phase))
+        {
+            RecordTraceEvent(phase, beginTicks, endTicks);
+        }
+    }
+
+private:
+    Phase phase;
+    uint64_t beginTicks;
+    bool running;
+#else
+    explicit ScopedPhase(Phase)
+    {
+    }
+
+    void End()
+    {
+    }
+#endif
+
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+};
+
+// Whether traced phases are recorded for WriteChromeTrace. Off by default.
+void SetTracing(bool enabled);
+
+// Adds the calling thread's tallies and trace events to the process totals and clears them.
+// threadIndex labels the thread's events in the trace.
+void FlushThread(int threadIndex);
+
+// Clears the calling thread's tallies and trace events without adding them to the totals, so
+// searches made outside a sweep or solve stay out of its counts.
+void DiscardThread();
+
+Tallies GetTotals();
+double GetTicksPerSecond();
+
+bool WriteJson(const std::string& path, std::string& error);
+bool WritePrometheus(const std::string& path, std::string& error);
+bool WriteChromeTrace(const std::string& path, std::string& error);
+
+}
+
+#endif
\ No newline at end of file
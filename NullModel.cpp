@@ -0,0 +1,211 @@
+#include "NullModel.h"
+#include "ClosestKernel.h"
+#include "MathUtilities.h"
+#include "WorkStealingScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+// The two-sided 95% quantile of the standard normal distribution.
+constexpr double CONFIDENCE_Z = 1.959963984540054;
+
+}
+
+NullModel::NullModel(const SweepOptions& options, const NullModelOptions& nullOptions, const Pyramid& observedPyramid):
+    options(options),
+    nullOptions(nullOptions),
+    random(nullOptions.seed),
+    observedPyramid(observedPyramid),
+    low(nullOptions.low),
+    high(nullOptions.high)
+{
+    for (const Target& target : options.targets.GetTargets())
+    {
+        if (target.inCombinedSum)
+        {
+            combinedTargets.push_back(target.value);
+        }
+    }
+
+    const double* dimensions = observedPyramid.GetDimensions().data();
+    for (const DimensionGroup& group : DIMENSION_GROUPS)
+    {
+        for (int i = group.begin; i < group.end; ++i)
+        {
+            for (int j = group.begin; j < group.end; ++j)
+            {
+                if (i != j)
+                {
+                    pairRatios.push_back(dimensions[i] / dimensions[j]);
+                }
+            }
+        }
+    }
+    std::sort(pairRatios.begin(), pairRatios.end());
+
+    if (!nullOptions.rangeSet)
+    {
+        switch (nullOptions.hypothesis)
+        {
+        case NullHypothesis::DIMENSIONS:
+            low = options.minHeightToBaseRatio;
+            high = options.maxHeightToBaseRatio;
+            break;
+        case NullHypothesis::TARGETS:
+            low = combinedTargets.empty() ? 0.0 : 0.5 * *std::min_element(combinedTargets.begin(), combinedTargets.end());
+            high = combinedTargets.empty() ? 0.0 : 2.0 * *std::max_element(combinedTargets.begin(), combinedTargets.end());
+            break;
+        case NullHypothesis::FACTORS:
+            low = allowedFactors.front();
+            high = allowedFactors.back();
+            break;
+        }
+    }
+
+    logLow = low > 0.0 ? std::log(low) : 0.0;
+    logHigh = high > 0.0 ? std::log(high) : 0.0;
+}
+
+bool NullModel::Run(NullModelResult& result, std::string& error) const
+{
+    if (combinedTargets.empty())
+    {
+        error = "the null model needs at least one combined target";
+        return false;
+    }
+    if (!(low < high) || (nullOptions.distribution == NullDistribution::LOG_UNIFORM && low <= 0.0))
+    {
+        error = "the null model range must have low < high, and low > 0 for a log-uniform distribution";
+        return false;
+    }
+
+    double observedRelativeErrorSum;
+    if (nullOptions.hypothesis == NullHypothesis::FACTORS)
+    {
+        observedRelativeErrorSum = ScoreFactors(allowedFactors.data(), allowedFactors.size());
+    }
+    else
+    {
+        observedRelativeErrorSum = ScoreTargets(observedPyramid.GetDimensions().data(), combinedTargets.data());
+    }
+
+    uint64_t blockCount = (nullOptions.drawCount + DRAWS_PER_BLOCK - 1) / DRAWS_PER_BLOCK;
+    std::vector<uint64_t> blockCounts((size_t) blockCount, 0);
+    WorkStealingScheduler scheduler(options.threadCount);
+    scheduler.Run((uint32_t) blockCount, [&](int, uint32_t block)
+    {
+        std::vector<double> values(std::max(combinedTargets.size(), allowedFactors.size()));
+        uint64_t begin = block * DRAWS_PER_BLOCK;
+        uint64_t end = std::min(nullOptions.drawCount, begin + DRAWS_PER_BLOCK);
+        uint64_t count = 0;
+        for (uint64_t draw = begin; draw < end; ++draw)
+        {
+            count += ScoreDraw(draw, values) <= observedRelativeErrorSum ? 1 : 0;
+        }
+        blockCounts[block] = count;
+    });
+
+    result.low = low;
+    result.high = high;
+    result.observedRelativeErrorSum = observedRelativeErrorSum;
+    result.drawCount = nullOptions.drawCount;
+    result.atLeastAsGoodCount = 0;
+    for (uint64_t count : blockCounts)
+    {
+        result.atLeastAsGoodCount += count;
+    }
+
+    double n = (double) result.drawCount;
+    double k = (double) result.atLeastAsGoodCount;
+    result.pValue = (k + 1.0) / (n + 1.0);
+    result.confidenceLow = 0.0;
+    result.confidenceHigh = 1.0;
+    if (result.drawCount > 0)
+    {
+        double proportion = k / n;
+        double z2 = CONFIDENCE_Z * CONFIDENCE_Z;
+        double center = (proportion + z2 / (2.0 * n)) / (1.0 + z2 / n);
+        double halfWidth = CONFIDENCE_Z * std::sqrt(proportion * (1.0 - proportion) / n + z2 / (4.0 * n * n)) / (1.0 + z2 / n);
+        result.confidenceLow = std::max(0.0, center - halfWidth);
+        result.confidenceHigh = std::min(1.0, center + halfWidth);
+    }
+
+    return true;
+}
+
+double NullModel::DrawValue(uint64_t draw, uint32_t index) const
+{
+    double unit = CounterRandom::ToUnitInterval(random.Generate(draw, index / 2)[index % 2]);
+    if (nullOptions.distribution == NullDistribution::LOG_UNIFORM)
+    {
+        return std::exp(logLow + unit * (logHigh - logLow));
+    }
+    return low + unit * (high - low);
+}
+
+double NullModel::ScoreDraw(uint64_t draw, std::vector<double>& values) const
+{
+    switch (nullOptions.hypothesis)
+    {
+    case NullHypothesis::DIMENSIONS:
+    {
+        Pyramid pyramid = Pyramid::FromHeightToBaseRatio(DrawValue(draw, 0));
+        return ScoreTargets(pyramid.GetDimensions().data(), combinedTargets.data());
+    }
+    case NullHypothesis::TARGETS:
+        for (uint32_t i = 0; i < combinedTargets.size(); ++i)
+        {
+            values[i] = DrawValue(draw, i);
+        }
+        return ScoreTargets(observedPyramid.GetDimensions().data(), values.data());
+    case NullHypothesis::FACTORS:
+        for (uint32_t i = 0; i < allowedFactors.size(); ++i)
+        {
+            values[i] = DrawValue(draw, i);
+        }
+        return ScoreFactors(values.data(), allowedFactors.size());
+    }
+    return std::numeric_limits<double>::max();
+}
+
+double NullModel::ScoreTargets(const double* dimensions, const double* targets) const
+{
+    double relativeErrorSum = 0.0;
+    for (size_t i = 0; i < combinedTargets.size(); ++i)
+    {
+        int candidate = ClosestKernel::FindClosestCandidate(dimensions, targets[i]);
+        relativeErrorSum += MathUtilities::CalculateRelativeError(ClosestKernel::CalculateCandidateValue(dimensions, candidate), targets[i]);
+    }
+    return relativeErrorSum;
+}
+
+double NullModel::ScoreFactors(const double* factors, size_t factorCount) const
+{
+    double relativeErrorSum = 0.0;
+    for (double target : combinedTargets)
+    {
+        double closest = 0.0;
+        double minAbsoluteError = std::numeric_limits<double>::max();
+        for (size_t k = 0; k < factorCount; ++k)
+        {
+            // A factor's values ascend with the ratio, so the closest is next to target / factor.
+            size_t position = std::lower_bound(pairRatios.begin(), pairRatios.end(), target / factors[k]) - pairRatios.begin();
+            for (size_t p = position > 0 ? position - 1 : 0; p < std::min(position + 1, pairRatios.size()); ++p)
+            {
+                double value = pairRatios[p] * factors[k];
+                double absoluteError = std::abs(value - target);
+                if (absoluteError < minAbsoluteError)
+                {
+                    closest = value;
+                    minAbsoluteError = absoluteError;
+                }
+            }
+        }
+        relativeErrorSum += MathUtilities::CalculateRelativeError(closest, target);
+    }
+    return relativeErrorSum;
+}
\ No newline at end of file
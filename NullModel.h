@@ -0,0 +1,112 @@
+#ifndef NULL_MODEL_H_
+#define NULL_MODEL_H_
+
+#include "CounterRandom.h"
+#include "Pyramid.h"
+#include "Sweep.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What a draw randomizes; everything else stays as observed.
+enum class NullHypothesis
+{
+    // The pyramid's proportions. Every quantity GetClosest compares is a ratio within a group,
+    // so a random dimension set is a random height to base ratio.
+    DIMENSIONS = 0,
+    // The values of the combined targets.
+    TARGETS,
+    // The factors candidates are scaled by, as many as allowedFactors has.
+    FACTORS
+};
+
+constexpr const char* const NullHypothesisStrings[] =
+{
+    "dimensions",
+    "targets",
+    "factors"
+};
+
+enum class NullDistribution
+{
+    UNIFORM = 0,
+    LOG_UNIFORM
+};
+
+constexpr const char* const NullDistributionStrings[] =
+{
+    "uniform",
+    "log-uniform"
+};
+
+struct NullModelOptions
+{
+    NullHypothesis hypothesis = NullHypothesis::DIMENSIONS;
+    NullDistribution distribution = NullDistribution::LOG_UNIFORM;
+
+    // The range the randomized quantities are drawn from. Unless rangeSet the hypothesis'
+    // default is used: the sweep's height to base ratio window, half the smallest to twice the
+    // largest combined target, or the range of allowedFactors.
+    bool rangeSet = false;
+    double low = 0.0;
+    double high = 0.0;
+
+    uint64_t drawCount = 1000000;
+    uint64_t seed = 1;
+};
+
+struct NullModelResult
+{
+    double low;
+    double high;
+    double observedRelativeErrorSum;
+
+    uint64_t drawCount;
+    // Draws whose relative error sum is at most the observed one.
+    uint64_t atLeastAsGoodCount;
+
+    // (atLeastAsGoodCount + 1) / (drawCount + 1), which never understates the chance of doing
+    // as well by luck, and the 95% Wilson score interval of atLeastAsGoodCount / drawCount.
+    double pValue;
+    double confidenceLow;
+    double confidenceHigh;
+};
+
+// Monte Carlo significance test of the observed pyramid's combined relative error sum. Each
+// draw replaces the quantity the hypothesis names with random values and scores the combined
+// targets the way the sweep does: DIMENSIONS and TARGETS through ClosestKernel, FACTORS by the
+// same group-wise pairs with the drawn factors in place of allowedFactors.
+//
+// Draw i takes its random numbers from CounterRandom at counter i, and the draws are counted
+// in fixed blocks whose totals are integers, so a run gives the same result on any number of
+// threads.
+class NullModel
+{
+public:
+    NullModel(const SweepOptions& options, const NullModelOptions& nullOptions, const Pyramid& observedPyramid);
+
+    bool Run(NullModelResult& result, std::string& error) const;
+
+private:
+    static constexpr uint64_t DRAWS_PER_BLOCK = 1 << 14;
+
+    SweepOptions options;
+    NullModelOptions nullOptions;
+    CounterRandom random;
+    Pyramid observedPyramid;
+    std::vector<double> combinedTargets;
+    // The observed pyramid's dimension ratios within each group, sorted, for FACTORS.
+    std::vector<double> pairRatios;
+    double low;
+    double high;
+    double logLow;
+    double logHigh;
+
+    double DrawValue(uint64_t draw, uint32_t index) const;
+    double ScoreDraw(uint64_t draw, std::vector<double>& values) const;
+    double ScoreTargets(const double* dimensions, const double* targets) const;
+    double ScoreFactors(const double* factors, size_t factorCount) const;
+};
+
+#endif
\ No newline at end of file
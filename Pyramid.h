@@ -2,53 +2,133 @@
 #define PYRAMID_H_
 
 #include <iostream>
-#include <vector>
+#include <array>
+#include <cmath>
 #include <utility>
 #include <iomanip>
+#include <type_traits>
+
+// Every pyramid dimension in PyramidDimension order, one entry each: the name, the label Print
+// uses, the group it is compared within and its formula. A formula may use the parameters
+// baseLength and height, dimensions listed before it as DIMENSION(NAME), and Sqrt, Square and
+// Atan. The enum, the names, the groups, Pyramid's constructor and PyramidBatch's vector
+// evaluator are all expanded from this list, so adding a dimension is adding a line here.
+#define PYRAMID_DIMENSIONS(X) \
+    X(BASE_LENGTH, "base length", LENGTHS, baseLength) \
+    X(HEIGHT, "height", LENGTHS, height) \
+    X(BASE_PERIMETER, "base perimeter", LENGTHS, 4.0 * DIMENSION(BASE_LENGTH)) \
+    X(BASE_DIAGONAL, "base diagonal", LENGTHS, std::sqrt(2.0) * DIMENSION(BASE_LENGTH)) \
+    X(SLANT_LENGTH, "slant length", LENGTHS, Sqrt(Square(0.5 * DIMENSION(BASE_LENGTH)) + Square(DIMENSION(HEIGHT)))) \
+    X(LATERAL_EDGE_LENGTH, "lateral edge length", LENGTHS, Sqrt(Square(0.5 * DIMENSION(BASE_LENGTH)) + Square(DIMENSION(SLANT_LENGTH)))) \
+    X(WEST_EAST_CROSS_SECTION_CORNER_ANGLE, "WEST_EAST_CROSS_SECTION_CORNER_ANGLE", ANGLES1, Atan(DIMENSION(HEIGHT) / (0.5 * DIMENSION(BASE_LENGTH)))) \
+    X(WEST_EAST_CROSS_SECTION_VERTEX_ANGLE, "WEST_EAST_CROSS_SECTION_VERTEX_ANGLE", ANGLES1, 2.0 * Atan(0.5 * DIMENSION(BASE_LENGTH) / DIMENSION(HEIGHT))) \
+    X(LATERAL_FACE_CORNER_ANGLE, "LATERAL_FACE_CORNER_ANGLE", ANGLES2, Atan(DIMENSION(SLANT_LENGTH) / (0.5 * DIMENSION(BASE_LENGTH)))) \
+    X(LATERAL_FACE_VERTEX_ANGLE, "LATERAL_FACE_VERTEX_ANGLE", ANGLES2, 2.0 * Atan(0.5 * DIMENSION(BASE_LENGTH) / DIMENSION(SLANT_LENGTH))) \
+    X(SOUTHWEST_NORTHEAST_CROSS_SECTION_CORNER_ANGLE, "SOUTHWEST_NORTHEAST_CROSS_SECTION_CORNER_ANGLE", ANGLES3, Atan(DIMENSION(HEIGHT) / (0.5 * DIMENSION(BASE_DIAGONAL)))) \
+    X(SOUTHWEST_NORTHEAST_CROSS_SECTION_VERTEX_ANGLE, "SOUTHWEST_NORTHEAST_CROSS_SECTION_VERTEX_ANGLE", ANGLES3, 2.0 * Atan(0.5 * DIMENSION(BASE_DIAGONAL) / DIMENSION(HEIGHT))) \
+    X(BASE_AREA, "base area", AREAS, Square(DIMENSION(BASE_LENGTH))) \
+    X(LATERAL_FACE_AREA, "lateral face area", AREAS, DIMENSION(BASE_LENGTH) * DIMENSION(SLANT_LENGTH) * 0.5) \
+    X(SURFACE_AREA_NOT_INCLUDING_BASE, "surface area not including base", AREAS, 4.0 * DIMENSION(LATERAL_FACE_AREA)) \
+    X(SURFACE_AREA_INCLUDING_BASE, "surface area including base", AREAS, 4.0 * DIMENSION(LATERAL_FACE_AREA) + DIMENSION(BASE_AREA)) \
+    X(VOLUME, "VOLUME", UNGROUPED, Square(DIMENSION(BASE_LENGTH)) * DIMENSION(HEIGHT) / 3.0)
+
+#define PYRAMID_DIMENSION_ENUM_ENTRY(name, label, group, formula) name,
+#define PYRAMID_DIMENSION_NAME_ENTRY(name, label, group, formula) #name,
+#define PYRAMID_DIMENSION_LABEL_ENTRY(name, label, group, formula) label,
+#define PYRAMID_DIMENSION_GROUP_ENTRY(name, label, group, formula) DimensionGroupName::group,
 
 enum class PyramidDimension
 {
-    BASE_LENGTH = 0,
-    HEIGHT,
-    BASE_PERIMETER,
-    BASE_DIAGONAL,
-    SLANT_LENGTH,
-    LATERAL_EDGE_LENGTH,
-    WEST_EAST_CROSS_SECTION_CORNER_ANGLE,
-    WEST_EAST_CROSS_SECTION_VERTEX_ANGLE,
-    LATERAL_FACE_CORNER_ANGLE,
-    LATERAL_FACE_VERTEX_ANGLE,
-    SOUTHWEST_NORTHEAST_CROSS_SECTION_CORNER_ANGLE,
-    SOUTHWEST_NORTHEAST_CROSS_SECTION_VERTEX_ANGLE,
-    BASE_AREA,
-    LATERAL_FACE_AREA,
-    SURFACE_AREA_NOT_INCLUDING_BASE,
-    SURFACE_AREA_INCLUDING_BASE,
-    VOLUME
+    PYRAMID_DIMENSIONS(PYRAMID_DIMENSION_ENUM_ENTRY)
 };
 
-static const char* PyramidDimensionStrings[] =
+constexpr int PYRAMID_DIMENSION_COUNT = (int) PyramidDimension::VOLUME + 1;
+
+// Dimensions in one group share a unit and may be divided by one another. GetClosest searches
+// the groups in this order; UNGROUPED dimensions are never compared. Each has the label that
+// reports use.
+#define DIMENSION_GROUP_NAMES(X) \
+    X(LENGTHS, "lengths") \
+    X(ANGLES1, "angles1") \
+    X(ANGLES2, "angles2") \
+    X(ANGLES3, "angles3") \
+    X(AREAS, "areas") \
+    X(UNGROUPED, "ungrouped")
+
+#define DIMENSION_GROUP_ENUM_ENTRY(name, label) name,
+#define DIMENSION_GROUP_LABEL_ENTRY(name, label) label,
+
+enum class DimensionGroupName
 {
-    "BASE_LENGTH",
-    "HEIGHT",
-    "BASE_PERIMETER",
-    "BASE_DIAGONAL",
-    "SLANT_LENGTH",
-    "LATERAL_EDGE_LENGTH",
-    "WEST_EAST_CROSS_SECTION_CORNER_ANGLE",
-    "WEST_EAST_CROSS_SECTION_VERTEX_ANGLE",
-    "LATERAL_FACE_CORNER_ANGLE",
-    "LATERAL_FACE_VERTEX_ANGLE",
-    "SOUTHWEST_NORTHEAST_CROSS_SECTION_CORNER_ANGLE",
-    "SOUTHWEST_NORTHEAST_CROSS_SECTION_VERTEX_ANGLE",
-    "BASE_AREA",
-    "LATERAL_FACE_AREA",
-    "SURFACE_AREA_NOT_INCLUDING_BASE",
-    "SURFACE_AREA_INCLUDING_BASE",
-    "VOLUME"
+    DIMENSION_GROUP_NAMES(DIMENSION_GROUP_ENUM_ENTRY)
 };
 
-static const std::vector<double> allowedFactors =
+constexpr const char* DimensionGroupLabels[] = { DIMENSION_GROUP_NAMES(DIMENSION_GROUP_LABEL_ENTRY) };
+
+constexpr DimensionGroupName PYRAMID_DIMENSION_GROUPS[] = { PYRAMID_DIMENSIONS(PYRAMID_DIMENSION_GROUP_ENTRY) };
+
+static const char* PyramidDimensionStrings[] = { PYRAMID_DIMENSIONS(PYRAMID_DIMENSION_NAME_ENTRY) };
+constexpr const char* PyramidDimensionLabels[] = { PYRAMID_DIMENSIONS(PYRAMID_DIMENSION_LABEL_ENTRY) };
+
+// A half-open range [begin, end) of PyramidDimension indices whose values share a unit and
+// may be divided by one another.
+struct DimensionGroup
+{
+    int begin;
+    int end;
+};
+
+// The range of the dimensions in name, given the group of each of count dimensions.
+constexpr DimensionGroup FindDimensionGroup(const DimensionGroupName* groups, int count, DimensionGroupName name)
+{
+    DimensionGroup group = { 0, 0 };
+    for (int i = count - 1; i >= 0; --i)
+    {
+        if (groups[i] == name)
+        {
+            group.begin = i;
+            group.end = group.end == 0 ? i + 1 : group.end;
+        }
+    }
+    return group;
+}
+
+constexpr DimensionGroup FindDimensionGroup(DimensionGroupName name)
+{
+    return FindDimensionGroup(PYRAMID_DIMENSION_GROUPS, PYRAMID_DIMENSION_COUNT, name);
+}
+
+constexpr bool AreDimensionGroupsContiguous(const DimensionGroupName* groups, int count)
+{
+    for (int g = 0; g < (int) DimensionGroupName::UNGROUPED; ++g)
+    {
+        DimensionGroup group = FindDimensionGroup(groups, count, (DimensionGroupName) g);
+        for (int i = group.begin; i < group.end; ++i)
+        {
+            if (groups[i] != (DimensionGroupName) g)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static_assert(AreDimensionGroupsContiguous(PYRAMID_DIMENSION_GROUPS, PYRAMID_DIMENSION_COUNT), "the dimensions of a group must be listed next to each other");
+
+// The groups GetClosest searches, in the order it searches them; DIMENSION_GROUPS[g] is
+// DimensionGroupName g.
+constexpr std::array<DimensionGroup, 5> DIMENSION_GROUPS =
+{
+    FindDimensionGroup(DimensionGroupName::LENGTHS),
+    FindDimensionGroup(DimensionGroupName::ANGLES1),
+    FindDimensionGroup(DimensionGroupName::ANGLES2),
+    FindDimensionGroup(DimensionGroupName::ANGLES3),
+    FindDimensionGroup(DimensionGroupName::AREAS)
+};
+
+// Kept in ascending order; CandidateIndex relies on it.
+static constexpr std::array<double, 9> allowedFactors =
 {
     0.1,
     0.125,
@@ -78,70 +158,34 @@ public:
     }
 };
 
+// A square right pyramid. All dimensions live in one array indexed by PyramidDimension, so
+// building one allocates nothing and copies are plain memberwise copies.
 class Pyramid
 {
 public:
     Pyramid(int baseLength, int height);
-    GetClosestResult GetClosest(double target);
-    void Print();
+    explicit Pyramid(const std::array<double, PYRAMID_DIMENSION_COUNT>& dimensions);
+    // The pyramid with base length 1 and any real height. Its ratios within a group are those
+    // of every pyramid with the same height to base ratio.
+    static Pyramid FromHeightToBaseRatio(double heightToBaseRatio);
+    GetClosestResult GetClosest(double target) const;
+    GetClosestResult GetCandidateResult(int candidate) const;
+    void Print() const;
     double GetBasePerimeter() const;
     double GetHeight() const;
     double GetVolume() const;
+    double GetDimension(PyramidDimension dimension) const;
+    const std::array<double, PYRAMID_DIMENSION_COUNT>& GetDimensions() const;
 
 private:
-    std::pair<PyramidDimension, double> baseLength;
-    std::pair<PyramidDimension, double> height;
-    std::pair<PyramidDimension, double> basePerimeter;
-    std::pair<PyramidDimension, double> baseDiagonal;
-    std::pair<PyramidDimension, double> slantLength;
-    std::pair<PyramidDimension, double> lateralEdgeLength;
-
-    std::pair<PyramidDimension, double> westEastCrossSectionCornerAngle;
-    std::pair<PyramidDimension, double> westEastCrossSectionVertexAngle;
-    std::pair<PyramidDimension, double> lateralFaceCornerAngle;
-    std::pair<PyramidDimension, double> lateralFaceVertexAngle;
-    std::pair<PyramidDimension, double> southwestNortheastCrossSectionCornerAngle;
-    std::pair<PyramidDimension, double> southwestNortheastCrossSectionVertexAngle;
-
-    std::pair<PyramidDimension, double> baseArea;
-    std::pair<PyramidDimension, double> lateralFaceArea;
-    std::pair<PyramidDimension, double> surfaceAreaNotIncludingBase;
-    std::pair<PyramidDimension, double> surfaceAreaIncludingBase;
-
-    std::pair<PyramidDimension, double> volume;
-
-    std::vector<std::pair<PyramidDimension, double>*> lengths;
-    std::vector<std::pair<PyramidDimension, double>*> angles1;
-    std::vector<std::pair<PyramidDimension, double>*> angles2;
-    std::vector<std::pair<PyramidDimension, double>*> angles3;
-    std::vector<std::pair<PyramidDimension, double>*> areas;
-
-    GetClosestResult GetClosest_Helper(const std::vector<std::pair<PyramidDimension, double>*>& dimensions, double target);
-
-    double CalculateAbsoluteError(double actual, double expected);
-
-    void InitializeLengths();
-    void InitializeAngles();
-    void InitializeAreas();
-
-    double CalculateBasePerimeter();
-    double CalculateBaseDiagonal();
-    double CalculateSlantLength();
-    double CalculateLateralEdgeLength();
- 
-    double CalculateWestEastCrossSectionCornerAngle();
-    double CalculateWestEastCrossSectionVertexAngle();
-    double CalculateLateralFaceCornerAngle();
-    double CalculateLateralFaceVertexAngle();
-    double CalculateSouthwestNortheastCrossSectionCornerAngle();
-    double CalculateSouthwestNortheastCrossSectionVertexAngle();
-
-    double CalculateBaseArea();
-    double CalculateLateralFaceArea();
-    double CalculateSurfaceAreaNotIncludingBase();
-    double CalculateSurfaceAreaIncludingBase();
-
-    double CalculateVolume();
+    std::array<double, PYRAMID_DIMENSION_COUNT> dimensions;
+
+    Pyramid() = default;
+    void Calculate(double baseLength, double height);
+    double& At(PyramidDimension dimension);
+    double At(PyramidDimension dimension) const;
 };
 
+static_assert(std::is_trivially_copyable<Pyramid>::value, "Pyramid must stay a plain value type");
+
 #endif
\ No newline at end of file
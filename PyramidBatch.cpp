@@ -0,0 +1,381 @@
+#include "PyramidBatch.h"
+#include "ClosestKernel.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PYRAMID_BATCH_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+// Atan's Horner steps are fused multiply-adds, so the AVX2 path needs FMA as well.
+#define TARGET_AVX2_FMA __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+// Keeps the compiler from fusing a multiply into the following add, which the scalar
+// formulas do not do.
+#define PREVENT_CONTRACTION(x) __asm__("" : "+v"(x))
+#else
+#define TARGET_AVX2_FMA
+#define TARGET_AVX512
+#define PREVENT_CONTRACTION(x)
+#endif
+
+namespace
+{
+
+// Cephes atan: arguments above tan(3 pi / 8) use pi / 2 - atan(1 / x), arguments above 0.66
+// use pi / 4 + atan((x - 1) / (x + 1)), and the rest a 4/5 rational approximation in x^2.
+constexpr double TAN_3PI_8 = 2.41421356237309504880;
+constexpr double REDUCTION_THRESHOLD = 0.66;
+constexpr double PI_2 = 1.57079632679489661923;
+constexpr double PI_4 = 7.85398163397448309616E-1;
+// The part of pi / 2 that PI_2 rounds off.
+constexpr double MORE_BITS = 6.123233995736765886130E-17;
+
+constexpr double P[] = { -8.750608600031904122785E-1, -1.615753718733365076637E1, -7.500855792314704667340E1, -1.228866684490136173410E2, -6.485021904942025371773E1 };
+constexpr double Q[] = { 2.485846490142306297962E1, 1.650270098316988542046E2, 4.328810604912902668951E2, 4.853903996359136964868E2, 1.945506571482613964425E2 };
+
+#ifdef PYRAMID_BATCH_X86
+
+#if defined(_MSC_VER) && !defined(__clang__)
+bool CpuSupportsFma()
+{
+    int registers[4];
+    __cpuid(registers, 1);
+    return (registers[2] & (1 << 12)) != 0;
+}
+#else
+bool CpuSupportsFma()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("fma");
+}
+#endif
+
+bool IsFmaSupported()
+{
+    static const bool supported = CpuSupportsFma();
+    return supported;
+}
+
+TARGET_AVX2_FMA __m256d Atan_Avx2(__m256d x)
+{
+    const __m256d signMask = _mm256_set1_pd(-0.0);
+    __m256d t = _mm256_andnot_pd(signMask, x);
+    __m256d large = _mm256_cmp_pd(t, _mm256_set1_pd(TAN_3PI_8), _CMP_GT_OQ);
+    __m256d middle = _mm256_andnot_pd(large, _mm256_cmp_pd(t, _mm256_set1_pd(REDUCTION_THRESHOLD), _CMP_GT_OQ));
+
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d z = _mm256_blendv_pd(t, _mm256_div_pd(_mm256_sub_pd(t, one), _mm256_add_pd(t, one)), middle);
+    z = _mm256_blendv_pd(z, _mm256_div_pd(_mm256_set1_pd(-1.0), t), large);
+    __m256d base = _mm256_blendv_pd(_mm256_and_pd(middle, _mm256_set1_pd(PI_4)), _mm256_set1_pd(PI_2), large);
+    __m256d moreBits = _mm256_blendv_pd(_mm256_and_pd(middle, _mm256_set1_pd(0.5 * MORE_BITS)), _mm256_set1_pd(MORE_BITS), large);
+
+    __m256d zz = _mm256_mul_pd(z, z);
+    __m256d p = _mm256_set1_pd(P[0]);
+    for (int i = 1; i < 5; ++i)
+    {
+        p = _mm256_fmadd_pd(p, zz, _mm256_set1_pd(P[i]));
+    }
+    __m256d q = _mm256_add_pd(zz, _mm256_set1_pd(Q[0]));
+    for (int i = 1; i < 5; ++i)
+    {
+        q = _mm256_fmadd_pd(q, zz, _mm256_set1_pd(Q[i]));
+    }
+
+    __m256d reduced = _mm256_fmadd_pd(z, _mm256_div_pd(_mm256_mul_pd(zz, p), q), z);
+    __m256d result = _mm256_add_pd(base, _mm256_add_pd(reduced, moreBits));
+
+    // Atan is odd.
+    return _mm256_or_pd(result, _mm256_and_pd(x, signMask));
+}
+
+// Four pyramids' values of one dimension, with the operators the dimension formulas use.
+struct Avx2Lanes
+{
+    __m256d value;
+};
+
+TARGET_AVX2_FMA inline Avx2Lanes operator+(Avx2Lanes a, Avx2Lanes b)
+{
+    return { _mm256_add_pd(a.value, b.value) };
+}
+
+TARGET_AVX2_FMA inline Avx2Lanes operator*(Avx2Lanes a, Avx2Lanes b)
+{
+    __m256d product = _mm256_mul_pd(a.value, b.value);
+    PREVENT_CONTRACTION(product);
+    return { product };
+}
+
+TARGET_AVX2_FMA inline Avx2Lanes operator*(double a, Avx2Lanes b)
+{
+    return Avx2Lanes{ _mm256_set1_pd(a) } * b;
+}
+
+TARGET_AVX2_FMA inline Avx2Lanes operator*(Avx2Lanes a, double b)
+{
+    return a * Avx2Lanes{ _mm256_set1_pd(b) };
+}
+
+TARGET_AVX2_FMA inline Avx2Lanes operator/(Avx2Lanes a, Avx2Lanes b)
+{
+    return { _mm256_div_pd(a.value, b.value) };
+}
+
+TARGET_AVX2_FMA inline Avx2Lanes operator/(double a, Avx2Lanes b)
+{
+    return Avx2Lanes{ _mm256_set1_pd(a) } / b;
+}
+
+TARGET_AVX2_FMA inline Avx2Lanes operator/(Avx2Lanes a, double b)
+{
+    return a / Avx2Lanes{ _mm256_set1_pd(b) };
+}
+
+TARGET_AVX2_FMA inline Avx2Lanes Sqrt(Avx2Lanes x)
+{
+    return { _mm256_sqrt_pd(x.value) };
+}
+
+TARGET_AVX2_FMA inline Avx2Lanes Square(Avx2Lanes x)
+{
+    return x * x;
+}
+
+TARGET_AVX2_FMA inline Avx2Lanes Atan(Avx2Lanes x)
+{
+    return { Atan_Avx2(x.value) };
+}
+
+TARGET_AVX2_FMA void Calculate_Avx2(const int* baseLengths, const int* heights, size_t count, double* const* columns)
+{
+    for (size_t i = 0; i < count; i += 4)
+    {
+        Avx2Lanes baseLength = { _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*) (baseLengths + i))) };
+        Avx2Lanes height = { _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*) (heights + i))) };
+
+        Avx2Lanes dimensions[PYRAMID_DIMENSION_COUNT];
+#define DIMENSION(name) dimensions[(int) PyramidDimension::name]
+#define CALCULATE_DIMENSION(name, label, group, formula) DIMENSION(name) = formula;
+        PYRAMID_DIMENSIONS(CALCULATE_DIMENSION)
+#undef CALCULATE_DIMENSION
+#undef DIMENSION
+
+        for (int dimension = 0; dimension < PYRAMID_DIMENSION_COUNT; ++dimension)
+        {
+            _mm256_storeu_pd(columns[dimension] + i, dimensions[dimension].value);
+        }
+    }
+}
+
+TARGET_AVX512 __m512d Atan_Avx512(__m512d x)
+{
+    __m512d t = _mm512_abs_pd(x);
+    __mmask8 large = _mm512_cmp_pd_mask(t, _mm512_set1_pd(TAN_3PI_8), _CMP_GT_OQ);
+    __mmask8 middle = _mm512_cmp_pd_mask(t, _mm512_set1_pd(REDUCTION_THRESHOLD), _CMP_GT_OQ) & ~large;
+
+    const __m512d one = _mm512_set1_pd(1.0);
+    __m512d z = _mm512_mask_blend_pd(middle, t, _mm512_div_pd(_mm512_sub_pd(t, one), _mm512_add_pd(t, one)));
+    z = _mm512_mask_blend_pd(large, z, _mm512_div_pd(_mm512_set1_pd(-1.0), t));
+    __m512d base = _mm512_mask_blend_pd(large, _mm512_maskz_mov_pd(middle, _mm512_set1_pd(PI_4)), _mm512_set1_pd(PI_2));
+    __m512d moreBits = _mm512_mask_blend_pd(large, _mm512_maskz_mov_pd(middle, _mm512_set1_pd(0.5 * MORE_BITS)), _mm512_set1_pd(MORE_BITS));
+
+    __m512d zz = _mm512_mul_pd(z, z);
+    __m512d p = _mm512_set1_pd(P[0]);
+    for (int i = 1; i < 5; ++i)
+    {
+        p = _mm512_fmadd_pd(p, zz, _mm512_set1_pd(P[i]));
+    }
+    __m512d q = _mm512_add_pd(zz, _mm512_set1_pd(Q[0]));
+    for (int i = 1; i < 5; ++i)
+    {
+        q = _mm512_fmadd_pd(q, zz, _mm512_set1_pd(Q[i]));
+    }
+
+    __m512d reduced = _mm512_fmadd_pd(z, _mm512_div_pd(_mm512_mul_pd(zz, p), q), z);
+    __m512d result = _mm512_add_pd(base, _mm512_add_pd(reduced, moreBits));
+
+    // Atan is odd.
+    const __m512i signMask = _mm512_set1_epi64((long long) 0x8000000000000000ull);
+    __m512i sign = _mm512_and_si512(_mm512_castpd_si512(x), signMask);
+    return _mm512_castsi512_pd(_mm512_or_si512(_mm512_castpd_si512(result), sign));
+}
+
+// Eight pyramids' values of one dimension, with the operators the dimension formulas use.
+struct Avx512Lanes
+{
+    __m512d value;
+};
+
+TARGET_AVX512 inline Avx512Lanes operator+(Avx512Lanes a, Avx512Lanes b)
+{
+    return { _mm512_add_pd(a.value, b.value) };
+}
+
+TARGET_AVX512 inline Avx512Lanes operator*(Avx512Lanes a, Avx512Lanes b)
+{
+    __m512d product = _mm512_mul_pd(a.value, b.value);
+    PREVENT_CONTRACTION(product);
+    return { product };
+}
+
+TARGET_AVX512 inline Avx512Lanes operator*(double a, Avx512Lanes b)
+{
+    return Avx512Lanes{ _mm512_set1_pd(a) } * b;
+}
+
+TARGET_AVX512 inline Avx512Lanes operator*(Avx512Lanes a, double b)
+{
+    return a * Avx512Lanes{ _mm512_set1_pd(b) };
+}
+
+TARGET_AVX512 inline Avx512Lanes operator/(Avx512Lanes a, Avx512Lanes b)
+{
+    return { _mm512_div_pd(a.value, b.value) };
+}
+
+TARGET_AVX512 inline Avx512Lanes operator/(double a, Avx512Lanes b)
+{
+    return Avx512Lanes{ _mm512_set1_pd(a) } / b;
+}
+
+TARGET_AVX512 inline Avx512Lanes operator/(Avx512Lanes a, double b)
+{
+    return a / Avx512Lanes{ _mm512_set1_pd(b) };
+}
+
+TARGET_AVX512 inline Avx512Lanes Sqrt(Avx512Lanes x)
+{
+    // The masked forms keep GCC 12 from reporting its self-initialized _mm512_undefined_pd()
+    // source as maybe uninitialized; with every lane set they are the plain instructions.
+    return { _mm512_mask_sqrt_pd(x.value, (__mmask8) 0xFF, x.value) };
+}
+
+TARGET_AVX512 inline Avx512Lanes Square(Avx512Lanes x)
+{
+    return x * x;
+}
+
+TARGET_AVX512 inline Avx512Lanes Atan(Avx512Lanes x)
+{
+    return { Atan_Avx512(x.value) };
+}
+
+TARGET_AVX512 void Calculate_Avx512(const int* baseLengths, const int* heights, size_t count, double* const* columns)
+{
+    for (size_t i = 0; i < count; i += 8)
+    {
+        Avx512Lanes baseLength = { _mm512_mask_cvtepi32_pd(_mm512_setzero_pd(), (__mmask8) 0xFF, _mm256_loadu_si256((const __m256i*) (baseLengths + i))) };
+        Avx512Lanes height = { _mm512_mask_cvtepi32_pd(_mm512_setzero_pd(), (__mmask8) 0xFF, _mm256_loadu_si256((const __m256i*) (heights + i))) };
+
+        Avx512Lanes dimensions[PYRAMID_DIMENSION_COUNT];
+#define DIMENSION(name) dimensions[(int) PyramidDimension::name]
+#define CALCULATE_DIMENSION(name, label, group, formula) DIMENSION(name) = formula;
+        PYRAMID_DIMENSIONS(CALCULATE_DIMENSION)
+#undef CALCULATE_DIMENSION
+#undef DIMENSION
+
+        for (int dimension = 0; dimension < PYRAMID_DIMENSION_COUNT; ++dimension)
+        {
+            _mm512_storeu_pd(columns[dimension] + i, dimensions[dimension].value);
+        }
+    }
+}
+
+#endif
+
+}
+
+double PyramidBatch::Atan(double x)
+{
+    double t = std::abs(x);
+    double base = 0.0;
+    double moreBits = 0.0;
+    double z = t;
+    if (t > TAN_3PI_8)
+    {
+        base = PI_2;
+        moreBits = MORE_BITS;
+        z = -1.0 / t;
+    }
+    else if (t > REDUCTION_THRESHOLD)
+    {
+        base = PI_4;
+        moreBits = 0.5 * MORE_BITS;
+        z = (t - 1.0) / (t + 1.0);
+    }
+
+    double zz = z * z;
+    double p = P[0];
+    for (int i = 1; i < 5; ++i)
+    {
+        p = std::fma(p, zz, P[i]);
+    }
+    double q = zz + Q[0];
+    for (int i = 1; i < 5; ++i)
+    {
+        q = std::fma(q, zz, Q[i]);
+    }
+
+    double result = base + (std::fma(z, zz * p / q, z) + moreBits);
+    return std::copysign(result, x);
+}
+
+void PyramidBatch::Calculate(const int* baseLengths, const int* heights, size_t count)
+{
+    size = count;
+    double* columnData[PYRAMID_DIMENSION_COUNT];
+    for (int dimension = 0; dimension < PYRAMID_DIMENSION_COUNT; ++dimension)
+    {
+        columns[dimension].resize(count);
+        columnData[dimension] = columns[dimension].data();
+    }
+
+    size_t vectorCount = 0;
+#ifdef PYRAMID_BATCH_X86
+    if (ClosestKernel::IsKernelSupported(ClosestKernelType::AVX512))
+    {
+        vectorCount = count / 8 * 8;
+        Calculate_Avx512(baseLengths, heights, vectorCount, columnData);
+    }
+    else if (ClosestKernel::IsKernelSupported(ClosestKernelType::AVX2) && IsFmaSupported())
+    {
+        vectorCount = count / 4 * 4;
+        Calculate_Avx2(baseLengths, heights, vectorCount, columnData);
+    }
+#endif
+
+    for (size_t i = vectorCount; i < count; ++i)
+    {
+        Pyramid pyramid(baseLengths[i], heights[i]);
+        for (int dimension = 0; dimension < PYRAMID_DIMENSION_COUNT; ++dimension)
+        {
+            columnData[dimension][i] = pyramid.GetDimensions()[dimension];
+        }
+    }
+}
+
+size_t PyramidBatch::GetSize() const
+{
+    return size;
+}
+
+const double* PyramidBatch::GetColumn(PyramidDimension dimension) const
+{
+    return columns[(int) dimension].data();
+}
+
+Pyramid PyramidBatch::GetPyramid(size_t index) const
+{
+    std::array<double, PYRAMID_DIMENSION_COUNT> dimensions;
+    for (int dimension = 0; dimension < PYRAMID_DIMENSION_COUNT; ++dimension)
+    {
+        dimensions[dimension] = columns[dimension][index];
+    }
+    return Pyramid(dimensions);
+}
\ No newline at end of file
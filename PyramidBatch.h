@@ -0,0 +1,32 @@
+#ifndef PYRAMID_BATCH_H_
+#define PYRAMID_BATCH_H_
+
+#include "Pyramid.h"
+
+#include <cstddef>
+#include <vector>
+
+// The dimensions of a block of pyramids as one column per PyramidDimension, computed eight
+// pyramids to an AVX-512 vector, or four to an AVX2 one, where the CPU has it. Every formula
+// is evaluated in the same order and with the same Atan as Pyramid's constructor, so a column
+// entry is bit-identical to the dimension of Pyramid(baseLength, height) on any CPU.
+class PyramidBatch
+{
+public:
+    void Calculate(const int* baseLengths, const int* heights, size_t count);
+
+    size_t GetSize() const;
+    const double* GetColumn(PyramidDimension dimension) const;
+    Pyramid GetPyramid(size_t index) const;
+
+    // Arctangent of any double, faithfully rounded (under 1 ulp; Cephes' reduction and
+    // rational approximation, with the Horner steps fused). Scalar and vector lanes round
+    // identically.
+    static double Atan(double x);
+
+private:
+    size_t size = 0;
+    std::vector<double> columns[PYRAMID_DIMENSION_COUNT];
+};
+
+#endif
\ No newline at end of file
@@ -1,11 +1,27 @@
 #include "Pyramid.h"
+#include "CandidateIndexFile.h"
+#include "ClosestKernel.h"
 #include "Constants.h"
+#include "ErrorRaster.h"
 #include "MathUtilities.h"
+#include "Metrics.h"
+#include "NullModel.h"
+#include "QuantileSketch.h"
+#include "QueryServer.h"
+#include "RatioSolver.h"
+#include "RecordStream.h"
+#include "Sweep.h"
+#include "TargetCatalog.h"
+#include "WorkStealingScheduler.h"
 
 #include <iostream>
 #include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <limits>
-#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
 
 constexpr int MIN_BASE_LENGTH = 1;
 constexpr int MAX_BASE_LENGTH = 1000;
@@ -19,137 +35,806 @@ constexpr double EQUATORIAL_CIRCUMFERENCE = 40075.017;
 constexpr double POLAR_RADIUS = 6356.752;
 constexpr int KHUFU_HEIGHT = 280;
 constexpr int KHUFU_BASE_LENGTH = 440;
-// constexpr double FINE_STRUCTURE_CONSTANT = 1.37035999206;
+constexpr double DEFAULT_HIT_TOLERANCE = 1.0E-4;
+const double REPORTED_QUANTILES[] = { 0.01, 0.05, 0.25, 0.5, 0.75, 0.95, 0.99 };
 
-double CalculateRelativeError(double actual, double expected)
+using MathUtilities::CalculateRelativeError;
+
+struct CommandLineOptions
+{
+    int threadCount = WorkStealingScheduler::GetDefaultThreadCount();
+    std::string targetCatalogPath;
+    std::vector<std::string> combinedTargets;
+    double hitTolerance = DEFAULT_HIT_TOLERANCE;
+    size_t leaderboardSize = 0;
+    std::string recordPath;
+    std::string readRecordPath;
+    std::string rasterPath;
+    std::string checkpointPath;
+    double checkpointInterval = 60.0;
+    bool resume = false;
+    int shardIndex = 0;
+    int shardCount = 1;
+    std::string partialPath;
+    std::vector<std::string> mergedPartialPaths;
+    SolidShape shape = SolidShape::SQUARE_PYRAMID;
+    double frustumTopFraction = 0.5;
+    int maxBaseLength = MAX_BASE_LENGTH;
+    int maxHeight = MAX_HEIGHT;
+    double minVolume = MIN_VOLUME;
+    double maxVolume = MAX_VOLUME;
+    bool solve = false;
+    std::string metricsPath;
+    bool prometheusMetrics = false;
+    std::string tracePath;
+    bool runNullModel = false;
+    NullModelOptions nullModel;
+    std::string buildIndexPath;
+    std::string indexPath;
+    bool serve = false;
+    std::string socketPath;
+};
+
+std::vector<std::string> SplitList(const std::string& list)
 {
-    return abs(actual - expected) / expected;
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        if (!item.empty())
+        {
+            items.push_back(item);
+        }
+    }
+    return items;
 }
 
-int main()
+void PrintQuantiles(const QuantileSketch& sketch)
 {
-    double pi = const_pi();
-    double phi = const_phi();
-    double e = const_e();
-    
-    double equatorialCircumferenceToPolarRadius = EQUATORIAL_CIRCUMFERENCE / POLAR_RADIUS;
+    for (double quantile : REPORTED_QUANTILES)
+    {
+        std::cout << (quantile == REPORTED_QUANTILES[0] ? "" : ", ") << "p" << quantile * 100.0 << " " << sketch.GetQuantile(quantile);
+    }
+    std::cout << '\n';
+}
 
-    std::set<std::pair<int, int>> processedHeightToBaseLengthRatios;
+// Usage: PyramidExperiments [--threads N] [--kernel scalar|avx2|avx512|pruned|screened]
+//                           [--targets catalog.txt] [--combine pi,phi,e] [--hit-tolerance X]
+//                           [--top K] [--records out.bin]
+//                           [--checkpoint sweep.ckpt [--checkpoint-interval seconds] [--resume]]
+//                           [--shard i/N --partial shard.part | --merge a.part,b.part,...]
+//                           [--shape square|triangular|hexagonal|cone|frustum [--frustum-top F]]
+//                           [--max-base-length N] [--max-height N] [--min-volume V] [--max-volume V] [--solve]
+//                           [--index sweep.index]
+//                           [--metrics out.json [--metrics-format json|prometheus]] [--trace out.trace.json]
+//                           [--null-model dimensions|targets|factors [--draws N] [--seed S]
+//                            [--null-distribution uniform|log-uniform] [--null-range low,high]]
+//        PyramidExperiments --read-records out.bin
+//        PyramidExperiments [--threads N] [--targets catalog.txt] [--combine pi,phi,e] --raster out.raster
+//        PyramidExperiments [--threads N] [--max-base-length N] [--max-height N] --build-index sweep.index
+//        PyramidExperiments [--targets catalog.txt] [--max-base-length N] [--max-height N] [--min-volume V] [--max-volume V]
+//                           --index sweep.index --serve [--socket path]
+bool ParseArguments(int argc, char* argv[], CommandLineOptions& commandLine)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        if (argument == "--threads" && i + 1 < argc)
+        {
+            commandLine.threadCount = std::atoi(argv[++i]);
+            if (commandLine.threadCount <= 0)
+            {
+                std::cerr << "--threads expects a positive thread count\n";
+                return false;
+            }
+        }
+        else if (argument == "--kernel" && i + 1 < argc)
+        {
+            std::string kernelName = argv[++i];
+            bool kernelSet = false;
+            for (int kernel = 0; kernel < (int) (sizeof(ClosestKernelTypeStrings) / sizeof(ClosestKernelTypeStrings[0])); ++kernel)
+            {
+                if (kernelName == ClosestKernelTypeStrings[kernel])
+                {
+                    kernelSet = ClosestKernel::SetKernel((ClosestKernelType) kernel);
+                }
+            }
 
-    Pyramid khufu(KHUFU_BASE_LENGTH, KHUFU_HEIGHT);
-    std::pair<int, int> khufuHeightToBaseRatio = MathUtilities::ReduceFraction(KHUFU_HEIGHT, KHUFU_BASE_LENGTH);
-    processedHeightToBaseLengthRatios.insert(khufuHeightToBaseRatio);
-    khufu.Print();
-    std::cout << '\n';
-    GetClosestResult khufuClosestPi = khufu.GetClosest(pi);
-    GetClosestResult khufuClosestPhi = khufu.GetClosest(phi);
-    GetClosestResult khufuClosestE = khufu.GetClosest(e);
-    // GetClosestResult khufuClosestFSC = khufu.GetClosest(FINE_STRUCTURE_CONSTANT);
+            if (!kernelSet)
+            {
+                std::cerr << "--kernel " << kernelName << " is unknown or not supported by this CPU\n";
+                return false;
+            }
+        }
+        else if (argument == "--shape" && i + 1 < argc)
+        {
+            std::string shapeName = argv[++i];
+            bool shapeSet = false;
+            for (int shape = 0; shape < (int) (sizeof(SolidShapeStrings) / sizeof(SolidShapeStrings[0])); ++shape)
+            {
+                if (shapeName == SolidShapeStrings[shape])
+                {
+                    commandLine.shape = (SolidShape) shape;
+                    shapeSet = true;
+                }
+            }
 
-    khufuClosestPi.relativeError = CalculateRelativeError(khufuClosestPi.value, pi);
-    khufuClosestPhi.relativeError = CalculateRelativeError(khufuClosestPhi.value, phi);
-    khufuClosestE.relativeError = CalculateRelativeError(khufuClosestE.value, e);
-    // khufuClosestFSC.relativeError = CalculateRelativeError(khufuClosestFSC.value, FINE_STRUCTURE_CONSTANT);
+            if (!shapeSet)
+            {
+                std::cerr << "--shape " << shapeName << " is unknown\n";
+                return false;
+            }
+        }
+        else if (argument == "--frustum-top" && i + 1 < argc)
+        {
+            commandLine.frustumTopFraction = std::atof(argv[++i]);
+            if (!(commandLine.frustumTopFraction > 0.0 && commandLine.frustumTopFraction < 1.0))
+            {
+                std::cerr << "--frustum-top expects the top side as a fraction of the base side, between 0 and 1\n";
+                return false;
+            }
+        }
+        else if ((argument == "--max-base-length" || argument == "--max-height") && i + 1 < argc)
+        {
+            int bound = std::atoi(argv[++i]);
+            if (bound < 1)
+            {
+                std::cerr << argument << " expects a positive length\n";
+                return false;
+            }
+            (argument == "--max-base-length" ? commandLine.maxBaseLength : commandLine.maxHeight) = bound;
+        }
+        else if (argument == "--min-volume" && i + 1 < argc)
+        {
+            commandLine.minVolume = std::atof(argv[++i]);
+        }
+        else if (argument == "--max-volume" && i + 1 < argc)
+        {
+            commandLine.maxVolume = std::atof(argv[++i]);
+        }
+        else if (argument == "--solve")
+        {
+            commandLine.solve = true;
+        }
+        else if (argument == "--null-model" && i + 1 < argc)
+        {
+            std::string hypothesisName = argv[++i];
+            commandLine.runNullModel = false;
+            for (int hypothesis = 0; hypothesis < (int) (sizeof(NullHypothesisStrings) / sizeof(NullHypothesisStrings[0])); ++hypothesis)
+            {
+                if (hypothesisName == NullHypothesisStrings[hypothesis])
+                {
+                    commandLine.nullModel.hypothesis = (NullHypothesis) hypothesis;
+                    commandLine.runNullModel = true;
+                }
+            }
 
-    khufuClosestPi.Print();
-    std::cout << '\n';
+            if (!commandLine.runNullModel)
+            {
+                std::cerr << "--null-model " << hypothesisName << " is unknown\n";
+                return false;
+            }
+        }
+        else if (argument == "--null-distribution" && i + 1 < argc)
+        {
+            std::string distributionName = argv[++i];
+            bool distributionSet = false;
+            for (int distribution = 0; distribution < (int) (sizeof(NullDistributionStrings) / sizeof(NullDistributionStrings[0])); ++distribution)
+            {
+                if (distributionName == NullDistributionStrings[distribution])
+                {
+                    commandLine.nullModel.distribution = (NullDistribution) distribution;
+                    distributionSet = true;
+                }
+            }
 
-    khufuClosestPhi.Print();
-    std::cout << '\n';
+            if (!distributionSet)
+            {
+                std::cerr << "--null-distribution " << distributionName << " is unknown\n";
+                return false;
+            }
+        }
+        else if (argument == "--null-range" && i + 1 < argc)
+        {
+            std::vector<std::string> range = SplitList(argv[++i]);
+            if (range.size() != 2)
+            {
+                std::cerr << "--null-range expects low,high\n";
+                return false;
+            }
+            commandLine.nullModel.low = std::atof(range[0].c_str());
+            commandLine.nullModel.high = std::atof(range[1].c_str());
+            if (!(commandLine.nullModel.low < commandLine.nullModel.high))
+            {
+                std::cerr << "--null-range expects low < high\n";
+                return false;
+            }
+            commandLine.nullModel.rangeSet = true;
+        }
+        else if (argument == "--draws" && i + 1 < argc)
+        {
+            long long drawCount = std::atoll(argv[++i]);
+            if (drawCount <= 0)
+            {
+                std::cerr << "--draws expects a positive draw count\n";
+                return false;
+            }
+            commandLine.nullModel.drawCount = (uint64_t) drawCount;
+        }
+        else if (argument == "--seed" && i + 1 < argc)
+        {
+            commandLine.nullModel.seed = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (argument == "--metrics" && i + 1 < argc)
+        {
+            commandLine.metricsPath = argv[++i];
+        }
+        else if (argument == "--metrics-format" && i + 1 < argc)
+        {
+            std::string format = argv[++i];
+            if (format != "json" && format != "prometheus")
+            {
+                std::cerr << "--metrics-format expects json or prometheus\n";
+                return false;
+            }
+            commandLine.prometheusMetrics = format == "prometheus";
+        }
+        else if (argument == "--trace" && i + 1 < argc)
+        {
+            commandLine.tracePath = argv[++i];
+        }
+        else if (argument == "--targets" && i + 1 < argc)
+        {
+            commandLine.targetCatalogPath = argv[++i];
+        }
+        else if (argument == "--combine" && i + 1 < argc)
+        {
+            commandLine.combinedTargets = SplitList(argv[++i]);
+        }
+        else if (argument == "--hit-tolerance" && i + 1 < argc)
+        {
+            commandLine.hitTolerance = std::atof(argv[++i]);
+        }
+        else if (argument == "--top" && i + 1 < argc)
+        {
+            int leaderboardSize = std::atoi(argv[++i]);
+            if (leaderboardSize < 0)
+            {
+                std::cerr << "--top expects a non-negative pyramid count\n";
+                return false;
+            }
+            commandLine.leaderboardSize = (size_t) leaderboardSize;
+        }
+        else if (argument == "--records" && i + 1 < argc)
+        {
+            commandLine.recordPath = argv[++i];
+        }
+        else if (argument == "--read-records" && i + 1 < argc)
+        {
+            commandLine.readRecordPath = argv[++i];
+        }
+        else if (argument == "--raster" && i + 1 < argc)
+        {
+            commandLine.rasterPath = argv[++i];
+        }
+        else if (argument == "--checkpoint" && i + 1 < argc)
+        {
+            commandLine.checkpointPath = argv[++i];
+        }
+        else if (argument == "--checkpoint-interval" && i + 1 < argc)
+        {
+            commandLine.checkpointInterval = std::atof(argv[++i]);
+        }
+        else if (argument == "--resume")
+        {
+            commandLine.resume = true;
+        }
+        else if (argument == "--shard" && i + 1 < argc)
+        {
+            std::string shard = argv[++i];
+            size_t slash = shard.find('/');
+            commandLine.shardIndex = std::atoi(shard.substr(0, slash).c_str());
+            commandLine.shardCount = slash == std::string::npos ? 0 : std::atoi(shard.substr(slash + 1).c_str());
+            if (commandLine.shardCount <= 0 || commandLine.shardIndex < 0 || commandLine.shardIndex >= commandLine.shardCount)
+            {
+                std::cerr << "--shard expects i/N with 0 <= i < N\n";
+                return false;
+            }
+        }
+        else if (argument == "--partial" && i + 1 < argc)
+        {
+            commandLine.partialPath = argv[++i];
+        }
+        else if (argument == "--merge" && i + 1 < argc)
+        {
+            commandLine.mergedPartialPaths = SplitList(argv[++i]);
+        }
+        else if (argument == "--build-index" && i + 1 < argc)
+        {
+            commandLine.buildIndexPath = argv[++i];
+        }
+        else if (argument == "--index" && i + 1 < argc)
+        {
+            commandLine.indexPath = argv[++i];
+        }
+        else if (argument == "--serve")
+        {
+            commandLine.serve = true;
+        }
+        else if (argument == "--socket" && i + 1 < argc)
+        {
+            commandLine.socketPath = argv[++i];
+        }
+        else
+        {
+            std::cerr << "unknown argument: " << argument << '\n';
+            return false;
+        }
+    }
+
+    if (commandLine.resume && commandLine.checkpointPath.empty())
+    {
+        std::cerr << "--resume needs --checkpoint\n";
+        return false;
+    }
+    if (commandLine.resume && !commandLine.recordPath.empty())
+    {
+        // The record file of the interrupted run cannot be told apart from a partial block.
+        std::cerr << "--records cannot be combined with --resume\n";
+        return false;
+    }
+    if (commandLine.shardCount > 1 && commandLine.partialPath.empty())
+    {
+        // A shard's own totals are not the sweep's, so they are only written for merging.
+        std::cerr << "--shard needs --partial\n";
+        return false;
+    }
+    if (!commandLine.mergedPartialPaths.empty() && (commandLine.shardCount > 1 || !commandLine.partialPath.empty() ||
+        !commandLine.recordPath.empty() || !commandLine.checkpointPath.empty()))
+    {
+        std::cerr << "--merge only takes the options that describe the sweep\n";
+        return false;
+    }
+
+    if (commandLine.shape != SolidShape::SQUARE_PYRAMID && (commandLine.leaderboardSize > 0 || !commandLine.recordPath.empty() || !commandLine.rasterPath.empty()))
+    {
+        // Leaderboard entries, records and rasters describe square pyramid dimensions.
+        std::cerr << "--top, --records and --raster are only for square pyramids\n";
+        return false;
+    }
+    if (commandLine.solve && (commandLine.shape != SolidShape::SQUARE_PYRAMID || commandLine.shardCount > 1 || !commandLine.partialPath.empty() ||
+        !commandLine.mergedPartialPaths.empty() || !commandLine.recordPath.empty() || !commandLine.checkpointPath.empty() || !commandLine.rasterPath.empty()))
+    {
+        std::cerr << "--solve only takes the options that describe a square pyramid sweep\n";
+        return false;
+    }
+    if (commandLine.runNullModel && (commandLine.solve || commandLine.shape != SolidShape::SQUARE_PYRAMID || commandLine.shardCount > 1 ||
+        !commandLine.partialPath.empty() || !commandLine.mergedPartialPaths.empty() || !commandLine.recordPath.empty() ||
+        !commandLine.checkpointPath.empty() || !commandLine.rasterPath.empty() || commandLine.leaderboardSize > 0))
+    {
+        std::cerr << "--null-model only takes the options that describe a square pyramid sweep\n";
+        return false;
+    }
+    if (!commandLine.indexPath.empty() && (commandLine.shape != SolidShape::SQUARE_PYRAMID || commandLine.solve || commandLine.runNullModel ||
+        !commandLine.mergedPartialPaths.empty() || !commandLine.buildIndexPath.empty()))
+    {
+        // The index holds square pyramid dimensions, and only the sweep searches them.
+        std::cerr << "--index is only for square pyramid sweeps\n";
+        return false;
+    }
+    if (!commandLine.buildIndexPath.empty() && commandLine.shape != SolidShape::SQUARE_PYRAMID)
+    {
+        std::cerr << "--build-index is only for square pyramids\n";
+        return false;
+    }
+    if (!commandLine.socketPath.empty() && !commandLine.serve)
+    {
+        std::cerr << "--socket needs --serve\n";
+        return false;
+    }
+    if (commandLine.serve && (commandLine.indexPath.empty() || commandLine.runNullModel || commandLine.shardCount > 1 || !commandLine.partialPath.empty() ||
+        !commandLine.recordPath.empty() || !commandLine.checkpointPath.empty() || !commandLine.rasterPath.empty() || commandLine.leaderboardSize > 0 ||
+        !commandLine.metricsPath.empty() || !commandLine.tracePath.empty()))
+    {
+        std::cerr << "--serve needs --index and only takes the options that describe the sweep\n";
+        return false;
+    }
+    if ((!commandLine.metricsPath.empty() || !commandLine.tracePath.empty()) && !Metrics::ENABLED)
+    {
+        std::cerr << "--metrics and --trace need a build with PYRAMID_METRICS enabled\n";
+        return false;
+    }
+    if ((!commandLine.metricsPath.empty() || !commandLine.tracePath.empty()) && (!commandLine.rasterPath.empty() || !commandLine.readRecordPath.empty()))
+    {
+        std::cerr << "--metrics and --trace describe a sweep or --solve\n";
+        return false;
+    }
+
+    return true;
+}
+
+// Summarizes a record file written by --records straight from the mapped columns.
+int ReadRecords(const std::string& path)
+{
+    RecordStreamReader reader;
+    std::string error;
+    if (!reader.Open(path, error))
+    {
+        std::cerr << error << '\n';
+        return 1;
+    }
+
+    std::cout << "records: " << reader.GetRecordCount() << " in " << reader.GetBlocks().size() << " blocks\n";
+
+    std::vector<double> minRelativeErrors(reader.GetTargets().size(), std::numeric_limits<double>::max());
+    std::vector<std::pair<int, int>> bestPyramids(reader.GetTargets().size());
+    for (const RecordBlockView& block : reader.GetBlocks())
+    {
+        for (size_t i = 0; i < reader.GetTargets().size(); ++i)
+        {
+            for (uint32_t record = 0; record < block.recordCount; ++record)
+            {
+                std::pair<int, int> pyramid(block.baseLength[record], block.height[record]);
+                if (block.relativeError[i][record] < minRelativeErrors[i] ||
+                    (block.relativeError[i][record] == minRelativeErrors[i] && pyramid < bestPyramids[i]))
+                {
+                    minRelativeErrors[i] = block.relativeError[i][record];
+                    bestPyramids[i] = pyramid;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < reader.GetTargets().size(); ++i)
+    {
+        std::cout << reader.GetTargets()[i].name << ": best base length " << bestPyramids[i].first << ", height " << bestPyramids[i].second
+            << ", relative error " << std::setprecision(15) << minRelativeErrors[i] << '\n';
+    }
+
+    return 0;
+}
+
+// Writes the metrics and the trace the command line asked for.
+bool WriteMetrics(const CommandLineOptions& commandLine)
+{
+    std::string error;
+    if (!commandLine.metricsPath.empty() &&
+        !(commandLine.prometheusMetrics ? Metrics::WritePrometheus(commandLine.metricsPath, error) : Metrics::WriteJson(commandLine.metricsPath, error)))
+    {
+        std::cerr << error << '\n';
+        return false;
+    }
+    if (!commandLine.tracePath.empty() && !Metrics::WriteChromeTrace(commandLine.tracePath, error))
+    {
+        std::cerr << error << '\n';
+        return false;
+    }
+    return true;
+}
+
+// The sweep the command line describes, short of the Great Pyramid's relative errors.
+SweepOptions CreateSweepOptions(const CommandLineOptions& commandLine, const TargetCatalog& targets)
+{
+    SweepOptions options;
+    options.minBaseLength = MIN_BASE_LENGTH;
+    options.maxBaseLength = commandLine.maxBaseLength;
+    options.minHeight = MIN_HEIGHT;
+    options.maxHeight = commandLine.maxHeight;
+    options.minVolume = commandLine.minVolume;
+    options.maxVolume = commandLine.maxVolume;
+    options.minHeightToBaseRatio = MIN_HEIGHT_TO_BASE_RATIO;
+    options.maxHeightToBaseRatio = MAX_HEIGHT_TO_BASE_RATIO;
+    // Only the square pyramid with Khufu's own ratio is Khufu.
+    options.excludedHeightToBaseRatio = commandLine.shape == SolidShape::SQUARE_PYRAMID ? MathUtilities::ReduceFraction(KHUFU_HEIGHT, KHUFU_BASE_LENGTH) : std::make_pair(0, 0);
+    options.shape = commandLine.shape;
+    options.frustumTopFraction = commandLine.frustumTopFraction;
+    options.targets = targets;
+    options.hitTolerance = commandLine.hitTolerance;
+    options.leaderboardSize = commandLine.leaderboardSize;
+    options.checkpointPath = commandLine.checkpointPath;
+    options.checkpointInterval = commandLine.checkpointInterval;
+    options.threadCount = commandLine.threadCount;
+    options.shardIndex = commandLine.shardIndex;
+    options.shardCount = commandLine.shardCount;
+    return options;
+}
+
+// Tests how often a null model does at least as well as the Great Pyramid.
+int RunNullModel(const SweepOptions& options, const NullModelOptions& nullOptions, const Pyramid& khufu)
+{
+    NullModel nullModel(options, nullOptions, khufu);
+    NullModelResult result;
+    std::string error;
+    if (!nullModel.Run(result, error))
+    {
+        std::cerr << error << '\n';
+        return 1;
+    }
+
+    std::cout << "null model: random " << NullHypothesisStrings[(int) nullOptions.hypothesis] << ", " << NullDistributionStrings[(int) nullOptions.distribution]
+        << " on [" << result.low << ", " << result.high << "], " << result.drawCount << " draws, seed " << nullOptions.seed << '\n';
+    std::cout << "observed relative error sum: " << result.observedRelativeErrorSum << '\n';
+    std::cout << "draws with a relative error sum at most the observed one: " << result.atLeastAsGoodCount << '\n';
+    std::cout << "p-value: " << result.pValue << " (95% confidence interval " << result.confidenceLow << " to " << result.confidenceHigh << ")\n";
+    return 0;
+}
+
+// Answers queries about the sweep from the index, on stdin or on a Unix domain socket.
+int Serve(const CommandLineOptions& commandLine, const SweepOptions& options)
+{
+    // Unsynchronized streams buffer stdin, which is how Serve sees that a batch has been read.
+    std::ios::sync_with_stdio(false);
+
+    CandidateIndexFile candidateIndex;
+    std::string error;
+    if (!candidateIndex.Open(commandLine.indexPath, error) || !candidateIndex.Covers(options, error))
+    {
+        std::cerr << error << '\n';
+        return 1;
+    }
+
+    QueryServer server(options, candidateIndex, Pyramid(KHUFU_BASE_LENGTH, KHUFU_HEIGHT));
+    std::cerr << "serving " << server.GetRatioCount() << " height to base ratios from " << commandLine.indexPath << '\n';
+    if (commandLine.socketPath.empty())
+    {
+        server.Serve(std::cin, std::cout);
+        return 0;
+    }
+
+    if (!server.ServeSocket(commandLine.socketPath, error))
+    {
+        std::cerr << error << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+// Lists the pyramids that beat Khufu from the ratio intervals where they can, without the sweep.
+int SolveBetterPyramids(const SweepOptions& options)
+{
+    RatioSolver solver(options);
+    RatioSolverResult result = solver.Solve(options.khufuRelativeErrorSum);
+
+    double candidateWidth = 0.0;
+    for (const RatioInterval& interval : result.candidateIntervals)
+    {
+        candidateWidth += interval.high - interval.low;
+    }
+
+    std::cout << "candidate height to base ratio intervals: " << result.candidateIntervals.size() << ", " << candidateWidth / (options.maxHeightToBaseRatio - options.minHeightToBaseRatio)
+        << " of the ratio window\n";
+    std::cout << "distinct height to base ratios evaluated: " << result.evaluatedRatioCount << '\n';
+    std::cout << "number of pyramids with a better combined relative error than the Great Pyramid: " << result.pyramidCount << " in " << result.ratios.size() << " height to base ratios\n";
+    for (const SolvedRatio& ratio : result.ratios)
+    {
+        std::cout << "    " << ratio.reducedHeight << ":" << ratio.reducedBaseLength << ", base length " << ratio.firstMultiple * ratio.reducedBaseLength;
+        if (ratio.lastMultiple > ratio.firstMultiple)
+        {
+            std::cout << " to " << ratio.lastMultiple * ratio.reducedBaseLength << " in steps of " << ratio.reducedBaseLength;
+        }
+        std::cout << ", relative error sum " << ratio.relativeErrorSum << '\n';
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    CommandLineOptions commandLine;
+    if (!ParseArguments(argc, argv, commandLine))
+    {
+        return 1;
+    }
+
+    if (!commandLine.readRecordPath.empty())
+    {
+        return ReadRecords(commandLine.readRecordPath);
+    }
+
+    Metrics::SetTracing(!commandLine.tracePath.empty());
+
+    TargetCatalog targets = TargetCatalog::CreateDefault();
+    std::string error;
+    if (!commandLine.targetCatalogPath.empty() && !targets.Load(commandLine.targetCatalogPath, error))
+    {
+        std::cerr << error << '\n';
+        return 1;
+    }
+    if (!commandLine.combinedTargets.empty() || !commandLine.targetCatalogPath.empty())
+    {
+        std::vector<std::string> combinedTargets = commandLine.combinedTargets.empty() ? std::vector<std::string>{ "pi", "phi", "e" } : commandLine.combinedTargets;
+        if (!targets.SetCombined(combinedTargets, error))
+        {
+            std::cerr << error << '\n';
+            return 1;
+        }
+    }
+
+    if (!commandLine.rasterPath.empty())
+    {
+        ErrorRasterOptions rasterOptions;
+        rasterOptions.minBaseLength = MIN_BASE_LENGTH;
+        rasterOptions.maxBaseLength = commandLine.maxBaseLength;
+        rasterOptions.minHeight = MIN_HEIGHT;
+        rasterOptions.maxHeight = commandLine.maxHeight;
+        rasterOptions.targets = targets;
+        rasterOptions.threadCount = commandLine.threadCount;
+
+        ErrorRasterWriter rasterWriter(rasterOptions);
+        if (!rasterWriter.Write(commandLine.rasterPath, error))
+        {
+            std::cerr << error << '\n';
+            return 1;
+        }
+
+        std::cout << "raster of " << commandLine.maxBaseLength - MIN_BASE_LENGTH + 1 << " x " << commandLine.maxHeight - MIN_HEIGHT + 1 << " pyramids in "
+            << rasterWriter.GetLevels().size() << " levels written to " << commandLine.rasterPath << '\n';
+        return 0;
+    }
 
-    khufuClosestE.Print();
+    if (!commandLine.buildIndexPath.empty())
+    {
+        // The index does not depend on the targets or the volume band, so any sweep inside
+        // these bounds can use it.
+        SweepOptions indexOptions = CreateSweepOptions(commandLine, targets);
+
+        CandidateIndexFile candidateIndex;
+        if (!CandidateIndexFile::Build(commandLine.buildIndexPath, indexOptions, error) || !candidateIndex.Open(commandLine.buildIndexPath, error))
+        {
+            std::cerr << error << '\n';
+            return 1;
+        }
+
+        std::cout << "candidate index of " << candidateIndex.GetRatioCount() << " height to base ratios (" << candidateIndex.GetSize() << " bytes) written to "
+            << commandLine.buildIndexPath << '\n';
+        return 0;
+    }
+
+    if (commandLine.serve)
+    {
+        return Serve(commandLine, CreateSweepOptions(commandLine, targets));
+    }
+
+    Pyramid khufu(KHUFU_BASE_LENGTH, KHUFU_HEIGHT);
+    khufu.Print();
     std::cout << '\n';
 
-   /* khufuClosestFSC.Print();
-    std::cout << '\n';*/
+    double khufuRelativeErrorSum = 0.0;
+    std::vector<double> khufuRelativeErrors;
+    for (const Target& target : targets.GetTargets())
+    {
+        GetClosestResult khufuClosest = khufu.GetClosest(target.value);
+        khufuClosest.relativeError = CalculateRelativeError(khufuClosest.value, target.value);
+        khufuRelativeErrors.push_back(khufuClosest.relativeError);
+
+        if (target.inCombinedSum)
+        {
+            khufuClosest.Print();
+            std::cout << '\n';
+            khufuRelativeErrorSum += khufuClosest.relativeError;
+        }
+    }
 
-    double khufuRelativeErrorSum = khufuClosestPi.relativeError + khufuClosestPhi.relativeError + khufuClosestE.relativeError;
-    
     std::cout << "Great Pyramid relative error sum: " << khufuRelativeErrorSum << '\n';
     std::cout << EQUATORIAL_CIRCUMFERENCE * 1000.0 / (khufu.GetBasePerimeter() * const_pi() / 6.0) << '\n';
     std::cout << POLAR_RADIUS * 1000.0 / (khufu.GetHeight() * const_pi() / 6.0) << '\n';
     std::cout << '\n';
 
-    int moreAccurateThanKhufuCount = 0;
-    int lessAccurateThanKhufuCount = 0;
-    int pyramidCount = 1;
+    SweepOptions options = CreateSweepOptions(commandLine, targets);
+    options.khufuRelativeErrorSum = khufuRelativeErrorSum;
+    options.khufuRelativeErrors = khufuRelativeErrors;
 
-    int winningBaseLength = 0;
-    int winningHeight = 0;
-    double minRelativeErrorSum = std::numeric_limits<double>::max();
-    double relativeErrorSumSum = khufuRelativeErrorSum;
-
-    for (int iBaseLength = MIN_BASE_LENGTH; iBaseLength <= MAX_BASE_LENGTH; ++iBaseLength)
+    CandidateIndexFile candidateIndex;
+    if (!commandLine.indexPath.empty())
     {
-        for (int jHeight = MIN_HEIGHT; jHeight <= MAX_HEIGHT; ++jHeight)
+        if (!candidateIndex.Open(commandLine.indexPath, error) || !candidateIndex.Covers(options, error))
         {
-            // Check if the ratio of the height to base length is the same as Khufu:
-            std::pair<int, int> reducedHeightToBaseRatio = MathUtilities::ReduceFraction(jHeight, iBaseLength);
-            if (reducedHeightToBaseRatio.first == khufuHeightToBaseRatio.first && reducedHeightToBaseRatio.second == khufuHeightToBaseRatio.second)
-            {
-                continue;
-            }
+            std::cerr << error << '\n';
+            return 1;
+        }
+        options.candidateIndex = &candidateIndex;
+    }
 
-            // Check if the height to base ratio is acceptable
-            double heightToBaseRatio = (double) jHeight / (double) iBaseLength;
-            if (heightToBaseRatio < MIN_HEIGHT_TO_BASE_RATIO || heightToBaseRatio > MAX_HEIGHT_TO_BASE_RATIO)
-            {
-                continue;
-            }
+    if (commandLine.solve)
+    {
+        int result = SolveBetterPyramids(options);
+        return WriteMetrics(commandLine) ? result : 1;
+    }
+    if (commandLine.runNullModel)
+    {
+        int result = RunNullModel(options, commandLine.nullModel, khufu);
+        return WriteMetrics(commandLine) ? result : 1;
+    }
 
-            // Check if the volume is acceptable
-            double volume = (double) iBaseLength * (double) iBaseLength * (double) jHeight / 3.0;
-            if (volume < MIN_VOLUME || volume > MAX_VOLUME)
-            {
-                continue;
-            }
+    RecordStreamWriter recordWriter;
+    if (!commandLine.recordPath.empty())
+    {
+        if (!recordWriter.Open(commandLine.recordPath, targets, error))
+        {
+            std::cerr << error << '\n';
+            return 1;
+        }
+        options.recordWriter = &recordWriter;
+    }
+
+    SweepEngine sweepEngine(options);
+    SweepAccumulator sweep;
+    if (!commandLine.mergedPartialPaths.empty())
+    {
+        if (!sweepEngine.MergePartials(commandLine.mergedPartialPaths, sweep, error))
+        {
+            std::cerr << error << '\n';
+            return 1;
+        }
+    }
+    else if (commandLine.resume)
+    {
+        if (!sweepEngine.Resume(error))
+        {
+            std::cerr << error << '\n';
+            return 1;
+        }
+        std::cerr << "resuming with " << sweepEngine.GetResumedSegmentCount() << " of " << sweepEngine.GetSegmentCount() << " ratio segments done\n";
+    }
 
-            // Check if the ratio of the base perimeter to the height encodes the Earth's parameters
-            Pyramid pyramid(iBaseLength, jHeight);
-            //double basePerimeterToHeight = pyramid.GetBasePerimeter() / pyramid.GetHeight();
-            //if (CalculateRelativeError(basePerimeterToHeight, equatorialCircumferenceToPolarRadius) > 0.01)
-            //{
-            //    lessAccurateThanKhufuCount += 1.0;
-            //    continue;
-            //}
+    if (commandLine.mergedPartialPaths.empty())
+    {
+        sweep = sweepEngine.Run();
+    }
 
-            ++pyramidCount;
+    if (!WriteMetrics(commandLine))
+    {
+        return 1;
+    }
 
-            GetClosestResult closestPi = pyramid.GetClosest(pi);
-            GetClosestResult closestPhi = pyramid.GetClosest(phi);
-            GetClosestResult closestE = pyramid.GetClosest(e);
+    if (!commandLine.recordPath.empty() && !recordWriter.Close(error))
+    {
+        std::cerr << error << '\n';
+        return 1;
+    }
 
-            closestPi.relativeError = CalculateRelativeError(closestPi.value, pi);
-            closestPhi.relativeError = CalculateRelativeError(closestPhi.value, phi);
-            closestE.relativeError = CalculateRelativeError(closestE.value, e);
+    if (!commandLine.partialPath.empty())
+    {
+        if (!sweepEngine.WritePartial(commandLine.partialPath, sweep, error))
+        {
+            std::cerr << error << '\n';
+            return 1;
+        }
+        std::cerr << "wrote shard " << commandLine.shardIndex << "/" << commandLine.shardCount << " (" << sweepEngine.GetSegmentCount() << " ratio segments, "
+            << sweep.ratioCount << " ratios) to " << commandLine.partialPath << '\n';
+        return 0;
+    }
 
-            double relativeErrorSum = closestPi.relativeError + closestPhi.relativeError + closestE.relativeError;
-            relativeErrorSumSum += relativeErrorSum;
-            if (relativeErrorSum < minRelativeErrorSum)
-            {
-                winningBaseLength = iBaseLength;
-                winningHeight = jHeight;
-                minRelativeErrorSum = relativeErrorSum;
-            }
+    // Khufu itself counts towards the averages, quantiles and hits, combined and per target,
+    // as he does towards the ranks.
+    int64_t pyramidCount = sweep.pyramidCount + 1;
+    sweep.relativeErrorSumSum.Add(khufuRelativeErrorSum);
+    sweep.relativeErrorSumSketch.Add(khufuRelativeErrorSum);
+    for (size_t i = 0; i < targets.GetSize(); ++i)
+    {
+        TargetStatistics& statistics = sweep.targetStatistics[i];
+        statistics.relativeErrorSum.Add(khufuRelativeErrors[i]);
+        statistics.relativeErrorSketch.Add(khufuRelativeErrors[i]);
+        statistics.hitCount += khufuRelativeErrors[i] <= commandLine.hitTolerance ? 1 : 0;
+    }
 
-            if (relativeErrorSum < khufuRelativeErrorSum)
-            {
-                ++moreAccurateThanKhufuCount;
-                //std::cout << "height: " << jHeight << '\n';
-                //std::cout << "base length: " << iBaseLength << '\n';
-                //std::cout << EQUATORIAL_CIRCUMFERENCE * 1000.0 / (pyramid.GetBasePerimeter() * const_pi() / 6.0) << '\n';
-                //std::cout << CalculateRelativeError(pyramid.GetBasePerimeter() / pyramid.GetHeight(), equatorialCircumferenceToPolarRadius) << '\n';
-                //std::cout << '\n';
-            }
-            else if (relativeErrorSum > khufuRelativeErrorSum)
-            {
-                ++lessAccurateThanKhufuCount;
-            }
+    int winningBaseLength = sweep.winningBaseLength;
+    int winningHeight = sweep.winningHeight;
+    double minRelativeErrorSum = sweep.minRelativeErrorSum;
+    double relativeErrorSumSum = sweep.relativeErrorSumSum.ToDouble();
+    int64_t moreAccurateThanKhufuCount = sweep.moreAccurateThanKhufuCount;
+    int64_t lessAccurateThanKhufuCount = sweep.lessAccurateThanKhufuCount;
 
-            processedHeightToBaseLengthRatios.insert(reducedHeightToBaseRatio);
+    if (commandLine.shape != SolidShape::SQUARE_PYRAMID)
+    {
+        std::cout << "shape: " << SolidShapeStrings[(int) commandLine.shape];
+        if (commandLine.shape == SolidShape::SQUARE_FRUSTUM)
+        {
+            std::cout << ", top side " << commandLine.frustumTopFraction << " of the base side";
         }
+        std::cout << '\n';
     }
-
     std::cout << "winning base length: " << winningBaseLength << '\n';
     std::cout << "winning height: " << winningHeight << '\n';
     std::cout << "relative error sum: " << minRelativeErrorSum << '\n';
@@ -160,4 +845,43 @@ int main()
     std::cout << "number of pyramids with a worse combined relative error than the Great Pyramid: " << lessAccurateThanKhufuCount << '\n';
 
     std::cout << "the Great Pyramid is more accurate than " << std::setprecision(15) << (double) lessAccurateThanKhufuCount / (double) (lessAccurateThanKhufuCount + moreAccurateThanKhufuCount) << '\n';
-}
+    std::cout << "relative error sum quantiles: ";
+    PrintQuantiles(sweep.relativeErrorSumSketch);
+    std::cout << "Great Pyramid rank by relative error sum: " << moreAccurateThanKhufuCount + 1 << " of " << pyramidCount << '\n';
+    std::cout << "distinct height to base ratios evaluated: " << sweep.ratioCount << '\n';
+    std::cout << "closest-match candidates evaluated: " << sweep.evaluatedCandidateCount << ", pruned: " << sweep.prunedCandidateCount << '\n';
+
+    std::cout << '\n';
+    std::cout << "per-target results (hit = relative error <= " << commandLine.hitTolerance << "):\n";
+    for (size_t i = 0; i < targets.GetSize(); ++i)
+    {
+        const TargetStatistics& statistics = sweep.targetStatistics[i];
+        std::cout << targets[i].name << (targets[i].inCombinedSum ? " (combined)" : "") << ": " << targets[i].value << '\n';
+        std::cout << "    Great Pyramid relative error: " << khufuRelativeErrors[i] << '\n';
+        std::cout << "    average relative error over the sweep: " << statistics.relativeErrorSum.ToDouble() / (double) pyramidCount << '\n';
+        std::cout << "    relative error quantiles: ";
+        PrintQuantiles(statistics.relativeErrorSketch);
+        std::cout << "    Great Pyramid rank: " << statistics.moreAccurateThanKhufuCount + 1 << " of " << pyramidCount << '\n';
+        std::cout << "    hits: " << statistics.hitCount << '\n';
+        std::cout << "    more accurate than the Great Pyramid: " << statistics.moreAccurateThanKhufuCount << '\n';
+        std::cout << "    best: base length " << statistics.bestBaseLength << ", height " << statistics.bestHeight << ", relative error " << statistics.minRelativeError << '\n';
+    }
+
+    if (commandLine.leaderboardSize > 0)
+    {
+        std::cout << '\n';
+        std::cout << "top " << commandLine.leaderboardSize << " pyramids by relative error sum:\n";
+        std::vector<LeaderboardEntry> entries = sweep.leaderboard.GetSortedEntries();
+        for (size_t rank = 0; rank < entries.size(); ++rank)
+        {
+            LeaderboardEntry& entry = entries[rank];
+            std::cout << '\n';
+            std::cout << "#" << rank + 1 << ": base length " << entry.baseLength << ", height " << entry.height << ", relative error sum " << entry.relativeErrorSum << '\n';
+            for (size_t i = 0; i < entry.closest.size(); ++i)
+            {
+                std::cout << targets[i].name << (targets[i].inCombinedSum ? " (combined)" : "") << ":\n";
+                entry.closest[i].Print();
+            }
+        }
+    }
+}
\ No newline at end of file
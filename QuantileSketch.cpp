@@ -0,0 +1,160 @@
+#include "QuantileSketch.h"
+#include "BinaryIO.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+QuantileSketch::QuantileSketch(double relativeAccuracy):
+    relativeAccuracy(relativeAccuracy),
+    gamma((1.0 + relativeAccuracy) / (1.0 - relativeAccuracy)),
+    logGamma(std::log(gamma)),
+    minIndex((int) std::floor(std::log(MIN_VALUE) / logGamma)),
+    count(0),
+    zeroCount(0),
+    min(std::numeric_limits<double>::max()),
+    max(0.0),
+    bucketCounts((size_t) ((int) std::ceil(std::log(MAX_VALUE) / logGamma) - minIndex + 1), 0)
+{
+}
+
+int QuantileSketch::GetBucket(double value) const
+{
+    // Bucket i holds (gamma^(i - 1), gamma^i].
+    int index = (int) std::ceil(std::log(value) / logGamma);
+    return std::min(std::max(index - minIndex, 0), (int) bucketCounts.size() - 1);
+}
+
+double QuantileSketch::GetBucketValue(int bucket) const
+{
+    // Within relativeAccuracy of every value in the bucket.
+    return 2.0 * std::pow(gamma, bucket + minIndex) / (gamma + 1.0);
+}
+
+void QuantileSketch::Add(double value)
+{
+    AddMultiple(value, 1);
+}
+
+void QuantileSketch::AddMultiple(double value, uint64_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    this->count += count;
+    min = std::min(min, value);
+    max = std::max(max, value);
+
+    if (value <= MIN_VALUE)
+    {
+        zeroCount += count;
+    }
+    else
+    {
+        bucketCounts[GetBucket(value)] += count;
+    }
+}
+
+void QuantileSketch::Merge(const QuantileSketch& other)
+{
+    count += other.count;
+    zeroCount += other.zeroCount;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+
+    for (size_t i = 0; i < bucketCounts.size() && i < other.bucketCounts.size(); ++i)
+    {
+        bucketCounts[i] += other.bucketCounts[i];
+    }
+}
+
+uint64_t QuantileSketch::GetCount() const
+{
+    return count;
+}
+
+double QuantileSketch::GetMin() const
+{
+    return min;
+}
+
+double QuantileSketch::GetMax() const
+{
+    return max;
+}
+
+double QuantileSketch::GetQuantile(double quantile) const
+{
+    if (count == 0)
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    uint64_t rank = (uint64_t) (std::min(std::max(quantile, 0.0), 1.0) * (double) (count - 1));
+    if (rank < zeroCount)
+    {
+        return 0.0;
+    }
+
+    uint64_t seen = zeroCount;
+    for (size_t i = 0; i < bucketCounts.size(); ++i)
+    {
+        seen += bucketCounts[i];
+        if (rank < seen)
+        {
+            // The extremes are known exactly.
+            return std::min(std::max(GetBucketValue((int) i), min), max);
+        }
+    }
+
+    return max;
+}
+
+void QuantileSketch::Write(std::ostream& stream) const
+{
+    BinaryIO::Write(stream, relativeAccuracy);
+    BinaryIO::Write(stream, minIndex);
+    BinaryIO::Write(stream, count);
+    BinaryIO::Write(stream, zeroCount);
+    BinaryIO::Write(stream, min);
+    BinaryIO::Write(stream, max);
+
+    uint32_t usedBucketCount = (uint32_t) std::count_if(bucketCounts.begin(), bucketCounts.end(), [](uint64_t bucketCount) { return bucketCount != 0; });
+    BinaryIO::Write(stream, usedBucketCount);
+    for (uint32_t bucket = 0; bucket < (uint32_t) bucketCounts.size(); ++bucket)
+    {
+        if (bucketCounts[bucket] != 0)
+        {
+            BinaryIO::Write(stream, bucket);
+            BinaryIO::Write(stream, bucketCounts[bucket]);
+        }
+    }
+}
+
+bool QuantileSketch::Read(std::istream& stream)
+{
+    double storedRelativeAccuracy;
+    int storedMinIndex;
+    uint32_t usedBucketCount;
+    if (!BinaryIO::Read(stream, storedRelativeAccuracy) || storedRelativeAccuracy != relativeAccuracy ||
+        !BinaryIO::Read(stream, storedMinIndex) || storedMinIndex != minIndex ||
+        !BinaryIO::Read(stream, count) || !BinaryIO::Read(stream, zeroCount) || !BinaryIO::Read(stream, min) || !BinaryIO::Read(stream, max) ||
+        !BinaryIO::Read(stream, usedBucketCount))
+    {
+        return false;
+    }
+
+    std::fill(bucketCounts.begin(), bucketCounts.end(), 0);
+    for (uint32_t i = 0; i < usedBucketCount; ++i)
+    {
+        uint32_t bucket;
+        if (!BinaryIO::Read(stream, bucket) || bucket >= bucketCounts.size() || !BinaryIO::Read(stream, bucketCounts[bucket]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#ifndef QUANTILE_SKETCH_H_
+#define QUANTILE_SKETCH_H_
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// A fixed-memory quantile sketch for non-negative values, in the style of DDSketch: values
+// are counted in logarithmic buckets, so every reported quantile is within relativeAccuracy
+// of a value at that rank. Values at or below MIN_VALUE share one bucket and are reported
+// as 0, values above MAX_VALUE share the top bucket. Merging adds counts, so unlike a
+// t-digest or KLL sketch the result does not depend on the order values arrive in or on how
+// partial sketches are merged. Memory depends only on the accuracy, never on the count: at
+// the default accuracy about 4,400 buckets, 35 KB.
+class QuantileSketch
+{
+public:
+    // Just below 2^-53, the smallest relative error between two different doubles, so only
+    // exact matches land in the zero bucket.
+    static constexpr double MIN_VALUE = 1.0E-16;
+    static constexpr double MAX_VALUE = 1.0E3;
+    static constexpr double DEFAULT_RELATIVE_ACCURACY = 0.005;
+
+    explicit QuantileSketch(double relativeAccuracy = DEFAULT_RELATIVE_ACCURACY);
+
+    void Add(double value);
+    void AddMultiple(double value, uint64_t count);
+    void Merge(const QuantileSketch& other);
+
+    uint64_t GetCount() const;
+    double GetMin() const;
+    double GetMax() const;
+
+    // The value at rank quantile * (count - 1), 0 <= quantile <= 1.
+    double GetQuantile(double quantile) const;
+
+    // Stores the buckets sparsely; Read expects a sketch of the same accuracy and range.
+    void Write(std::ostream& stream) const;
+    bool Read(std::istream& stream);
+
+private:
+    double relativeAccuracy;
+    double gamma;
+    double logGamma;
+    int minIndex;
+
+    uint64_t count;
+    uint64_t zeroCount;
+    double min;
+    double max;
+    std::vector<uint64_t> bucketCounts;
+
+    int GetBucket(double value) const;
+    double GetBucketValue(int bucket) const;
+};
+
+#endif
\ No newline at end of file
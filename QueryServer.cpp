@@ -0,0 +1,504 @@
+#include "QueryServer.h"
+#include "ClosestKernel.h"
+#include "MathUtilities.h"
+#include "WorkStealingScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using MathUtilities::CalculateRelativeError;
+
+namespace
+{
+
+// The connections being served. Shared with the connection threads, which may outlive
+// ServeSocket when it fails.
+struct ConnectionSlots
+{
+    std::mutex mutex;
+    std::condition_variable released;
+    int activeCount = 0;
+};
+
+}
+
+QueryServer::QueryServer(const SweepOptions& options, const CandidateIndexFile& index, const Pyramid& greatPyramid):
+    options(options),
+    index(index),
+    greatPyramid(greatPyramid)
+{
+    // The same ratios and multiples as the sweep, in index order.
+    SweepEngine engine(options);
+    std::pair<int64_t, int64_t> multiples;
+    for (uint64_t entry = 0; entry < index.GetRatioCount(); ++entry)
+    {
+        if (engine.AcceptRatio(index.GetReducedHeight(entry), index.GetReducedBaseLength(entry), multiples))
+        {
+            ratios.push_back({ entry, multiples.first, multiples.second });
+        }
+    }
+
+    // The varying pairs, by their first factor's candidate; an invariant pair is invariant
+    // for every factor.
+    std::vector<std::pair<int, int>> varyingPairs;
+    for (int candidate = 0; candidate < ClosestKernel::CANDIDATE_COUNT; ++candidate)
+    {
+        const ClosestKernel::Candidate& c = ClosestKernel::GetCandidate(candidate);
+        if (c.factorIndex == 0 && !ClosestKernel::IsInvariantCandidate(candidate))
+        {
+            varyingPairs.emplace_back((int) c.dimension1, (int) c.dimension2);
+        }
+    }
+
+    size_t targetCount = options.targets.GetSize();
+    pairRatios.resize(ratios.size() * varyingPairs.size());
+    catalogRelativeErrors.resize(ratios.size() * targetCount);
+    uint32_t batchCount = (uint32_t) ((ratios.size() + LOAD_BATCH_SIZE - 1) / LOAD_BATCH_SIZE);
+    WorkStealingScheduler scheduler(options.threadCount);
+    scheduler.Run(batchCount, [&](int, uint32_t batch)
+    {
+        uint32_t batchEnd = (uint32_t) std::min<size_t>(ratios.size(), (size_t) (batch + 1) * LOAD_BATCH_SIZE);
+        for (uint32_t ratio = batch * LOAD_BATCH_SIZE; ratio < batchEnd; ++ratio)
+        {
+            const double* dimensions = index.GetDimensions(ratios[ratio].entry);
+            for (size_t p = 0; p < varyingPairs.size(); ++p)
+            {
+                pairRatios[ratio * varyingPairs.size() + p] = { (float) (dimensions[varyingPairs[p].first] / dimensions[varyingPairs[p].second]), ratio };
+            }
+            for (size_t t = 0; t < targetCount; ++t)
+            {
+                catalogRelativeErrors[t * ratios.size() + ratio] = CalculateRatioRelativeError(ratio, options.targets[t].value);
+            }
+        }
+    });
+    std::sort(pairRatios.begin(), pairRatios.end());
+}
+
+bool QueryServer::PairRatio::operator<(const PairRatio& other) const
+{
+    return value < other.value || (value == other.value && ratio < other.ratio);
+}
+
+size_t QueryServer::GetRatioCount() const
+{
+    return ratios.size();
+}
+
+bool QueryServer::ParseTarget(const std::string& name, double& value) const
+{
+    for (const Target& target : options.targets.GetTargets())
+    {
+        if (target.name == name)
+        {
+            value = target.value;
+            return true;
+        }
+    }
+    if (TargetCatalog::FindBuiltIn(name, value))
+    {
+        return true;
+    }
+
+    char* end;
+    value = std::strtod(name.c_str(), &end);
+    return !name.empty() && *end == '\0' && std::isfinite(value) && value > 0.0;
+}
+
+std::vector<uint32_t> QueryServer::FindMatchCandidates(double value, double tolerance) const
+{
+    double low = value * (1.0 - tolerance) * (1.0 - PAIR_RATIO_TABLE_MARGIN);
+    double high = value * (1.0 + tolerance) * (1.0 + PAIR_RATIO_TABLE_MARGIN);
+
+    // An invariant candidate is every ratio's, so if one is in range all of them are.
+    const IndexedCandidate* invariants = ClosestKernel::GetInvariantCandidates();
+    for (int i = 0; i < ClosestKernel::GetInvariantCandidateCount(); ++i)
+    {
+        if (invariants[i].value >= low && invariants[i].value <= high)
+        {
+            std::vector<uint32_t> all(ratios.size());
+            for (uint32_t ratio = 0; ratio < (uint32_t) ratios.size(); ++ratio)
+            {
+                all[ratio] = ratio;
+            }
+            return all;
+        }
+    }
+
+    std::vector<uint32_t> found;
+    for (double factor : allowedFactors)
+    {
+        auto begin = std::lower_bound(pairRatios.begin(), pairRatios.end(), low / factor, [](const PairRatio& pairRatio, double bound)
+        {
+            return (double) pairRatio.value < bound;
+        });
+        for (auto pairRatio = begin; pairRatio != pairRatios.end() && (double) pairRatio->value <= high / factor; ++pairRatio)
+        {
+            found.push_back(pairRatio->ratio);
+        }
+    }
+
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+    return found;
+}
+
+const double* QueryServer::FindCatalogRelativeErrors(double value) const
+{
+    for (size_t t = 0; t < options.targets.GetSize(); ++t)
+    {
+        if (options.targets[t].value == value)
+        {
+            return catalogRelativeErrors.data() + t * ratios.size();
+        }
+    }
+    return nullptr;
+}
+
+double QueryServer::CalculateRatioRelativeError(uint32_t ratio, double value) const
+{
+    uint64_t entry = ratios[ratio].entry;
+    int candidate = index.FindClosestCandidate(entry, value);
+    return CalculateRelativeError(ClosestKernel::CalculateCandidateValue(index.GetDimensions(entry), candidate), value);
+}
+
+void QueryServer::Answer(const std::string& request, std::string& response) const
+{
+    std::istringstream fields(request);
+    std::ostringstream answer;
+    answer << std::setprecision(15);
+
+    std::string command;
+    fields >> command;
+    if (command == "closest")
+    {
+        AnswerClosest(fields, answer);
+    }
+    else if (command == "matches")
+    {
+        AnswerMatches(fields, answer);
+    }
+    else if (command == "rank")
+    {
+        AnswerRank(fields, answer);
+    }
+    else
+    {
+        answer << "error unknown request: " << command << '\n';
+    }
+
+    response += answer.str();
+}
+
+void QueryServer::AnswerClosest(std::istringstream& fields, std::ostringstream& response) const
+{
+    std::string targetName;
+    int baseLength;
+    int height;
+    double value;
+    if (!(fields >> targetName >> baseLength >> height) || baseLength < 1 || height < 1)
+    {
+        response << "error usage: closest <target> <baseLength> <height>\n";
+        return;
+    }
+    if (!ParseTarget(targetName, value))
+    {
+        response << "error unknown target: " << targetName << '\n';
+        return;
+    }
+
+    // Any pyramid, not just the indexed ones; a single search is microseconds anyway.
+    GetClosestResult closest = Pyramid(baseLength, height).GetClosest(value);
+    response << "ok " << PyramidDimensionStrings[(int) closest.dimension1.first] << ' ' << closest.dimension1.second << ' '
+        << PyramidDimensionStrings[(int) closest.dimension2.first] << ' ' << closest.dimension2.second << ' '
+        << closest.value << ' ' << CalculateRelativeError(closest.value, value) << '\n';
+}
+
+void QueryServer::AnswerMatches(std::istringstream& fields, std::ostringstream& response) const
+{
+    std::string targetName;
+    double tolerance;
+    double value;
+    if (!(fields >> targetName >> tolerance) || !(tolerance >= 0.0))
+    {
+        response << "error usage: matches <target> <tolerance>\n";
+        return;
+    }
+    if (!ParseTarget(targetName, value))
+    {
+        response << "error unknown target: " << targetName << '\n';
+        return;
+    }
+
+    std::ostringstream matches;
+    matches << std::setprecision(15);
+    int64_t pyramidCount = 0;
+    int64_t ratioCount = 0;
+    // The closest candidate is within tolerance exactly when any candidate is, so only the
+    // ratios the table finds can match.
+    for (uint32_t r : FindMatchCandidates(value, tolerance))
+    {
+        const AcceptedRatio& ratio = ratios[r];
+        double relativeError = CalculateRatioRelativeError(r, value);
+        if (relativeError <= tolerance)
+        {
+            pyramidCount += ratio.lastMultiple - ratio.firstMultiple + 1;
+            ++ratioCount;
+            matches << index.GetReducedBaseLength(ratio.entry) << ' ' << index.GetReducedHeight(ratio.entry) << ' '
+                << ratio.firstMultiple << ' ' << ratio.lastMultiple << ' ' << relativeError << '\n';
+        }
+    }
+
+    response << "ok " << pyramidCount << ' ' << ratioCount << '\n' << matches.str();
+}
+
+void QueryServer::AnswerRank(std::istringstream& fields, std::ostringstream& response) const
+{
+    std::string targetList;
+    if (!(fields >> targetList))
+    {
+        response << "error usage: rank <target>[,<target>...]\n";
+        return;
+    }
+
+    std::vector<double> values;
+    std::stringstream names(targetList);
+    std::string name;
+    while (std::getline(names, name, ','))
+    {
+        double value;
+        if (!ParseTarget(name, value))
+        {
+            response << "error unknown target: " << name << '\n';
+            return;
+        }
+        values.push_back(value);
+    }
+    if (values.empty())
+    {
+        response << "error usage: rank <target>[,<target>...]\n";
+        return;
+    }
+
+    // Summed in the order given, as the sweep sums the combined targets in catalog order.
+    double greatPyramidRelativeErrorSum = 0.0;
+    for (double value : values)
+    {
+        greatPyramidRelativeErrorSum += CalculateRelativeError(greatPyramid.GetClosest(value).value, value);
+    }
+
+    // Each target's relative errors, from the cache for catalog targets.
+    std::vector<std::vector<double>> searchedRelativeErrors;
+    std::vector<const double*> relativeErrors;
+    for (double value : values)
+    {
+        const double* cached = FindCatalogRelativeErrors(value);
+        if (cached == nullptr)
+        {
+            searchedRelativeErrors.emplace_back(ratios.size());
+            for (uint32_t r = 0; r < (uint32_t) ratios.size(); ++r)
+            {
+                searchedRelativeErrors.back()[r] = CalculateRatioRelativeError(r, value);
+            }
+            cached = searchedRelativeErrors.back().data();
+        }
+        relativeErrors.push_back(cached);
+    }
+
+    int64_t pyramidCount = 1;
+    int64_t moreAccurateCount = 0;
+    for (size_t r = 0; r < ratios.size(); ++r)
+    {
+        double relativeErrorSum = 0.0;
+        for (const double* targetRelativeErrors : relativeErrors)
+        {
+            relativeErrorSum += targetRelativeErrors[r];
+        }
+
+        const AcceptedRatio& ratio = ratios[r];
+        int64_t count = ratio.lastMultiple - ratio.firstMultiple + 1;
+        pyramidCount += count;
+        if (relativeErrorSum < greatPyramidRelativeErrorSum)
+        {
+            moreAccurateCount += count;
+        }
+    }
+
+    response << "ok " << moreAccurateCount + 1 << ' ' << pyramidCount << ' ' << greatPyramidRelativeErrorSum << '\n';
+}
+
+bool QueryServer::IsQuit(const std::string& request)
+{
+    std::istringstream fields(request);
+    std::string command;
+    return fields >> command && command == "quit";
+}
+
+void QueryServer::Serve(std::istream& input, std::ostream& output) const
+{
+    std::string request;
+    std::string responses;
+    while (std::getline(input, request) && !IsQuit(request))
+    {
+        if (!request.empty() && request.back() == '\r')
+        {
+            request.pop_back();
+        }
+        if (request.find_first_not_of(" \t") == std::string::npos)
+        {
+            continue;
+        }
+
+        Answer(request, responses);
+        if (input.rdbuf()->in_avail() <= 0)
+        {
+            output << responses << std::flush;
+            responses.clear();
+        }
+    }
+
+    output << responses << std::flush;
+}
+
+bool QueryServer::ServeSocket(const std::string& path, std::string& error) const
+{
+#ifdef _WIN32
+    (void) path;
+    error = "--socket needs Unix domain sockets, which this platform does not have";
+    return false;
+#else
+    sockaddr_un address = {};
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        error = "socket path is too long: " + path;
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size());
+
+    // A client that hangs up mid-response must not take the server down with it.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str());
+    if (listener < 0 || bind(listener, (const sockaddr*) &address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+    {
+        if (listener >= 0)
+        {
+            close(listener);
+        }
+        error = "cannot listen on " + path;
+        return false;
+    }
+
+    std::shared_ptr<ConnectionSlots> slots = std::make_shared<ConnectionSlots>();
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(slots->mutex);
+            slots->released.wait(lock, [&] { return slots->activeCount < MAX_CONNECTIONS; });
+        }
+
+        int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            close(listener);
+            error = "cannot accept connections on " + path;
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(slots->mutex);
+            ++slots->activeCount;
+        }
+        std::thread([this, connection, slots]
+        {
+            ServeConnection(connection);
+            std::lock_guard<std::mutex> lock(slots->mutex);
+            --slots->activeCount;
+            slots->released.notify_one();
+        }).detach();
+    }
+#endif
+}
+
+void QueryServer::ServeConnection(int connection) const
+{
+#ifdef _WIN32
+    (void) connection;
+#else
+    std::string pending;
+    std::string responses;
+    char buffer[1 << 16];
+    bool quit = false;
+    while (!quit)
+    {
+        ssize_t received = recv(connection, buffer, sizeof(buffer), 0);
+        if (received <= 0)
+        {
+            break;
+        }
+        pending.append(buffer, (size_t) received);
+
+        // Answer every complete request received so far and send the responses in one go.
+        size_t begin = 0;
+        size_t end;
+        while (!quit && (end = pending.find('\n', begin)) != std::string::npos)
+        {
+            std::string request = pending.substr(begin, end - begin);
+            begin = end + 1;
+            if (!request.empty() && request.back() == '\r')
+            {
+                request.pop_back();
+            }
+            if (IsQuit(request))
+            {
+                quit = true;
+            }
+            else if (request.find_first_not_of(" \t") != std::string::npos)
+            {
+                Answer(request, responses);
+            }
+        }
+        pending.erase(0, begin);
+        if (!quit && pending.size() > MAX_REQUEST_LENGTH)
+        {
+            responses += "error request longer than " + std::to_string(MAX_REQUEST_LENGTH) + " bytes\n";
+            quit = true;
+        }
+
+        size_t sent = 0;
+        while (sent < responses.size())
+        {
+            ssize_t written = send(connection, responses.data() + sent, responses.size() - sent, 0);
+            if (written <= 0)
+            {
+                quit = true;
+                break;
+            }
+            sent += (size_t) written;
+        }
+        responses.clear();
+    }
+
+    close(connection);
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#ifndef QUERY_SERVER_H_
+#define QUERY_SERVER_H_
+
+#include "CandidateIndexFile.h"
+#include "Pyramid.h"
+#include "Sweep.h"
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Answers ad-hoc queries about the sweep a candidate index covers, one request per line:
+//
+//   closest <target> <baseLength> <height>
+//       ok <dimension1> <value1> <dimension2> <value2> <value> <relativeError>
+//   matches <target> <tolerance>
+//       ok <pyramidCount> <ratioCount>, then per ratio whose closest match is within
+//       tolerance: <reducedBaseLength> <reducedHeight> <firstMultiple> <lastMultiple> <relativeError>
+//   rank <target>[,<target>...]
+//       ok <rank> <pyramidCount> <greatPyramidRelativeErrorSum>
+//
+// A target is a catalog name, a built-in constant or a number. The pyramids are those the
+// sweep of options visits plus the Great Pyramid, and rank is the Great Pyramid's by the
+// relative error sum over the targets, counted the way the sweep counts it. Failed requests
+// get "error <message>", and "quit" ends the connection. A socket connection that sends more
+// than MAX_REQUEST_LENGTH bytes without a newline gets an error and is closed.
+//
+// Everything a query reads is built in the constructor and never changes afterwards, so any
+// number of connections answer concurrently without locks. matches looks its target up in a
+// table of every ratio's pair ratios sorted by value, and rank sums per-ratio errors cached
+// for each catalog target; only targets outside the catalog are searched ratio by ratio.
+class QueryServer
+{
+public:
+    QueryServer(const SweepOptions& options, const CandidateIndexFile& index, const Pyramid& greatPyramid);
+
+    // Appends the response to request, newline terminated.
+    void Answer(const std::string& request, std::string& response) const;
+
+    // Answers requests from input until it ends or sends quit. The responses to every request
+    // already read are written out together, so a batch of requests is one flush.
+    void Serve(std::istream& input, std::ostream& output) const;
+
+    // Answers each connection to a Unix domain socket at path on its own thread, at most
+    // MAX_CONNECTIONS at once; further clients wait to be accepted until one hangs up. Only
+    // returns if the socket cannot be set up.
+    bool ServeSocket(const std::string& path, std::string& error) const;
+
+    size_t GetRatioCount() const;
+
+private:
+    static constexpr uint32_t LOAD_BATCH_SIZE = 1024;
+    static constexpr size_t MAX_REQUEST_LENGTH = 1 << 16;
+    static constexpr int MAX_CONNECTIONS = 64;
+    // The pair ratio table is keyed by float, so a lookup widens its range by this much and
+    // confirms each ratio it finds with an exact search.
+    static constexpr double PAIR_RATIO_TABLE_MARGIN = 1.0E-6;
+
+    // A ratio the sweep accepts: its index entry and the multiples inside the bounds.
+    struct AcceptedRatio
+    {
+        uint64_t entry;
+        int64_t firstMultiple;
+        int64_t lastMultiple;
+    };
+
+    // One of the varying dimension pair ratios of ratios[ratio]; its candidates are this
+    // times each allowed factor.
+    struct PairRatio
+    {
+        float value;
+        uint32_t ratio;
+
+        bool operator<(const PairRatio& other) const;
+    };
+
+    SweepOptions options;
+    const CandidateIndexFile& index;
+    Pyramid greatPyramid;
+    std::vector<AcceptedRatio> ratios;
+    // Every ratio's pair ratios, sorted by value.
+    std::vector<PairRatio> pairRatios;
+    // The relative error of each ratio's closest match to catalog target t, at
+    // t * ratios.size() onwards.
+    std::vector<double> catalogRelativeErrors;
+
+    bool ParseTarget(const std::string& name, double& value) const;
+    // The ratios with a candidate within tolerance of value, maybe a few more, in index order.
+    std::vector<uint32_t> FindMatchCandidates(double value, double tolerance) const;
+    // The cached relative errors for value, or nullptr if it is not a catalog target's.
+    const double* FindCatalogRelativeErrors(double value) const;
+    double CalculateRatioRelativeError(uint32_t ratio, double value) const;
+    void AnswerClosest(std::istringstream& fields, std::ostringstream& response) const;
+    void AnswerMatches(std::istringstream& fields, std::ostringstream& response) const;
+    void AnswerRank(std::istringstream& fields, std::ostringstream& response) const;
+    void ServeConnection(int connection) const;
+
+    static bool IsQuit(const std::string& request);
+};
+
+#endif
\ No newline at end of file
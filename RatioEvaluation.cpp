@@ -0,0 +1,81 @@
+#include "RatioEvaluation.h"
+#include "CandidateIndex.h"
+#include "ClosestKernel.h"
+#include "MathUtilities.h"
+#include "Metrics.h"
+
+namespace
+{
+
+// Past this many targets, sorting the pyramid's candidates once and merging the sorted
+// catalog against them beats scanning every candidate per target.
+constexpr size_t CANDIDATE_INDEX_MIN_TARGETS = 16;
+
+}
+
+namespace RatioEvaluator
+{
+
+RatioEvaluation Evaluate(std::pair<int, int> reducedHeightToBaseRatio, const TargetCatalog& targets)
+{
+    return Evaluate(Pyramid(reducedHeightToBaseRatio.second, reducedHeightToBaseRatio.first), targets);
+}
+
+RatioEvaluation Evaluate(const Pyramid& pyramid, const TargetCatalog& targets)
+{
+    std::vector<int> candidates(targets.GetSize());
+    if (targets.GetSize() >= CANDIDATE_INDEX_MIN_TARGETS)
+    {
+        CandidateIndex index(pyramid);
+        std::vector<int> closestCandidates(targets.GetSize());
+        index.FindClosestCandidates(targets.GetSortedValues().data(), targets.GetSize(), closestCandidates.data());
+        for (size_t i = 0; i < targets.GetSize(); ++i)
+        {
+            candidates[targets.GetSortedOrder()[i]] = closestCandidates[i];
+        }
+
+        // The index valued every varying candidate once, for all of the targets.
+        ClosestKernel::CountSearches((int) targets.GetSize(), ClosestKernel::GetGroupVaryingCandidateCounts());
+    }
+    else
+    {
+        for (size_t i = 0; i < targets.GetSize(); ++i)
+        {
+            candidates[i] = ClosestKernel::FindClosestCandidate(pyramid.GetDimensions().data(), targets[i].value);
+        }
+    }
+
+    return EvaluateCandidates(pyramid, std::move(candidates), targets);
+}
+
+RatioEvaluation EvaluateCandidates(const Pyramid& pyramid, std::vector<int> candidates, const TargetCatalog& targets)
+{
+    RatioEvaluation evaluation;
+    evaluation.closest.resize(targets.GetSize());
+    evaluation.candidates = std::move(candidates);
+
+    for (size_t i = 0; i < targets.GetSize(); ++i)
+    {
+        evaluation.closest[i] = pyramid.GetCandidateResult(evaluation.candidates[i]);
+        if (Metrics::ENABLED)
+        {
+            Metrics::CountGroup(Metrics::GroupCounter::WINS, ClosestKernel::GetCandidateGroup(evaluation.candidates[i]));
+        }
+    }
+    Metrics::Count(Metrics::Counter::CLOSEST_SEARCHES, targets.GetSize());
+
+    evaluation.relativeErrorSum = 0.0;
+    for (size_t i = 0; i < targets.GetSize(); ++i)
+    {
+        GetClosestResult& closest = evaluation.closest[i];
+        closest.relativeError = MathUtilities::CalculateRelativeError(closest.value, targets[i].value);
+        if (targets[i].inCombinedSum)
+        {
+            evaluation.relativeErrorSum += closest.relativeError;
+        }
+    }
+
+    return evaluation;
+}
+
+}
\ No newline at end of file
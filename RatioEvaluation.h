@@ -0,0 +1,35 @@
+#ifndef RATIO_EVALUATION_H_
+#define RATIO_EVALUATION_H_
+
+#include "Pyramid.h"
+#include "TargetCatalog.h"
+
+#include <utility>
+#include <vector>
+
+// The closest matches for one reduced height:base ratio, one per catalog target, and the
+// relative error summed over the catalog's combined targets. Every quantity GetClosest compares
+// is a ratio within a single group, so all multiples of the ratio share these results.
+struct RatioEvaluation
+{
+public:
+    std::vector<GetClosestResult> closest;
+    // The ClosestKernel candidate number of each match.
+    std::vector<int> candidates;
+    double relativeErrorSum;
+};
+
+// Evaluations are made on the coprime pyramid itself, so a ratio gives the same result
+// whichever of its multiples asks.
+namespace RatioEvaluator
+{
+
+RatioEvaluation Evaluate(std::pair<int, int> reducedHeightToBaseRatio, const TargetCatalog& targets);
+// Evaluates the coprime pyramid when its dimensions are already at hand.
+RatioEvaluation Evaluate(const Pyramid& reducedPyramid, const TargetCatalog& targets);
+// Completes the evaluation once the closest candidate of every target is known.
+RatioEvaluation EvaluateCandidates(const Pyramid& reducedPyramid, std::vector<int> candidates, const TargetCatalog& targets);
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,386 @@
+#include "RatioSolver.h"
+#include "ClosestKernel.h"
+#include "MathUtilities.h"
+#include "Metrics.h"
+#include "RatioEvaluation.h"
+#include "WorkStealingScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+constexpr double GOLDEN_SECTION = 0.61803398874989484820;
+
+// Sorts intervals and joins those that overlap or touch.
+std::vector<RatioInterval> MergeIntervals(std::vector<RatioInterval> intervals)
+{
+    std::sort(intervals.begin(), intervals.end(), [](const RatioInterval& a, const RatioInterval& b)
+    {
+        return a.low < b.low;
+    });
+
+    std::vector<RatioInterval> merged;
+    for (const RatioInterval& interval : intervals)
+    {
+        if (!merged.empty() && interval.low <= merged.back().high)
+        {
+            merged.back().high = std::max(merged.back().high, interval.high);
+        }
+        else
+        {
+            merged.push_back(interval);
+        }
+    }
+    return merged;
+}
+
+std::vector<RatioInterval> IntersectIntervals(const std::vector<RatioInterval>& a, const std::vector<RatioInterval>& b)
+{
+    std::vector<RatioInterval> intersection;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a.size() && j < b.size())
+    {
+        double low = std::max(a[i].low, b[j].low);
+        double high = std::min(a[i].high, b[j].high);
+        if (low <= high)
+        {
+            intersection.push_back({ low, high });
+        }
+
+        if (a[i].high < b[j].high)
+        {
+            ++i;
+        }
+        else
+        {
+            ++j;
+        }
+    }
+    return intersection;
+}
+
+}
+
+RatioSolver::RatioSolver(const SweepOptions& options):
+    options(options),
+    bounds(options),
+    minRatio(std::max(options.minHeightToBaseRatio, (double) options.minHeight / (double) options.maxBaseLength)),
+    maxRatio(std::min(options.maxHeightToBaseRatio, (double) options.maxHeight / (double) options.minBaseLength))
+{
+    std::vector<double> sampleRatios(BASE_SAMPLE_COUNT + 1);
+    std::vector<Pyramid> samplePyramids;
+    for (int i = 0; i <= BASE_SAMPLE_COUNT; ++i)
+    {
+        // Geometric spacing resolves the steep end of the angles as well as the flat end.
+        double fraction = (double) i / BASE_SAMPLE_COUNT;
+        sampleRatios[i] = minRatio > 0.0 ? minRatio * std::pow(maxRatio / minRatio, fraction) : minRatio + (maxRatio - minRatio) * fraction;
+        samplePyramids.push_back(Pyramid::FromHeightToBaseRatio(sampleRatios[i]));
+    }
+    sampleRatios[BASE_SAMPLE_COUNT] = maxRatio;
+
+    constexpr int factorCount = (int) allowedFactors.size();
+    for (int candidate = 0; candidate < ClosestKernel::CANDIDATE_COUNT; candidate += factorCount)
+    {
+        if (ClosestKernel::IsInvariantCandidate(candidate))
+        {
+            invariantCandidates.push_back(candidate);
+            continue;
+        }
+
+        PairCurve curve;
+        curve.firstCandidate = candidate;
+        curve.numerator = ClosestKernel::GetCandidate(candidate).dimension1;
+        curve.denominator = ClosestKernel::GetCandidate(candidate).dimension2;
+        curve.ratios = sampleRatios;
+        for (const Pyramid& pyramid : samplePyramids)
+        {
+            curve.values.push_back(pyramid.GetDimension(curve.numerator) / pyramid.GetDimension(curve.denominator));
+        }
+
+        AddTurningPoints(curve);
+        curves.push_back(std::move(curve));
+    }
+}
+
+double RatioSolver::CalculatePairValue(const PairCurve& curve, double heightToBaseRatio) const
+{
+    Pyramid pyramid = Pyramid::FromHeightToBaseRatio(heightToBaseRatio);
+    return pyramid.GetDimension(curve.numerator) / pyramid.GetDimension(curve.denominator);
+}
+
+// Where the pair passes value between the ratios outside and other, with the pair monotone in
+// between and value not on outside's side of the pair at other. Returns the last ratio found
+// on outside's side, so an interval ending there is rounded outwards.
+double RatioSolver::FindCrossing(const PairCurve& curve, double outside, double other, double value) const
+{
+    bool outsideBelow = CalculatePairValue(curve, outside) < value;
+    for (int step = 0; step < BISECTION_STEPS; ++step)
+    {
+        double middle = 0.5 * (outside + other);
+        if (middle == outside || middle == other)
+        {
+            break;
+        }
+
+        double middleValue = CalculatePairValue(curve, middle);
+        if ((middleValue < value) == outsideBelow && middleValue != value)
+        {
+            outside = middle;
+        }
+        else
+        {
+            other = middle;
+        }
+    }
+    return outside;
+}
+
+// Adds a sample at every extremum, found by golden-section search between the neighbours of a
+// sample where the pair changes direction, so the pair is monotone between samples.
+void RatioSolver::AddTurningPoints(PairCurve& curve) const
+{
+    std::vector<std::pair<double, double>> turningPoints;
+    int direction = 0;
+    for (size_t i = 1; i < curve.values.size(); ++i)
+    {
+        int stepDirection = (curve.values[i] > curve.values[i - 1]) - (curve.values[i] < curve.values[i - 1]);
+        if (stepDirection != 0 && direction != 0 && stepDirection != direction)
+        {
+            bool isMaximum = direction > 0;
+            double low = curve.ratios[i >= 2 ? i - 2 : 0];
+            double high = curve.ratios[i];
+            for (int step = 0; step < BISECTION_STEPS && low < high; ++step)
+            {
+                double left = high - GOLDEN_SECTION * (high - low);
+                double right = low + GOLDEN_SECTION * (high - low);
+                if (left >= right)
+                {
+                    break;
+                }
+                if ((CalculatePairValue(curve, left) < CalculatePairValue(curve, right)) == isMaximum)
+                {
+                    low = left;
+                }
+                else
+                {
+                    high = right;
+                }
+            }
+
+            double extremum = 0.5 * (low + high);
+            turningPoints.emplace_back(extremum, CalculatePairValue(curve, extremum));
+        }
+        direction = stepDirection != 0 ? stepDirection : direction;
+    }
+
+    for (const std::pair<double, double>& turningPoint : turningPoints)
+    {
+        size_t position = std::lower_bound(curve.ratios.begin(), curve.ratios.end(), turningPoint.first) - curve.ratios.begin();
+        curve.ratios.insert(curve.ratios.begin() + position, turningPoint.first);
+        curve.values.insert(curve.values.begin() + position, turningPoint.second);
+    }
+}
+
+// Appends the ratios where the pair is within [low, high].
+void RatioSolver::FindPreimage(const PairCurve& curve, double low, double high, std::vector<RatioInterval>& intervals) const
+{
+    auto isInside = [low, high](double value)
+    {
+        return value >= low && value <= high;
+    };
+
+    for (size_t i = 0; i + 1 < curve.ratios.size(); ++i)
+    {
+        double startValue = curve.values[i];
+        double endValue = curve.values[i + 1];
+        if (std::max(startValue, endValue) < low || std::min(startValue, endValue) > high)
+        {
+            continue;
+        }
+
+        RatioInterval interval = { curve.ratios[i], curve.ratios[i + 1] };
+        if (!isInside(startValue))
+        {
+            interval.low = FindCrossing(curve, curve.ratios[i], curve.ratios[i + 1], startValue < low ? low : high);
+        }
+        if (!isInside(endValue))
+        {
+            interval.high = FindCrossing(curve, curve.ratios[i + 1], curve.ratios[i], endValue < low ? low : high);
+        }
+        intervals.push_back(interval);
+    }
+}
+
+std::vector<ExactHit> RatioSolver::FindExactHits(size_t target) const
+{
+    double targetValue = options.targets[target].value;
+    std::vector<ExactHit> hits;
+    for (const PairCurve& curve : curves)
+    {
+        for (int k = 0; k < (int) allowedFactors.size(); ++k)
+        {
+            double value = targetValue / allowedFactors[k];
+            for (size_t i = 0; i + 1 < curve.ratios.size(); ++i)
+            {
+                double startValue = curve.values[i];
+                double endValue = curve.values[i + 1];
+                bool isLastSample = i + 2 == curve.ratios.size();
+                if (startValue == value)
+                {
+                    hits.push_back({ curve.ratios[i], curve.firstCandidate + k });
+                }
+                else if (isLastSample && endValue == value)
+                {
+                    hits.push_back({ curve.ratios[i + 1], curve.firstCandidate + k });
+                }
+                else if ((startValue < value) != (endValue < value) && endValue != value)
+                {
+                    double below = FindCrossing(curve, curve.ratios[i], curve.ratios[i + 1], value);
+                    double above = FindCrossing(curve, curve.ratios[i + 1], curve.ratios[i], value);
+                    hits.push_back({ 0.5 * (below + above), curve.firstCandidate + k });
+                }
+            }
+        }
+    }
+
+    std::sort(hits.begin(), hits.end(), [](const ExactHit& a, const ExactHit& b)
+    {
+        return a.heightToBaseRatio < b.heightToBaseRatio || (a.heightToBaseRatio == b.heightToBaseRatio && a.candidate < b.candidate);
+    });
+    return hits;
+}
+
+std::vector<RatioInterval> RatioSolver::FindToleranceIntervals(size_t target, double relativeTolerance) const
+{
+    double targetValue = options.targets[target].value;
+    double absoluteTolerance = (relativeTolerance + TOLERANCE_GUARD) * std::abs(targetValue);
+    if (minRatio > maxRatio)
+    {
+        return {};
+    }
+
+    // An invariant candidate is equally close at every ratio.
+    Pyramid unitPyramid = Pyramid::FromHeightToBaseRatio(1.0);
+    for (int firstCandidate : invariantCandidates)
+    {
+        for (int k = 0; k < (int) allowedFactors.size(); ++k)
+        {
+            double value = ClosestKernel::CalculateCandidateValue(unitPyramid.GetDimensions().data(), firstCandidate + k);
+            if (std::abs(value - targetValue) <= absoluteTolerance)
+            {
+                return { { minRatio, maxRatio } };
+            }
+        }
+    }
+
+    std::vector<RatioInterval> intervals;
+    for (const PairCurve& curve : curves)
+    {
+        for (int k = 0; k < (int) allowedFactors.size(); ++k)
+        {
+            // Widened by the rounding of the candidate's product with the factor.
+            double low = (targetValue - absoluteTolerance) / allowedFactors[k] * (1.0 - TOLERANCE_GUARD);
+            double high = (targetValue + absoluteTolerance) / allowedFactors[k] * (1.0 + TOLERANCE_GUARD);
+            FindPreimage(curve, low, high, intervals);
+        }
+    }
+
+    return MergeIntervals(intervals);
+}
+
+std::vector<RatioInterval> RatioSolver::FindCandidateIntervals(double maxRelativeErrorSum) const
+{
+    // Every term of the sum is at most the sum.
+    std::vector<RatioInterval> intervals = { { minRatio, maxRatio } };
+    for (size_t target = 0; target < options.targets.GetSize() && !intervals.empty(); ++target)
+    {
+        if (options.targets[target].inCombinedSum)
+        {
+            intervals = IntersectIntervals(intervals, FindToleranceIntervals(target, maxRelativeErrorSum));
+        }
+    }
+    return intervals;
+}
+
+RatioSolverResult RatioSolver::Solve(double maxRelativeErrorSum) const
+{
+    RatioSolverResult result;
+    result.candidateIntervals = FindCandidateIntervals(maxRelativeErrorSum);
+    result.pyramidCount = 0;
+    result.evaluatedRatioCount = 0;
+
+    // Pieces are half-open except the last of each interval, so a ratio on a cut is solved
+    // once.
+    std::vector<std::pair<RatioInterval, bool>> pieces;
+    for (const RatioInterval& interval : result.candidateIntervals)
+    {
+        for (double low = interval.low; ; low += MAX_PIECE_WIDTH)
+        {
+            double high = std::min(interval.high, low + MAX_PIECE_WIDTH);
+            pieces.emplace_back(RatioInterval{ low, high }, high == interval.high);
+            if (high == interval.high)
+            {
+                break;
+            }
+        }
+    }
+
+    // As in the sweep, the calling thread solves pieces too, so drop whatever it searched before.
+    Metrics::DiscardThread();
+
+    std::vector<std::vector<SolvedRatio>> pieceRatios(pieces.size());
+    std::vector<int64_t> pieceEvaluatedRatioCounts(pieces.size(), 0);
+    WorkStealingScheduler scheduler(options.threadCount);
+    scheduler.Run((uint32_t) pieces.size(), [&](int threadIndex, uint32_t piece)
+    {
+        Metrics::ScopedPhase phase(Metrics::Phase::SOLVER_PIECE);
+        SolvePiece(pieces[piece].first, pieces[piece].second, maxRelativeErrorSum, pieceRatios[piece], pieceEvaluatedRatioCounts[piece]);
+        phase.End();
+        Metrics::FlushThread(threadIndex);
+    });
+
+    for (size_t piece = 0; piece < pieces.size(); ++piece)
+    {
+        for (const SolvedRatio& ratio : pieceRatios[piece])
+        {
+            result.ratios.push_back(ratio);
+            result.pyramidCount += ratio.lastMultiple - ratio.firstMultiple + 1;
+        }
+        result.evaluatedRatioCount += pieceEvaluatedRatioCounts[piece];
+    }
+
+    Metrics::FlushThread(0);
+    return result;
+}
+
+void RatioSolver::SolvePiece(RatioInterval piece, bool includeHigh, double maxRelativeErrorSum, std::vector<SolvedRatio>& ratios, int64_t& evaluatedRatioCount) const
+{
+    std::pair<int64_t, int64_t> start = MathUtilities::FindFareyFloor(piece.low, bounds.GetFareyOrder());
+    MathUtilities::FareySequence sequence(bounds.GetFareyOrder(), start.first, start.second);
+    std::pair<int64_t, int64_t> multiples;
+
+    while (true)
+    {
+        int64_t reducedHeight = sequence.GetNumerator();
+        int64_t reducedBaseLength = sequence.GetDenominator();
+        double ratio = (double) reducedHeight / (double) reducedBaseLength;
+        if (ratio > piece.high || (ratio == piece.high && !includeHigh))
+        {
+            break;
+        }
+
+        if (ratio >= piece.low && bounds.AcceptRatio(reducedHeight, reducedBaseLength, multiples))
+        {
+            ++evaluatedRatioCount;
+            RatioEvaluation evaluation = RatioEvaluator::Evaluate(Pyramid((int) reducedBaseLength, (int) reducedHeight), options.targets);
+            if (evaluation.relativeErrorSum < maxRelativeErrorSum)
+            {
+                ratios.push_back({ (int) reducedHeight, (int) reducedBaseLength, multiples.first, multiples.second, evaluation.relativeErrorSum });
+            }
+        }
+        sequence.Next();
+    }
+}
\ No newline at end of file
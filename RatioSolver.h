@@ -0,0 +1,109 @@
+#ifndef RATIO_SOLVER_H_
+#define RATIO_SOLVER_H_
+
+#include "Pyramid.h"
+#include "Sweep.h"
+
+#include <cstdint>
+#include <vector>
+
+// A closed interval of height to base ratios.
+struct RatioInterval
+{
+    double low;
+    double high;
+};
+
+// A height to base ratio at which a ClosestKernel candidate equals a target.
+struct ExactHit
+{
+    double heightToBaseRatio;
+    int candidate;
+};
+
+// A coprime height:base ratio whose pyramids beat the threshold, and the multiples of it
+// inside the bounds.
+struct SolvedRatio
+{
+    int reducedHeight;
+    int reducedBaseLength;
+    int64_t firstMultiple;
+    int64_t lastMultiple;
+    double relativeErrorSum;
+};
+
+struct RatioSolverResult
+{
+    // In increasing ratio order.
+    std::vector<SolvedRatio> ratios;
+    int64_t pyramidCount;
+
+    std::vector<RatioInterval> candidateIntervals;
+    int64_t evaluatedRatioCount;
+};
+
+// Every quantity GetClosest compares is a ratio within a group, so it depends on the height to
+// base ratio t alone, and a candidate's value is a continuous function of t. Each varying pair
+// is sampled over the ratio window, with extra samples at its turning points, so the pair is
+// monotone between neighbouring samples and the ratios where a candidate comes within a
+// tolerance of a target are found by bisection.
+//
+// A pyramid can only have a relative error sum below a threshold where every combined target
+// has a match within the threshold. Solve intersects those ratio intervals and evaluates only
+// the coprime ratios inside them, exactly as the sweep does, so it finds the same pyramids
+// without visiting the rest of the grid. Intervals are rounded outwards, so they never miss a
+// ratio; the exact evaluation decides.
+//
+// Square pyramids only: the candidates are ClosestKernel's.
+class RatioSolver
+{
+public:
+    explicit RatioSolver(const SweepOptions& options);
+
+    std::vector<ExactHit> FindExactHits(size_t target) const;
+
+    // The ratios of the window where target's closest match has a relative error of at most
+    // relativeTolerance, as sorted disjoint intervals.
+    std::vector<RatioInterval> FindToleranceIntervals(size_t target, double relativeTolerance) const;
+
+    // The ratios where every combined target is within maxRelativeErrorSum.
+    std::vector<RatioInterval> FindCandidateIntervals(double maxRelativeErrorSum) const;
+
+    // Every pyramid inside the bounds of options whose relative error sum is below
+    // maxRelativeErrorSum, the sweep's test for beating Khufu.
+    RatioSolverResult Solve(double maxRelativeErrorSum) const;
+
+private:
+    static constexpr int BASE_SAMPLE_COUNT = 4096;
+    static constexpr int BISECTION_STEPS = 200;
+    // Widens every tolerance for the rounding between a pyramid's own dimensions and those of
+    // FromHeightToBaseRatio.
+    static constexpr double TOLERANCE_GUARD = 1.0E-12;
+    // Candidate intervals are cut into pieces no wider than this to spread them over threads.
+    static constexpr double MAX_PIECE_WIDTH = 1.0 / 1024.0;
+
+    // A varying pair's ratio sampled at ratios[i].
+    struct PairCurve
+    {
+        int firstCandidate;
+        PyramidDimension numerator;
+        PyramidDimension denominator;
+        std::vector<double> ratios;
+        std::vector<double> values;
+    };
+
+    SweepOptions options;
+    SweepEngine bounds;
+    double minRatio;
+    double maxRatio;
+    std::vector<PairCurve> curves;
+    std::vector<int> invariantCandidates;
+
+    double CalculatePairValue(const PairCurve& curve, double heightToBaseRatio) const;
+    double FindCrossing(const PairCurve& curve, double outside, double other, double value) const;
+    void AddTurningPoints(PairCurve& curve) const;
+    void FindPreimage(const PairCurve& curve, double low, double high, std::vector<RatioInterval>& intervals) const;
+    void SolvePiece(RatioInterval piece, bool includeHigh, double maxRelativeErrorSum, std::vector<SolvedRatio>& ratios, int64_t& evaluatedRatioCount) const;
+};
+
+#endif
\ No newline at end of file
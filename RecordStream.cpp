@@ -0,0 +1,386 @@
+#include "RecordStream.h"
+
+#include <cstring>
+#include <utility>
+
+namespace
+{
+
+struct BlockHeader
+{
+    uint32_t magic;
+    uint32_t recordCount;
+    uint64_t columnBytes;
+};
+
+size_t PadTo8(size_t bytes)
+{
+    return (bytes + 7) & ~(size_t) 7;
+}
+
+template <typename T>
+void WriteColumn(std::FILE* file, const std::vector<T>& column)
+{
+    static const char padding[8] = {};
+    size_t bytes = column.size() * sizeof(T);
+    std::fwrite(column.data(), 1, bytes, file);
+    std::fwrite(padding, 1, PadTo8(bytes) - bytes, file);
+}
+
+template <typename T>
+const T* ReadColumn(const uint8_t*& position, uint32_t recordCount)
+{
+    const T* column = (const T*) position;
+    position += PadTo8(recordCount * sizeof(T));
+    return column;
+}
+
+size_t GetColumnBytes(uint32_t recordCount, size_t targetCount)
+{
+    size_t recordColumns = 4 * PadTo8(recordCount * sizeof(int32_t)) + PadTo8(recordCount * sizeof(double));
+    size_t targetColumns = 2 * PadTo8(recordCount * sizeof(double)) + 3 * PadTo8(recordCount * sizeof(uint8_t));
+    return recordColumns + targetCount * targetColumns;
+}
+
+}
+
+RecordBlock::RecordBlock(size_t targetCount):
+    targetColumns(targetCount)
+{
+}
+
+size_t RecordBlock::GetSize() const
+{
+    return baseLength.size();
+}
+
+bool RecordBlock::IsFull() const
+{
+    return baseLength.size() >= RecordStream::BLOCK_RECORD_COUNT;
+}
+
+void RecordBlock::Clear()
+{
+    baseLength.clear();
+    height.clear();
+    reducedBaseLength.clear();
+    reducedHeight.clear();
+    relativeErrorSum.clear();
+    for (TargetColumns& columns : targetColumns)
+    {
+        columns.value.clear();
+        columns.relativeError.clear();
+        columns.dimension1.clear();
+        columns.dimension2.clear();
+        columns.factorIndex.clear();
+    }
+}
+
+void RecordBlock::Append(int baseLength, int height, int reducedBaseLength, int reducedHeight, double relativeErrorSum)
+{
+    this->baseLength.push_back(baseLength);
+    this->height.push_back(height);
+    this->reducedBaseLength.push_back(reducedBaseLength);
+    this->reducedHeight.push_back(reducedHeight);
+    this->relativeErrorSum.push_back(relativeErrorSum);
+}
+
+void RecordBlock::SetTarget(size_t target, double value, double relativeError, int dimension1, int dimension2, int factorIndex)
+{
+    TargetColumns& columns = targetColumns[target];
+    columns.value.push_back(value);
+    columns.relativeError.push_back(relativeError);
+    columns.dimension1.push_back((uint8_t) dimension1);
+    columns.dimension2.push_back((uint8_t) dimension2);
+    columns.factorIndex.push_back((uint8_t) factorIndex);
+}
+
+void RecordBlock::Write(std::FILE* file) const
+{
+    BlockHeader header = { RecordStream::BLOCK_MAGIC, (uint32_t) GetSize(), (uint64_t) GetColumnBytes((uint32_t) GetSize(), targetColumns.size()) };
+    std::fwrite(&header, sizeof(header), 1, file);
+
+    WriteColumn(file, baseLength);
+    WriteColumn(file, height);
+    WriteColumn(file, reducedBaseLength);
+    WriteColumn(file, reducedHeight);
+    WriteColumn(file, relativeErrorSum);
+    for (const TargetColumns& columns : targetColumns)
+    {
+        WriteColumn(file, columns.value);
+        WriteColumn(file, columns.relativeError);
+        WriteColumn(file, columns.dimension1);
+        WriteColumn(file, columns.dimension2);
+        WriteColumn(file, columns.factorIndex);
+    }
+}
+
+RecordStreamWriter::RecordStreamWriter():
+    file(nullptr),
+    targetCount(0),
+    closing(false),
+    writeFailed(false),
+    recordCount(0)
+{
+}
+
+RecordStreamWriter::~RecordStreamWriter()
+{
+    std::string error;
+    Close(error);
+}
+
+bool RecordStreamWriter::Open(const std::string& path, const TargetCatalog& targets, std::string& error)
+{
+    file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        error = "cannot open record file " + path;
+        return false;
+    }
+
+    this->path = path;
+    targetCount = targets.GetSize();
+    writeBuffer.resize(WRITE_BUFFER_SIZE);
+    std::setvbuf(file, writeBuffer.data(), _IOFBF, writeBuffer.size());
+
+    uint32_t version = RecordStream::VERSION;
+    uint32_t storedTargetCount = (uint32_t) targetCount;
+    std::fwrite(RecordStream::FILE_MAGIC, 1, sizeof(RecordStream::FILE_MAGIC), file);
+    std::fwrite(&version, sizeof(version), 1, file);
+    std::fwrite(&storedTargetCount, sizeof(storedTargetCount), 1, file);
+    for (const Target& target : targets.GetTargets())
+    {
+        static const char padding[8] = {};
+        uint32_t nameLength = (uint32_t) target.name.size();
+        std::fwrite(&target.value, sizeof(target.value), 1, file);
+        std::fwrite(&nameLength, sizeof(nameLength), 1, file);
+        std::fwrite(target.name.data(), 1, nameLength, file);
+        std::fwrite(padding, 1, PadTo8(sizeof(nameLength) + nameLength) - (sizeof(nameLength) + nameLength), file);
+    }
+
+    closing = false;
+    writeFailed = false;
+    recordCount = 0;
+    writerThread = std::thread(&RecordStreamWriter::WriteBlocks, this);
+    return true;
+}
+
+void RecordStreamWriter::Submit(RecordBlock& block)
+{
+    if (block.GetSize() == 0)
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    pendingChanged.wait(lock, [this] { return pendingBlocks.size() < MAX_PENDING_BLOCKS; });
+
+    RecordBlock next(targetCount);
+    if (!freeBlocks.empty())
+    {
+        next = std::move(freeBlocks.back());
+        freeBlocks.pop_back();
+    }
+
+    recordCount += block.GetSize();
+    pendingBlocks.push_back(std::move(block));
+    block = std::move(next);
+    pendingChanged.notify_all();
+}
+
+void RecordStreamWriter::WriteBlocks()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        pendingChanged.wait(lock, [this] { return !pendingBlocks.empty() || closing; });
+        if (pendingBlocks.empty())
+        {
+            return;
+        }
+
+        RecordBlock block = std::move(pendingBlocks.front());
+        pendingBlocks.pop_front();
+        pendingChanged.notify_all();
+
+        lock.unlock();
+        block.Write(file);
+        bool failed = std::ferror(file) != 0;
+        block.Clear();
+        lock.lock();
+
+        writeFailed = writeFailed || failed;
+        freeBlocks.push_back(std::move(block));
+    }
+}
+
+bool RecordStreamWriter::Close(std::string& error)
+{
+    if (file == nullptr)
+    {
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    pendingChanged.notify_all();
+    writerThread.join();
+
+    bool failed = writeFailed || std::fclose(file) != 0;
+    file = nullptr;
+    freeBlocks.clear();
+
+    if (failed)
+    {
+        error = "writing record file " + path + " failed";
+        return false;
+    }
+
+    return true;
+}
+
+uint64_t RecordStreamWriter::GetRecordCount() const
+{
+    return recordCount;
+}
+
+RecordStreamReader::RecordStreamReader():
+    recordCount(0)
+{
+}
+
+RecordStreamReader::~RecordStreamReader()
+{
+    Close();
+}
+
+bool RecordStreamReader::Open(const std::string& path, std::string& error)
+{
+    Close();
+
+    if (!file.Open(path, "record file", error))
+    {
+        return false;
+    }
+
+    if (!Parse(error))
+    {
+        Close();
+        error = path + ": " + error;
+        return false;
+    }
+
+    return true;
+}
+
+void RecordStreamReader::Close()
+{
+    file.Close();
+    targets.clear();
+    blocks.clear();
+    recordCount = 0;
+}
+
+bool RecordStreamReader::Parse(std::string& error)
+{
+    const uint8_t* data = file.GetData();
+    const uint8_t* position = data;
+    const uint8_t* end = data + file.GetSize();
+
+    uint32_t version;
+    uint32_t targetCount;
+    if (file.GetSize() < sizeof(RecordStream::FILE_MAGIC) + 2 * sizeof(uint32_t) || std::memcmp(position, RecordStream::FILE_MAGIC, sizeof(RecordStream::FILE_MAGIC)) != 0)
+    {
+        error = "not a record file";
+        return false;
+    }
+    position += sizeof(RecordStream::FILE_MAGIC);
+    std::memcpy(&version, position, sizeof(version));
+    std::memcpy(&targetCount, position + sizeof(version), sizeof(targetCount));
+    position += sizeof(version) + sizeof(targetCount);
+    if (version != RecordStream::VERSION)
+    {
+        error = "unsupported record file version " + std::to_string(version);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < targetCount; ++i)
+    {
+        Target target;
+        uint32_t nameLength;
+        if (end - position < (ptrdiff_t) (sizeof(double) + sizeof(nameLength)))
+        {
+            error = "truncated target list";
+            return false;
+        }
+        std::memcpy(&target.value, position, sizeof(double));
+        std::memcpy(&nameLength, position + sizeof(double), sizeof(nameLength));
+        position += sizeof(double);
+        if ((size_t) (end - position) < PadTo8(sizeof(nameLength) + nameLength))
+        {
+            error = "truncated target list";
+            return false;
+        }
+        target.name.assign((const char*) position + sizeof(nameLength), nameLength);
+        target.inCombinedSum = false;
+        position += PadTo8(sizeof(nameLength) + nameLength);
+        targets.push_back(target);
+    }
+
+    while (position < end)
+    {
+        BlockHeader header;
+        if ((size_t) (end - position) < sizeof(header))
+        {
+            error = "truncated block header";
+            return false;
+        }
+        std::memcpy(&header, position, sizeof(header));
+        position += sizeof(header);
+        if (header.magic != RecordStream::BLOCK_MAGIC || header.columnBytes != GetColumnBytes(header.recordCount, targetCount) ||
+            (uint64_t) (end - position) < header.columnBytes)
+        {
+            error = "corrupt block at offset " + std::to_string(position - sizeof(header) - data);
+            return false;
+        }
+
+        RecordBlockView block;
+        block.recordCount = header.recordCount;
+        block.baseLength = ReadColumn<int32_t>(position, header.recordCount);
+        block.height = ReadColumn<int32_t>(position, header.recordCount);
+        block.reducedBaseLength = ReadColumn<int32_t>(position, header.recordCount);
+        block.reducedHeight = ReadColumn<int32_t>(position, header.recordCount);
+        block.relativeErrorSum = ReadColumn<double>(position, header.recordCount);
+        for (uint32_t i = 0; i < targetCount; ++i)
+        {
+            block.value.push_back(ReadColumn<double>(position, header.recordCount));
+            block.relativeError.push_back(ReadColumn<double>(position, header.recordCount));
+            block.dimension1.push_back(ReadColumn<uint8_t>(position, header.recordCount));
+            block.dimension2.push_back(ReadColumn<uint8_t>(position, header.recordCount));
+            block.factorIndex.push_back(ReadColumn<uint8_t>(position, header.recordCount));
+        }
+
+        recordCount += header.recordCount;
+        blocks.push_back(std::move(block));
+    }
+
+    return true;
+}
+
+const std::vector<Target>& RecordStreamReader::GetTargets() const
+{
+    return targets;
+}
+
+const std::vector<RecordBlockView>& RecordStreamReader::GetBlocks() const
+{
+    return blocks;
+}
+
+uint64_t RecordStreamReader::GetRecordCount() const
+{
+    return recordCount;
+}
\ No newline at end of file
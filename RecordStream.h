@@ -0,0 +1,157 @@
+#ifndef RECORD_STREAM_H_
+#define RECORD_STREAM_H_
+
+#include "MappedFile.h"
+#include "TargetCatalog.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Per-pyramid sweep results in a columnar, append-only binary file, native byte order.
+//
+//   file header:  char magic[8] = "PYRREC1", uint32 version, uint32 targetCount, then per
+//                 target: double value, uint32 nameLength, name bytes, zero padding to 8
+//   block:        uint32 blockMagic, uint32 recordCount, uint64 columnBytes, then the columns
+//                 baseLength, height, reducedBaseLength, reducedHeight (int32),
+//                 relativeErrorSum (double), and per target value, relativeError (double),
+//                 dimension1, dimension2, factorIndex (uint8), each padded to 8 bytes
+//
+// Blocks come from the sweep threads in whatever order they fill up, so records are not
+// sorted. Every column starts 8-byte aligned, which lets a reader use it straight from a
+// memory-mapped file.
+namespace RecordStream
+{
+
+constexpr char FILE_MAGIC[8] = { 'P', 'Y', 'R', 'R', 'E', 'C', '1', '\0' };
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t BLOCK_MAGIC = 0x314b4c42; // "BLK1"
+constexpr size_t BLOCK_RECORD_COUNT = 1 << 16;
+
+}
+
+// One block's worth of records being filled by a sweep thread.
+class RecordBlock
+{
+public:
+    explicit RecordBlock(size_t targetCount = 0);
+
+    size_t GetSize() const;
+    bool IsFull() const;
+    void Clear();
+
+    // Starts a record; the per-target columns are filled with SetTarget.
+    void Append(int baseLength, int height, int reducedBaseLength, int reducedHeight, double relativeErrorSum);
+    void SetTarget(size_t target, double value, double relativeError, int dimension1, int dimension2, int factorIndex);
+
+    void Write(std::FILE* file) const;
+
+private:
+    struct TargetColumns
+    {
+        std::vector<double> value;
+        std::vector<double> relativeError;
+        std::vector<uint8_t> dimension1;
+        std::vector<uint8_t> dimension2;
+        std::vector<uint8_t> factorIndex;
+    };
+
+    std::vector<int32_t> baseLength;
+    std::vector<int32_t> height;
+    std::vector<int32_t> reducedBaseLength;
+    std::vector<int32_t> reducedHeight;
+    std::vector<double> relativeErrorSum;
+    std::vector<TargetColumns> targetColumns;
+};
+
+// Writes blocks on a background thread, so the sweep threads only hand over full blocks and
+// never wait on formatting or disk unless the writer falls MAX_PENDING_BLOCKS behind.
+class RecordStreamWriter
+{
+public:
+    RecordStreamWriter();
+    ~RecordStreamWriter();
+
+    bool Open(const std::string& path, const TargetCatalog& targets, std::string& error);
+
+    // Queues block for writing and swaps in an empty one to fill next.
+    void Submit(RecordBlock& block);
+
+    // Writes what is queued and closes the file. Returns false if any write failed.
+    bool Close(std::string& error);
+
+    uint64_t GetRecordCount() const;
+
+private:
+    static constexpr size_t MAX_PENDING_BLOCKS = 8;
+    static constexpr size_t WRITE_BUFFER_SIZE = 1 << 22;
+
+    std::FILE* file;
+    std::string path;
+    size_t targetCount;
+    std::vector<char> writeBuffer;
+    std::thread writerThread;
+
+    std::mutex mutex;
+    std::condition_variable pendingChanged;
+    std::deque<RecordBlock> pendingBlocks;
+    std::vector<RecordBlock> freeBlocks;
+    bool closing;
+    bool writeFailed;
+    uint64_t recordCount;
+
+    void WriteBlocks();
+};
+
+// Zero-copy views of one block's columns inside a mapped file.
+struct RecordBlockView
+{
+public:
+    uint32_t recordCount;
+    const int32_t* baseLength;
+    const int32_t* height;
+    const int32_t* reducedBaseLength;
+    const int32_t* reducedHeight;
+    const double* relativeErrorSum;
+
+    // Indexed by target.
+    std::vector<const double*> value;
+    std::vector<const double*> relativeError;
+    std::vector<const uint8_t*> dimension1;
+    std::vector<const uint8_t*> dimension2;
+    std::vector<const uint8_t*> factorIndex;
+};
+
+// Maps a record file read-only and indexes its blocks.
+class RecordStreamReader
+{
+public:
+    RecordStreamReader();
+    ~RecordStreamReader();
+
+    RecordStreamReader(const RecordStreamReader&) = delete;
+    RecordStreamReader& operator=(const RecordStreamReader&) = delete;
+
+    bool Open(const std::string& path, std::string& error);
+    void Close();
+
+    const std::vector<Target>& GetTargets() const;
+    const std::vector<RecordBlockView>& GetBlocks() const;
+    uint64_t GetRecordCount() const;
+
+private:
+    MappedFile file;
+
+    std::vector<Target> targets;
+    std::vector<RecordBlockView> blocks;
+    uint64_t recordCount;
+
+    bool Parse(std::string& error);
+};
+
+#endif
\ No newline at end of file
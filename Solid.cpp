@@ -0,0 +1,71 @@
+#include "Solid.h"
+#include "PyramidBatch.h"
+
+#include <cmath>
+#include <type_traits>
+
+namespace
+{
+
+constexpr double PI = 3.14159265358979323846;
+
+double Sqrt(double x)
+{
+    return std::sqrt(x);
+}
+
+double Square(double x)
+{
+    return x * x;
+}
+
+double Atan(double x)
+{
+    return PyramidBatch::Atan(x);
+}
+
+}
+
+#define CALCULATE_DIMENSION(name, group, formula) DIMENSION(name) = formula;
+#define DIMENSION(name) dimensions[(int) Dimension::name]
+
+void SquarePyramidShape::Calculate(int baseLength, int height, double* dimensions) const
+{
+    Pyramid pyramid(baseLength, height);
+    std::copy(pyramid.GetDimensions().begin(), pyramid.GetDimensions().end(), dimensions);
+}
+
+template <int SIDES>
+void RegularPyramidShape<SIDES>::Calculate(int baseLength, int height, double* dimensions) const
+{
+    const double apothemFactor = 0.5 / std::tan(PI / SIDES);
+    const double circumradiusFactor = 0.5 / std::sin(PI / SIDES);
+    REGULAR_PYRAMID_DIMENSIONS(CALCULATE_DIMENSION)
+}
+
+template struct RegularPyramidShape<3>;
+template struct RegularPyramidShape<6>;
+
+void ConeShape::Calculate(int baseLength, int height, double* dimensions) const
+{
+    CONE_DIMENSIONS(CALCULATE_DIMENSION)
+}
+
+void SquareFrustumShape::Calculate(int baseLength, int height, double* dimensions) const
+{
+    SQUARE_FRUSTUM_DIMENSIONS(CALCULATE_DIMENSION)
+}
+
+#undef DIMENSION
+#undef CALCULATE_DIMENSION
+
+double CalculateSolidVolumeFactor(SolidShape shape, double frustumTopFraction)
+{
+    return VisitSolidShape(shape, frustumTopFraction, [](const auto& solid)
+    {
+        using Shape = typename std::decay<decltype(solid)>::type;
+        double dimensions[Shape::DIMENSION_COUNT];
+        solid.Calculate(1, 1, dimensions);
+        return dimensions[(int) Shape::Dimension::VOLUME];
+    });
+}
\ No newline at end of file
@@ -0,0 +1,373 @@
+#ifndef SOLID_H_
+#define SOLID_H_
+
+#include "ClosestKernel.h"
+#include "Pyramid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// The solids the sweep can score. Every solid is given by a base length and a height: the
+// side of the base for the pyramids and the frustum (the bottom side), the diameter for the
+// cone.
+enum class SolidShape
+{
+    SQUARE_PYRAMID = 0,
+    TRIANGULAR_PYRAMID,
+    HEXAGONAL_PYRAMID,
+    CONE,
+    SQUARE_FRUSTUM
+};
+
+constexpr const char* const SolidShapeStrings[] =
+{
+    "square",
+    "triangular",
+    "hexagonal",
+    "cone",
+    "frustum"
+};
+
+// A shape type lists its dimensions the way PYRAMID_DIMENSIONS does, as X(NAME, GROUP,
+// formula), and provides
+//
+//   enum class Dimension { ..., VOLUME }            the dimensions, VOLUME last
+//   static constexpr int DIMENSION_COUNT
+//   static constexpr DimensionGroupName GROUPS[]   the group of each dimension
+//   void Calculate(int baseLength, int height, double* dimensions) const
+//
+// Every dimension in a group must scale with the same power of the size, so that all
+// multiples of a height:base ratio have the same closest matches, which the sweep relies on.
+#define SOLID_DIMENSION_ENUM_ENTRY(name, group, formula) name,
+#define SOLID_DIMENSION_GROUP_ENTRY(name, group, formula) DimensionGroupName::group,
+
+// Pyramid's dimensions, so the generic search can be checked against ClosestKernel.
+struct SquarePyramidShape
+{
+    using Dimension = PyramidDimension;
+    static constexpr int DIMENSION_COUNT = PYRAMID_DIMENSION_COUNT;
+    static constexpr const DimensionGroupName* GROUPS = PYRAMID_DIMENSION_GROUPS;
+
+    void Calculate(int baseLength, int height, double* dimensions) const;
+};
+
+// A right pyramid on a regular SIDES-gon. The cross sections go through the apex and a base
+// apothem, and through the apex and a base corner.
+#define REGULAR_PYRAMID_DIMENSIONS(X) \
+    X(SIDE_LENGTH, LENGTHS, baseLength) \
+    X(HEIGHT, LENGTHS, height) \
+    X(BASE_PERIMETER, LENGTHS, SIDES * DIMENSION(SIDE_LENGTH)) \
+    X(APOTHEM, LENGTHS, apothemFactor * DIMENSION(SIDE_LENGTH)) \
+    X(CIRCUMRADIUS, LENGTHS, circumradiusFactor * DIMENSION(SIDE_LENGTH)) \
+    X(SLANT_LENGTH, LENGTHS, Sqrt(Square(DIMENSION(APOTHEM)) + Square(DIMENSION(HEIGHT)))) \
+    X(LATERAL_EDGE_LENGTH, LENGTHS, Sqrt(Square(DIMENSION(CIRCUMRADIUS)) + Square(DIMENSION(HEIGHT)))) \
+    X(APOTHEM_CROSS_SECTION_CORNER_ANGLE, ANGLES1, Atan(DIMENSION(HEIGHT) / DIMENSION(APOTHEM))) \
+    X(APOTHEM_CROSS_SECTION_VERTEX_ANGLE, ANGLES1, 2.0 * Atan(DIMENSION(APOTHEM) / DIMENSION(HEIGHT))) \
+    X(LATERAL_FACE_CORNER_ANGLE, ANGLES2, Atan(DIMENSION(SLANT_LENGTH) / (0.5 * DIMENSION(SIDE_LENGTH)))) \
+    X(LATERAL_FACE_VERTEX_ANGLE, ANGLES2, 2.0 * Atan(0.5 * DIMENSION(SIDE_LENGTH) / DIMENSION(SLANT_LENGTH))) \
+    X(CORNER_CROSS_SECTION_CORNER_ANGLE, ANGLES3, Atan(DIMENSION(HEIGHT) / DIMENSION(CIRCUMRADIUS))) \
+    X(CORNER_CROSS_SECTION_VERTEX_ANGLE, ANGLES3, 2.0 * Atan(DIMENSION(CIRCUMRADIUS) / DIMENSION(HEIGHT))) \
+    X(BASE_AREA, AREAS, 0.5 * DIMENSION(BASE_PERIMETER) * DIMENSION(APOTHEM)) \
+    X(LATERAL_FACE_AREA, AREAS, DIMENSION(SIDE_LENGTH) * DIMENSION(SLANT_LENGTH) * 0.5) \
+    X(SURFACE_AREA_NOT_INCLUDING_BASE, AREAS, SIDES * DIMENSION(LATERAL_FACE_AREA)) \
+    X(SURFACE_AREA_INCLUDING_BASE, AREAS, SIDES * DIMENSION(LATERAL_FACE_AREA) + DIMENSION(BASE_AREA)) \
+    X(VOLUME, UNGROUPED, DIMENSION(BASE_AREA) * DIMENSION(HEIGHT) / 3.0)
+
+template <int SIDES>
+struct RegularPyramidShape
+{
+    enum class Dimension
+    {
+        REGULAR_PYRAMID_DIMENSIONS(SOLID_DIMENSION_ENUM_ENTRY)
+    };
+
+    static constexpr int DIMENSION_COUNT = (int) Dimension::VOLUME + 1;
+    static constexpr DimensionGroupName GROUPS[] = { REGULAR_PYRAMID_DIMENSIONS(SOLID_DIMENSION_GROUP_ENTRY) };
+
+    void Calculate(int baseLength, int height, double* dimensions) const;
+};
+
+// A right circular cone; its base length is the diameter.
+#define CONE_DIMENSIONS(X) \
+    X(DIAMETER, LENGTHS, baseLength) \
+    X(HEIGHT, LENGTHS, height) \
+    X(RADIUS, LENGTHS, 0.5 * DIMENSION(DIAMETER)) \
+    X(CIRCUMFERENCE, LENGTHS, PI * DIMENSION(DIAMETER)) \
+    X(SLANT_LENGTH, LENGTHS, Sqrt(Square(DIMENSION(RADIUS)) + Square(DIMENSION(HEIGHT)))) \
+    X(CROSS_SECTION_CORNER_ANGLE, ANGLES1, Atan(DIMENSION(HEIGHT) / DIMENSION(RADIUS))) \
+    X(CROSS_SECTION_VERTEX_ANGLE, ANGLES1, 2.0 * Atan(DIMENSION(RADIUS) / DIMENSION(HEIGHT))) \
+    X(BASE_AREA, AREAS, PI * Square(DIMENSION(RADIUS))) \
+    X(LATERAL_SURFACE_AREA, AREAS, PI * DIMENSION(RADIUS) * DIMENSION(SLANT_LENGTH)) \
+    X(SURFACE_AREA_INCLUDING_BASE, AREAS, DIMENSION(LATERAL_SURFACE_AREA) + DIMENSION(BASE_AREA)) \
+    X(VOLUME, UNGROUPED, DIMENSION(BASE_AREA) * DIMENSION(HEIGHT) / 3.0)
+
+struct ConeShape
+{
+    enum class Dimension
+    {
+        CONE_DIMENSIONS(SOLID_DIMENSION_ENUM_ENTRY)
+    };
+
+    static constexpr int DIMENSION_COUNT = (int) Dimension::VOLUME + 1;
+    static constexpr DimensionGroupName GROUPS[] = { CONE_DIMENSIONS(SOLID_DIMENSION_GROUP_ENTRY) };
+
+    void Calculate(int baseLength, int height, double* dimensions) const;
+};
+
+// A square pyramid cut parallel to the base; the top side is topFraction of the bottom side.
+// The angles are those at the bottom and at the top edge of each cross section.
+#define SQUARE_FRUSTUM_DIMENSIONS(X) \
+    X(BASE_LENGTH, LENGTHS, baseLength) \
+    X(HEIGHT, LENGTHS, height) \
+    X(TOP_LENGTH, LENGTHS, topFraction * DIMENSION(BASE_LENGTH)) \
+    X(BASE_PERIMETER, LENGTHS, 4.0 * DIMENSION(BASE_LENGTH)) \
+    X(TOP_PERIMETER, LENGTHS, 4.0 * DIMENSION(TOP_LENGTH)) \
+    X(BASE_DIAGONAL, LENGTHS, std::sqrt(2.0) * DIMENSION(BASE_LENGTH)) \
+    X(SLANT_LENGTH, LENGTHS, Sqrt(Square(0.5 * (DIMENSION(BASE_LENGTH) - DIMENSION(TOP_LENGTH))) + Square(DIMENSION(HEIGHT)))) \
+    X(LATERAL_EDGE_LENGTH, LENGTHS, Sqrt(Square(0.5 * (DIMENSION(BASE_LENGTH) - DIMENSION(TOP_LENGTH))) + Square(DIMENSION(SLANT_LENGTH)))) \
+    X(CROSS_SECTION_BASE_ANGLE, ANGLES1, Atan(DIMENSION(HEIGHT) / (0.5 * (DIMENSION(BASE_LENGTH) - DIMENSION(TOP_LENGTH))))) \
+    X(CROSS_SECTION_TOP_ANGLE, ANGLES1, PI - DIMENSION(CROSS_SECTION_BASE_ANGLE)) \
+    X(LATERAL_FACE_BASE_ANGLE, ANGLES2, Atan(DIMENSION(SLANT_LENGTH) / (0.5 * (DIMENSION(BASE_LENGTH) - DIMENSION(TOP_LENGTH))))) \
+    X(LATERAL_FACE_TOP_ANGLE, ANGLES2, PI - DIMENSION(LATERAL_FACE_BASE_ANGLE)) \
+    X(DIAGONAL_CROSS_SECTION_BASE_ANGLE, ANGLES3, Atan(DIMENSION(HEIGHT) / (std::sqrt(0.5) * (DIMENSION(BASE_LENGTH) - DIMENSION(TOP_LENGTH))))) \
+    X(DIAGONAL_CROSS_SECTION_TOP_ANGLE, ANGLES3, PI - DIMENSION(DIAGONAL_CROSS_SECTION_BASE_ANGLE)) \
+    X(BASE_AREA, AREAS, Square(DIMENSION(BASE_LENGTH))) \
+    X(TOP_AREA, AREAS, Square(DIMENSION(TOP_LENGTH))) \
+    X(LATERAL_FACE_AREA, AREAS, 0.5 * (DIMENSION(BASE_LENGTH) + DIMENSION(TOP_LENGTH)) * DIMENSION(SLANT_LENGTH)) \
+    X(SURFACE_AREA_NOT_INCLUDING_BASE, AREAS, 4.0 * DIMENSION(LATERAL_FACE_AREA) + DIMENSION(TOP_AREA)) \
+    X(SURFACE_AREA_INCLUDING_BASE, AREAS, 4.0 * DIMENSION(LATERAL_FACE_AREA) + DIMENSION(TOP_AREA) + DIMENSION(BASE_AREA)) \
+    X(VOLUME, UNGROUPED, DIMENSION(HEIGHT) * (DIMENSION(BASE_AREA) + DIMENSION(BASE_LENGTH) * DIMENSION(TOP_LENGTH) + DIMENSION(TOP_AREA)) / 3.0)
+
+struct SquareFrustumShape
+{
+    enum class Dimension
+    {
+        SQUARE_FRUSTUM_DIMENSIONS(SOLID_DIMENSION_ENUM_ENTRY)
+    };
+
+    static constexpr int DIMENSION_COUNT = (int) Dimension::VOLUME + 1;
+    static constexpr DimensionGroupName GROUPS[] = { SQUARE_FRUSTUM_DIMENSIONS(SOLID_DIMENSION_GROUP_ENTRY) };
+
+    // In (0, 1).
+    double topFraction;
+
+    void Calculate(int baseLength, int height, double* dimensions) const;
+};
+
+static_assert(AreDimensionGroupsContiguous(RegularPyramidShape<3>::GROUPS, RegularPyramidShape<3>::DIMENSION_COUNT), "the dimensions of a group must be listed next to each other");
+static_assert(AreDimensionGroupsContiguous(ConeShape::GROUPS, ConeShape::DIMENSION_COUNT), "the dimensions of a group must be listed next to each other");
+static_assert(AreDimensionGroupsContiguous(SquareFrustumShape::GROUPS, SquareFrustumShape::DIMENSION_COUNT), "the dimensions of a group must be listed next to each other");
+
+// Calls visit with the shape object for shape, so whatever visit does is compiled once per
+// shape type and dispatched once per call instead of once per dimension.
+template <typename Visitor>
+auto VisitSolidShape(SolidShape shape, double frustumTopFraction, Visitor&& visit)
+{
+    switch (shape)
+    {
+    case SolidShape::TRIANGULAR_PYRAMID:
+        return visit(RegularPyramidShape<3>());
+    case SolidShape::HEXAGONAL_PYRAMID:
+        return visit(RegularPyramidShape<6>());
+    case SolidShape::CONE:
+        return visit(ConeShape());
+    case SolidShape::SQUARE_FRUSTUM:
+        return visit(SquareFrustumShape{ frustumTopFraction });
+    default:
+        return visit(SquarePyramidShape());
+    }
+}
+
+// The volume of the solid with base length and height 1. Every shape's volume is this times
+// the base length squared times the height.
+double CalculateSolidVolumeFactor(SolidShape shape, double frustumTopFraction);
+
+// ClosestKernel's search over any shape's dimensions: the same candidates in the same order,
+// the invariant pairs valued once and kept sorted, and the pruned branch and bound over the
+// varying ones, with ties going to the lowest candidate number. Immutable once built, so one
+// search can be shared by every thread.
+template <typename Shape>
+class SolidClosestSearch
+{
+public:
+    explicit SolidClosestSearch(const Shape& shape);
+
+    int FindClosestCandidate(const double* dimensions, double target, ClosestKernel::SearchStatistics& statistics) const;
+    double CalculateCandidateValue(const double* dimensions, int candidate) const;
+
+private:
+    static constexpr int FACTOR_COUNT = (int) allowedFactors.size();
+
+    // Candidate c divides dimension numerator of pair c / FACTOR_COUNT by its denominator and
+    // scales the ratio by allowedFactors[c % FACTOR_COUNT].
+    struct CandidatePair
+    {
+        int numerator;
+        int denominator;
+        bool invariant;
+        double unitRatio;
+    };
+
+    // The varying pairs [pairBegin, pairEnd) of varyingPairs that belong to group.
+    struct VaryingGroup
+    {
+        DimensionGroup group;
+        int pairBegin;
+        int pairEnd;
+    };
+
+    std::vector<CandidatePair> pairs;
+    std::vector<IndexedCandidate> invariantCandidates;
+    std::vector<int> varyingPairs;
+    std::vector<VaryingGroup> varyingGroups;
+};
+
+template <typename Shape>
+SolidClosestSearch<Shape>::SolidClosestSearch(const Shape& shape)
+{
+    std::vector<std::vector<double>> probes;
+    for (const std::pair<int, int>& probe : ClosestKernel::INVARIANT_PROBES)
+    {
+        probes.emplace_back(Shape::DIMENSION_COUNT);
+        shape.Calculate(probe.first, probe.second, probes.back().data());
+    }
+
+    for (int g = 0; g < (int) DimensionGroupName::UNGROUPED; ++g)
+    {
+        VaryingGroup varyingGroup;
+        varyingGroup.group = FindDimensionGroup(Shape::GROUPS, Shape::DIMENSION_COUNT, (DimensionGroupName) g);
+        varyingGroup.pairBegin = (int) varyingPairs.size();
+        for (int i = varyingGroup.group.begin; i < varyingGroup.group.end; ++i)
+        {
+            for (int j = varyingGroup.group.begin; j < varyingGroup.group.end; ++j)
+            {
+                if (i == j)
+                {
+                    continue;
+                }
+
+                CandidatePair pair = { i, j, true, probes[0][i] / probes[0][j] };
+                for (const std::vector<double>& probe : probes)
+                {
+                    double ratio = probe[i] / probe[j];
+                    pair.invariant = pair.invariant && std::abs(ratio - pair.unitRatio) <= ClosestKernel::INVARIANT_PROBE_TOLERANCE * pair.unitRatio;
+                }
+
+                int firstCandidate = (int) pairs.size() * FACTOR_COUNT;
+                if (pair.invariant)
+                {
+                    for (int k = 0; k < FACTOR_COUNT; ++k)
+                    {
+                        invariantCandidates.push_back({ pair.unitRatio * allowedFactors[k], firstCandidate + k });
+                    }
+                }
+                else
+                {
+                    varyingPairs.push_back((int) pairs.size());
+                }
+                pairs.push_back(pair);
+            }
+        }
+        varyingGroup.pairEnd = (int) varyingPairs.size();
+
+        if (varyingGroup.pairBegin < varyingGroup.pairEnd)
+        {
+            varyingGroups.push_back(varyingGroup);
+        }
+    }
+
+    std::sort(invariantCandidates.begin(), invariantCandidates.end(), [](const IndexedCandidate& a, const IndexedCandidate& b)
+    {
+        return a.value < b.value || (a.value == b.value && a.candidate < b.candidate);
+    });
+}
+
+template <typename Shape>
+double SolidClosestSearch<Shape>::CalculateCandidateValue(const double* dimensions, int candidate) const
+{
+    const CandidatePair& pair = pairs[candidate / FACTOR_COUNT];
+    if (pair.invariant)
+    {
+        return pair.unitRatio * allowedFactors[candidate % FACTOR_COUNT];
+    }
+
+    double ratio = dimensions[pair.numerator] / dimensions[pair.denominator];
+    return ratio * allowedFactors[candidate % FACTOR_COUNT];
+}
+
+template <typename Shape>
+int SolidClosestSearch<Shape>::FindClosestCandidate(const double* dimensions, double target, ClosestKernel::SearchStatistics& statistics) const
+{
+    int closest = ClosestKernel::FindClosestInSorted(invariantCandidates.data(), (int) invariantCandidates.size(), target);
+    double minAbsoluteError = closest < 0 ? std::numeric_limits<double>::max() : std::abs(CalculateCandidateValue(dimensions, closest) - target);
+
+    int64_t evaluatedCount = 0;
+    auto consider = [&](double value, int candidate)
+    {
+        ++evaluatedCount;
+        double absoluteError = std::abs(value - target);
+        if (absoluteError < minAbsoluteError || (absoluteError == minAbsoluteError && candidate < closest))
+        {
+            closest = candidate;
+            minAbsoluteError = absoluteError;
+        }
+        return absoluteError;
+    };
+
+    // See FindClosestCandidate_Pruned in ClosestKernel.cpp.
+    auto distanceToInterval = [target](double low, double high)
+    {
+        return target < low ? low - target : (target > high ? target - high : 0.0);
+    };
+
+    const double lowestFactor = allowedFactors[0];
+    const double highestFactor = allowedFactors[FACTOR_COUNT - 1];
+    for (const VaryingGroup& varyingGroup : varyingGroups)
+    {
+        const DimensionGroup& group = varyingGroup.group;
+        double minDimension = *std::min_element(dimensions + group.begin, dimensions + group.end);
+        double maxDimension = *std::max_element(dimensions + group.begin, dimensions + group.end);
+        if (distanceToInterval((minDimension / maxDimension) * lowestFactor, (maxDimension / minDimension) * highestFactor) > minAbsoluteError)
+        {
+            continue;
+        }
+
+        for (int p = varyingGroup.pairBegin; p < varyingGroup.pairEnd; ++p)
+        {
+            const CandidatePair& pair = pairs[varyingPairs[p]];
+            double ratio = dimensions[pair.numerator] / dimensions[pair.denominator];
+            if (distanceToInterval(ratio * lowestFactor, ratio * highestFactor) > minAbsoluteError)
+            {
+                continue;
+            }
+
+            int low = (int) (std::lower_bound(allowedFactors.begin(), allowedFactors.end(), target, [ratio](double factor, double value)
+            {
+                return ratio * factor < value;
+            }) - allowedFactors.begin());
+
+            int firstCandidate = varyingPairs[p] * FACTOR_COUNT;
+            if (low < FACTOR_COUNT)
+            {
+                consider(ratio * allowedFactors[low], firstCandidate + low);
+            }
+            if (low > 0)
+            {
+                double absoluteError = consider(ratio * allowedFactors[low - 1], firstCandidate + low - 1);
+                for (int k = low - 2; k >= 0 && std::abs(ratio * allowedFactors[k] - target) == absoluteError; --k)
+                {
+                    consider(ratio * allowedFactors[k], firstCandidate + k);
+                }
+            }
+        }
+    }
+
+    statistics.evaluatedCandidateCount += evaluatedCount;
+    statistics.prunedCandidateCount += (int64_t) varyingPairs.size() * FACTOR_COUNT - evaluatedCount;
+    return closest;
+}
+
+#endif
\ No newline at end of file
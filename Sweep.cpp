@@ -0,0 +1,969 @@
+#include "Sweep.h"
+#include "AtomicFile.h"
+#include "BinaryIO.h"
+#include "CandidateIndexFile.h"
+#include "ClosestKernel.h"
+#include "Metrics.h"
+#include "RatioEvaluation.h"
+#include "WorkStealingScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+
+namespace
+{
+
+// Ratio segments are [p / SEGMENT_DENOMINATOR, (p + 1) / SEGMENT_DENOMINATOR). Their bounds are
+// exact fractions, so segments partition the Farey sequence without floating-point overlap.
+constexpr int64_t MAX_SEGMENT_DENOMINATOR = 1024;
+
+// The volume check exactly as the grid scan evaluated it.
+double CalculateSquarePyramidVolume(int64_t baseLength, int64_t height)
+{
+    return (double) baseLength * (double) baseLength * (double) height / 3.0;
+}
+
+constexpr char CHECKPOINT_MAGIC[8] = { 'P', 'Y', 'R', 'C', 'K', 'P', '2', '\0' };
+constexpr char PARTIAL_MAGIC[8] = { 'P', 'Y', 'R', 'P', 'R', 'T', '2', '\0' };
+
+// Rough relative costs of evaluating one ratio and of stepping past one Farey term, and
+// the number of base lengths sampled when integrating a segment's area.
+constexpr double RATIO_EVALUATION_COST = 200.0;
+constexpr double FAREY_TERM_COST = 1.0;
+constexpr int WORK_ESTIMATE_SAMPLES = 64;
+constexpr double PI = 3.14159265358979323846;
+
+// How many multiples [first, second] holds.
+uint64_t CountMultiples(std::pair<int64_t, int64_t> multiples)
+{
+    return multiples.first <= multiples.second ? (uint64_t) (multiples.second - multiples.first + 1) : 0;
+}
+
+// FNV-1a, to tell whether a checkpoint was written by a sweep with the same options.
+uint64_t HashBytes(const std::string& bytes)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char byte : bytes)
+    {
+        hash = (hash ^ (uint8_t) byte) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Keeps each thread's accumulator on its own cache lines.
+struct alignas(64) ThreadAccumulator
+{
+    SweepAccumulator accumulator;
+    RecordBlock records;
+};
+
+}
+
+TargetStatistics::TargetStatistics():
+    hitCount(0),
+    moreAccurateThanKhufuCount(0),
+    bestBaseLength(0),
+    bestHeight(0),
+    minRelativeError(std::numeric_limits<double>::max())
+{
+}
+
+void TargetStatistics::Add(int baseLength, int height, uint32_t count, double relativeError, double hitTolerance, double khufuRelativeError)
+{
+    relativeErrorSum.AddMultiple(relativeError, count);
+    relativeErrorSketch.AddMultiple(relativeError, count);
+
+    if (relativeError <= hitTolerance)
+    {
+        hitCount += count;
+    }
+
+    if (relativeError < khufuRelativeError)
+    {
+        moreAccurateThanKhufuCount += count;
+    }
+
+    if (relativeError < minRelativeError ||
+        (relativeError == minRelativeError && std::make_pair(baseLength, height) < std::make_pair(bestBaseLength, bestHeight)))
+    {
+        bestBaseLength = baseLength;
+        bestHeight = height;
+        minRelativeError = relativeError;
+    }
+}
+
+void TargetStatistics::Merge(const TargetStatistics& other)
+{
+    relativeErrorSum.Merge(other.relativeErrorSum);
+    relativeErrorSketch.Merge(other.relativeErrorSketch);
+    hitCount += other.hitCount;
+    moreAccurateThanKhufuCount += other.moreAccurateThanKhufuCount;
+
+    if (other.bestBaseLength != 0 &&
+        (other.minRelativeError < minRelativeError ||
+        (other.minRelativeError == minRelativeError &&
+        std::make_pair(other.bestBaseLength, other.bestHeight) < std::make_pair(bestBaseLength, bestHeight))))
+    {
+        bestBaseLength = other.bestBaseLength;
+        bestHeight = other.bestHeight;
+        minRelativeError = other.minRelativeError;
+    }
+}
+
+void TargetStatistics::Write(std::ostream& stream) const
+{
+    relativeErrorSum.Write(stream);
+    relativeErrorSketch.Write(stream);
+    BinaryIO::Write(stream, hitCount);
+    BinaryIO::Write(stream, moreAccurateThanKhufuCount);
+    BinaryIO::Write(stream, bestBaseLength);
+    BinaryIO::Write(stream, bestHeight);
+    BinaryIO::Write(stream, minRelativeError);
+}
+
+bool TargetStatistics::Read(std::istream& stream)
+{
+    return relativeErrorSum.Read(stream) && relativeErrorSketch.Read(stream) &&
+        BinaryIO::Read(stream, hitCount) && BinaryIO::Read(stream, moreAccurateThanKhufuCount) &&
+        BinaryIO::Read(stream, bestBaseLength) && BinaryIO::Read(stream, bestHeight) && BinaryIO::Read(stream, minRelativeError);
+}
+
+SweepAccumulator::SweepAccumulator(size_t targetCount, size_t leaderboardSize):
+    pyramidCount(0),
+    ratioCount(0),
+    moreAccurateThanKhufuCount(0),
+    lessAccurateThanKhufuCount(0),
+    evaluatedCandidateCount(0),
+    prunedCandidateCount(0),
+    winningBaseLength(0),
+    winningHeight(0),
+    minRelativeErrorSum(std::numeric_limits<double>::max()),
+    targetStatistics(targetCount),
+    leaderboard(leaderboardSize)
+{
+}
+
+void SweepAccumulator::Add(int baseLength, int height, double relativeErrorSum, double khufuRelativeErrorSum)
+{
+    AddMultiples(baseLength, height, 1, relativeErrorSum, khufuRelativeErrorSum);
+}
+
+void SweepAccumulator::AddMultiples(int baseLength, int height, uint32_t count, double relativeErrorSum, double khufuRelativeErrorSum)
+{
+    pyramidCount += count;
+    relativeErrorSumSum.AddMultiple(relativeErrorSum, count);
+    relativeErrorSumSketch.AddMultiple(relativeErrorSum, count);
+
+    // Ties go to the smaller (base length, height), which is the pyramid a serial scan meets first.
+    if (relativeErrorSum < minRelativeErrorSum ||
+        (relativeErrorSum == minRelativeErrorSum && std::make_pair(baseLength, height) < std::make_pair(winningBaseLength, winningHeight)))
+    {
+        winningBaseLength = baseLength;
+        winningHeight = height;
+        minRelativeErrorSum = relativeErrorSum;
+    }
+
+    if (relativeErrorSum < khufuRelativeErrorSum)
+    {
+        moreAccurateThanKhufuCount += count;
+    }
+    else if (relativeErrorSum > khufuRelativeErrorSum)
+    {
+        lessAccurateThanKhufuCount += count;
+    }
+}
+
+void SweepAccumulator::Merge(const SweepAccumulator& other)
+{
+    pyramidCount += other.pyramidCount;
+    ratioCount += other.ratioCount;
+    moreAccurateThanKhufuCount += other.moreAccurateThanKhufuCount;
+    lessAccurateThanKhufuCount += other.lessAccurateThanKhufuCount;
+    relativeErrorSumSum.Merge(other.relativeErrorSumSum);
+    relativeErrorSumSketch.Merge(other.relativeErrorSumSketch);
+    evaluatedCandidateCount += other.evaluatedCandidateCount;
+    prunedCandidateCount += other.prunedCandidateCount;
+
+    if (targetStatistics.size() < other.targetStatistics.size())
+    {
+        targetStatistics.resize(other.targetStatistics.size());
+    }
+    for (size_t i = 0; i < other.targetStatistics.size(); ++i)
+    {
+        targetStatistics[i].Merge(other.targetStatistics[i]);
+    }
+
+    leaderboard.Merge(other.leaderboard);
+
+    if (other.pyramidCount > 0 &&
+        (other.minRelativeErrorSum < minRelativeErrorSum ||
+        (other.minRelativeErrorSum == minRelativeErrorSum &&
+        std::make_pair(other.winningBaseLength, other.winningHeight) < std::make_pair(winningBaseLength, winningHeight))))
+    {
+        winningBaseLength = other.winningBaseLength;
+        winningHeight = other.winningHeight;
+        minRelativeErrorSum = other.minRelativeErrorSum;
+    }
+}
+
+void SweepAccumulator::Write(std::ostream& stream) const
+{
+    BinaryIO::Write(stream, pyramidCount);
+    BinaryIO::Write(stream, ratioCount);
+    BinaryIO::Write(stream, moreAccurateThanKhufuCount);
+    BinaryIO::Write(stream, lessAccurateThanKhufuCount);
+    relativeErrorSumSum.Write(stream);
+    relativeErrorSumSketch.Write(stream);
+    BinaryIO::Write(stream, evaluatedCandidateCount);
+    BinaryIO::Write(stream, prunedCandidateCount);
+    BinaryIO::Write(stream, winningBaseLength);
+    BinaryIO::Write(stream, winningHeight);
+    BinaryIO::Write(stream, minRelativeErrorSum);
+
+    BinaryIO::Write(stream, (uint64_t) targetStatistics.size());
+    for (const TargetStatistics& statistics : targetStatistics)
+    {
+        statistics.Write(stream);
+    }
+
+    leaderboard.Write(stream);
+}
+
+bool SweepAccumulator::Read(std::istream& stream)
+{
+    uint64_t targetCount;
+    bool read = BinaryIO::Read(stream, pyramidCount) && BinaryIO::Read(stream, ratioCount) &&
+        BinaryIO::Read(stream, moreAccurateThanKhufuCount) && BinaryIO::Read(stream, lessAccurateThanKhufuCount) &&
+        relativeErrorSumSum.Read(stream) && relativeErrorSumSketch.Read(stream) &&
+        BinaryIO::Read(stream, evaluatedCandidateCount) && BinaryIO::Read(stream, prunedCandidateCount) &&
+        BinaryIO::Read(stream, winningBaseLength) && BinaryIO::Read(stream, winningHeight) && BinaryIO::Read(stream, minRelativeErrorSum) &&
+        BinaryIO::Read(stream, targetCount) && targetCount <= BinaryIO::MAX_VECTOR_SIZE;
+    if (!read)
+    {
+        return false;
+    }
+
+    targetStatistics.resize((size_t) targetCount);
+    for (TargetStatistics& statistics : targetStatistics)
+    {
+        if (!statistics.Read(stream))
+        {
+            return false;
+        }
+    }
+
+    return leaderboard.Read(stream);
+}
+
+SweepEngine::SweepEngine(const SweepOptions& options):
+    options(options),
+    firstSegment(0),
+    segmentDenominator(1),
+    segmentCount(0),
+    shardBegin(0),
+    shardEnd(0),
+    nextSegment(0),
+    resumedAccumulator(options.targets.GetSize(), options.leaderboardSize),
+    volumeFactor(CalculateSolidVolumeFactor(options.shape, options.frustumTopFraction)),
+    fareyOrder(options.maxBaseLength)
+{
+    // A reduced ratio h:b has h >= 1 and h / b >= the window's low end, so its smallest
+    // pyramid has a volume of at least volumeFactor * b^3 * minRatio, and every multiple more.
+    // Past the base length where that exceeds maxVolume no ratio can be accepted, and the
+    // Farey walk stops there instead of stepping through O(maxBaseLength^2) rejected terms.
+    // The extra 1 absorbs the rounding of the volume check.
+    if (options.maxBaseLength >= 1)
+    {
+        double minRatio = std::max(options.minHeightToBaseRatio, 1.0 / (double) options.maxBaseLength);
+        double maxBaseLength = std::floor(std::cbrt(std::max(0.0, options.maxVolume) / (volumeFactor * minRatio))) + 1.0;
+        if (maxBaseLength < (double) fareyOrder)
+        {
+            fareyOrder = std::max<int64_t>(1, (int64_t) maxBaseLength);
+        }
+    }
+
+    if (options.maxBaseLength >= 1 && options.maxBaseLength >= options.minBaseLength && options.maxHeight >= options.minHeight)
+    {
+        // Segments must not have a larger denominator than the Farey order, so that each
+        // segment's lower bound is itself a term of the sequence.
+        segmentDenominator = std::min<int64_t>(fareyOrder, MAX_SEGMENT_DENOMINATOR);
+        firstSegment = std::max<int64_t>(0, (int64_t) std::floor(options.minHeightToBaseRatio * segmentDenominator));
+        int64_t lastSegment = (int64_t) std::ceil(options.maxHeightToBaseRatio * segmentDenominator);
+        segmentCount = lastSegment >= firstSegment ? (uint32_t) (lastSegment - firstSegment + 1) : 0;
+    }
+
+    std::pair<uint32_t, uint32_t> shardSegments = FindShardSegments(options.shardIndex);
+    shardBegin = shardSegments.first;
+    shardEnd = shardSegments.second;
+    nextSegment = shardBegin;
+}
+
+uint32_t SweepEngine::GetResumedSegmentCount() const
+{
+    return nextSegment - shardBegin;
+}
+
+uint32_t SweepEngine::GetSegmentCount() const
+{
+    return shardEnd - shardBegin;
+}
+
+double SweepEngine::EstimateSegmentWork(int64_t segment) const
+{
+    double minRatio = std::max((double) segment / (double) segmentDenominator, options.minHeightToBaseRatio);
+    double maxRatio = std::min((double) (segment + 1) / (double) segmentDenominator, options.maxHeightToBaseRatio);
+    if (maxRatio <= minRatio || maxRatio <= 0.0)
+    {
+        return 0.0;
+    }
+
+    // Every fraction in the segment with a denominator up to the Farey order is stepped past.
+    double fareyTermCount = 3.0 * (double) fareyOrder * (double) fareyOrder * (maxRatio - minRatio) / (PI * PI);
+
+    // Ratios are evaluated about once per coprime lattice point that passes the bounds, so
+    // integrate the height range left over base lengths where the volume band can be met.
+    double minBaseLength = std::max((double) options.minBaseLength, std::cbrt(options.minVolume / (volumeFactor * maxRatio)));
+    double maxBaseLength = (double) options.maxBaseLength;
+    if (minRatio > 0.0)
+    {
+        maxBaseLength = std::min(maxBaseLength, std::cbrt(options.maxVolume / (volumeFactor * minRatio)));
+    }
+
+    double area = 0.0;
+    double step = (maxBaseLength - minBaseLength) / WORK_ESTIMATE_SAMPLES;
+    for (int sample = 0; step > 0.0 && sample < WORK_ESTIMATE_SAMPLES; ++sample)
+    {
+        double baseLength = minBaseLength + (sample + 0.5) * step;
+        double low = std::max({ minRatio * baseLength, (double) options.minHeight, options.minVolume / (volumeFactor * baseLength * baseLength) });
+        double high = std::min({ maxRatio * baseLength, (double) options.maxHeight, options.maxVolume / (volumeFactor * baseLength * baseLength) });
+        area += std::max(0.0, high - low) * step;
+    }
+
+    return RATIO_EVALUATION_COST * area * 6.0 / (PI * PI) + FAREY_TERM_COST * fareyTermCount;
+}
+
+std::pair<uint32_t, uint32_t> SweepEngine::FindShardSegments(int shardIndex) const
+{
+    int shardCount = std::max(options.shardCount, 1);
+    if (shardCount == 1)
+    {
+        return std::make_pair(0u, segmentCount);
+    }
+
+    // Shard i takes the segments whose work, summed from the first segment, ends in
+    // (i / shardCount, (i + 1) / shardCount] of the total.
+    std::vector<double> cumulativeWork(segmentCount + 1, 0.0);
+    for (uint32_t segment = 0; segment < segmentCount; ++segment)
+    {
+        cumulativeWork[segment + 1] = cumulativeWork[segment] + EstimateSegmentWork(firstSegment + segment);
+    }
+
+    auto findBoundary = [&](int shard)
+    {
+        if (shard >= shardCount)
+        {
+            return segmentCount;
+        }
+        double boundary = cumulativeWork[segmentCount] * shard / shardCount;
+        return (uint32_t) (std::upper_bound(cumulativeWork.begin() + 1, cumulativeWork.end(), boundary) - (cumulativeWork.begin() + 1));
+    };
+
+    return std::make_pair(findBoundary(shardIndex), findBoundary(shardIndex + 1));
+}
+
+uint64_t SweepEngine::CalculateFingerprint() const
+{
+    std::ostringstream stream;
+    BinaryIO::Write(stream, options.minBaseLength);
+    BinaryIO::Write(stream, options.maxBaseLength);
+    BinaryIO::Write(stream, options.minHeight);
+    BinaryIO::Write(stream, options.maxHeight);
+    BinaryIO::Write(stream, options.minVolume);
+    BinaryIO::Write(stream, options.maxVolume);
+    BinaryIO::Write(stream, options.minHeightToBaseRatio);
+    BinaryIO::Write(stream, options.maxHeightToBaseRatio);
+    BinaryIO::Write(stream, options.excludedHeightToBaseRatio.first);
+    BinaryIO::Write(stream, options.excludedHeightToBaseRatio.second);
+    BinaryIO::Write(stream, (int32_t) options.shape);
+    BinaryIO::Write(stream, options.frustumTopFraction);
+    for (const Target& target : options.targets.GetTargets())
+    {
+        stream << target.name << '\0';
+        BinaryIO::Write(stream, target.value);
+        BinaryIO::Write(stream, target.inCombinedSum);
+    }
+    BinaryIO::Write(stream, options.khufuRelativeErrorSum);
+    BinaryIO::WriteVector(stream, options.khufuRelativeErrors);
+    BinaryIO::Write(stream, options.hitTolerance);
+    BinaryIO::Write(stream, (uint64_t) options.leaderboardSize);
+    // Whether the kernel prunes and whether the index answers the searches decide the candidate
+    // counts. The exhaustive kernels all count alike, so any of them may pick up another's run.
+    BinaryIO::Write(stream, ClosestKernel::GetKernel() == ClosestKernelType::PRUNED);
+    BinaryIO::Write(stream, options.candidateIndex != nullptr);
+    BinaryIO::Write(stream, firstSegment);
+    BinaryIO::Write(stream, segmentDenominator);
+    BinaryIO::Write(stream, segmentCount);
+    return HashBytes(stream.str());
+}
+
+bool SweepEngine::SaveCheckpoint(uint32_t nextSegment, const SweepAccumulator& accumulator, std::string& error) const
+{
+    std::ostringstream stream;
+    stream.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    BinaryIO::Write(stream, CalculateFingerprint());
+    BinaryIO::Write(stream, options.shardIndex);
+    BinaryIO::Write(stream, options.shardCount);
+    BinaryIO::Write(stream, nextSegment);
+    accumulator.Write(stream);
+    return WriteFileAtomically(options.checkpointPath, stream.str(), error);
+}
+
+bool SweepEngine::Resume(std::string& error)
+{
+    std::string contents;
+    if (options.checkpointPath.empty() || !ReadFile(options.checkpointPath, contents))
+    {
+        return true;
+    }
+
+    std::istringstream stream(contents);
+    char magic[sizeof(CHECKPOINT_MAGIC)];
+    uint64_t fingerprint;
+    int shardIndex;
+    int shardCount;
+    uint32_t checkpointSegment;
+    SweepAccumulator accumulator(options.targets.GetSize(), options.leaderboardSize);
+    if (!stream.read(magic, sizeof(magic)) || std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0 ||
+        !BinaryIO::Read(stream, fingerprint) || !BinaryIO::Read(stream, shardIndex) || !BinaryIO::Read(stream, shardCount) ||
+        !BinaryIO::Read(stream, checkpointSegment) || !accumulator.Read(stream) ||
+        accumulator.targetStatistics.size() != options.targets.GetSize())
+    {
+        error = options.checkpointPath + " is not a readable sweep checkpoint";
+        return false;
+    }
+
+    if (fingerprint != CalculateFingerprint() || shardIndex != options.shardIndex || shardCount != options.shardCount ||
+        checkpointSegment < shardBegin || checkpointSegment > shardEnd)
+    {
+        error = options.checkpointPath + " was written by a sweep with different options, --kernel or --index";
+        return false;
+    }
+
+    nextSegment = checkpointSegment;
+    resumedAccumulator = accumulator;
+    return true;
+}
+
+SweepAccumulator SweepEngine::Run()
+{
+    WorkStealingScheduler scheduler(options.threadCount);
+    std::unique_ptr<ThreadAccumulator[]> threadAccumulators(new ThreadAccumulator[scheduler.GetThreadCount()]);
+    for (int i = 0; i < scheduler.GetThreadCount(); ++i)
+    {
+        threadAccumulators[i].accumulator = SweepAccumulator(options.targets.GetSize(), options.leaderboardSize);
+        threadAccumulators[i].records = RecordBlock(options.targets.GetSize());
+    }
+
+    auto mergeAccumulators = [&]()
+    {
+        SweepAccumulator result = resumedAccumulator;
+        for (int i = 0; i < scheduler.GetThreadCount(); ++i)
+        {
+            result.Merge(threadAccumulators[i].accumulator);
+        }
+        return result;
+    };
+
+    // The calling thread works items too, so drop whatever it searched before the sweep.
+    ClosestKernel::TakeSearchStatistics();
+    Metrics::DiscardThread();
+
+    uint32_t batchSegments = std::max(MIN_BATCH_SEGMENTS, BATCH_SEGMENTS_PER_THREAD * (uint32_t) scheduler.GetThreadCount());
+    std::chrono::steady_clock::time_point lastCheckpoint = std::chrono::steady_clock::now();
+    bool checkpointFailed = false;
+
+    uint32_t beginSegment = nextSegment;
+    for (uint32_t batchBegin = nextSegment; batchBegin < shardEnd; batchBegin += batchSegments)
+    {
+        uint32_t batchEnd = std::min(shardEnd, batchBegin + batchSegments);
+        scheduler.Run(batchEnd - batchBegin, [&](int threadIndex, uint32_t segment)
+        {
+            SweepAccumulator& accumulator = threadAccumulators[threadIndex].accumulator;
+            ProcessRatioSegment(firstSegment + batchBegin + segment, segmentDenominator, accumulator, threadAccumulators[threadIndex].records);
+
+            ClosestKernel::SearchStatistics searchStatistics = ClosestKernel::TakeSearchStatistics();
+            accumulator.evaluatedCandidateCount += searchStatistics.evaluatedCandidateCount;
+            accumulator.prunedCandidateCount += searchStatistics.prunedCandidateCount;
+            Metrics::FlushThread(threadIndex);
+        });
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (!options.checkpointPath.empty() && !checkpointFailed && batchEnd < shardEnd &&
+            std::chrono::duration<double>(now - lastCheckpoint).count() >= options.checkpointInterval)
+        {
+            Metrics::ScopedPhase phase(Metrics::Phase::CHECKPOINT);
+            std::string error;
+            checkpointFailed = !SaveCheckpoint(batchEnd, mergeAccumulators(), error);
+            if (checkpointFailed)
+            {
+                std::cerr << "checkpointing stopped: " << error << '\n';
+            }
+            lastCheckpoint = now;
+        }
+    }
+
+    Metrics::ScopedPhase mergePhase(Metrics::Phase::MERGE);
+    SweepAccumulator result = mergeAccumulators();
+    mergePhase.End();
+
+    if (options.recordWriter != nullptr)
+    {
+        for (int i = 0; i < scheduler.GetThreadCount(); ++i)
+        {
+            options.recordWriter->Submit(threadAccumulators[i].records);
+        }
+    }
+
+    if (!options.checkpointPath.empty() && !checkpointFailed)
+    {
+        Metrics::ScopedPhase phase(Metrics::Phase::CHECKPOINT);
+        std::string error;
+        if (!SaveCheckpoint(shardEnd, result, error))
+        {
+            std::cerr << "checkpointing stopped: " << error << '\n';
+        }
+    }
+
+    if (Metrics::ENABLED)
+    {
+        uint64_t acceptedPairCount = 0;
+        for (int i = 0; i < scheduler.GetThreadCount(); ++i)
+        {
+            acceptedPairCount += (uint64_t) threadAccumulators[i].accumulator.pyramidCount;
+        }
+        CountUnvisitedPairs(beginSegment, acceptedPairCount);
+    }
+
+    Metrics::FlushThread(0);
+    return result;
+}
+
+bool SweepEngine::WritePartial(const std::string& path, const SweepAccumulator& accumulator, std::string& error) const
+{
+    std::ostringstream stream;
+    stream.write(PARTIAL_MAGIC, sizeof(PARTIAL_MAGIC));
+    BinaryIO::Write(stream, CalculateFingerprint());
+    BinaryIO::Write(stream, options.shardIndex);
+    BinaryIO::Write(stream, options.shardCount);
+    accumulator.Write(stream);
+    return WriteFileAtomically(path, stream.str(), error);
+}
+
+bool SweepEngine::MergePartials(const std::vector<std::string>& paths, SweepAccumulator& result, std::string& error) const
+{
+    result = SweepAccumulator(options.targets.GetSize(), options.leaderboardSize);
+
+    int expectedShardCount = 0;
+    std::vector<bool> shardsSeen;
+    for (const std::string& path : paths)
+    {
+        std::string contents;
+        if (!ReadFile(path, contents))
+        {
+            error = "cannot open partial " + path;
+            return false;
+        }
+
+        std::istringstream stream(contents);
+        char magic[sizeof(PARTIAL_MAGIC)];
+        uint64_t fingerprint;
+        int shardIndex;
+        int shardCount;
+        SweepAccumulator accumulator(options.targets.GetSize(), options.leaderboardSize);
+        if (!stream.read(magic, sizeof(magic)) || std::memcmp(magic, PARTIAL_MAGIC, sizeof(magic)) != 0 ||
+            !BinaryIO::Read(stream, fingerprint) || !BinaryIO::Read(stream, shardIndex) || !BinaryIO::Read(stream, shardCount) ||
+            !accumulator.Read(stream) || accumulator.targetStatistics.size() != options.targets.GetSize() ||
+            shardCount < 1 || shardIndex < 0 || shardIndex >= shardCount)
+        {
+            error = path + " is not a readable sweep partial";
+            return false;
+        }
+
+        if (fingerprint != CalculateFingerprint())
+        {
+            error = path + " was written by a sweep with different options, --kernel or --index";
+            return false;
+        }
+
+        if (expectedShardCount == 0)
+        {
+            expectedShardCount = shardCount;
+            shardsSeen.assign(shardCount, false);
+        }
+        if (shardCount != expectedShardCount || shardsSeen[shardIndex])
+        {
+            error = path + " repeats shard " + std::to_string(shardIndex) + " or splits the sweep differently";
+            return false;
+        }
+
+        shardsSeen[shardIndex] = true;
+        result.Merge(accumulator);
+    }
+
+    for (int shard = 0; shard < expectedShardCount; ++shard)
+    {
+        if (!shardsSeen[shard])
+        {
+            error = "shard " + std::to_string(shard) + "/" + std::to_string(expectedShardCount) + " is missing";
+            return false;
+        }
+    }
+
+    if (expectedShardCount == 0)
+    {
+        error = "no partials to merge";
+        return false;
+    }
+
+    return true;
+}
+
+void SweepEngine::ProcessRatioSegment(int64_t segmentNumerator, int64_t segmentDenominator, SweepAccumulator& accumulator, RecordBlock& records)
+{
+    Metrics::ScopedPhase phase(Metrics::Phase::SEGMENT);
+    MathUtilities::FareySequence ratios(fareyOrder, segmentNumerator, segmentDenominator);
+    PendingRatios pendingRatios;
+    std::pair<int64_t, int64_t> multiples;
+    uint64_t termCount = 0;
+
+    while (ratios.GetNumerator() * segmentDenominator < (segmentNumerator + 1) * ratios.GetDenominator())
+    {
+        ++termCount;
+        if (AcceptRatio(ratios.GetNumerator(), ratios.GetDenominator(), multiples))
+        {
+            pendingRatios.reducedHeights.push_back((int) ratios.GetNumerator());
+            pendingRatios.reducedBaseLengths.push_back((int) ratios.GetDenominator());
+            pendingRatios.multiples.push_back(multiples);
+            if (pendingRatios.multiples.size() == RATIO_BATCH_SIZE)
+            {
+                ProcessRatios(pendingRatios, accumulator, records);
+            }
+        }
+        ratios.Next();
+    }
+
+    ProcessRatios(pendingRatios, accumulator, records);
+    Metrics::Count(Metrics::Counter::FAREY_TERMS, termCount);
+}
+
+bool SweepEngine::AcceptRatio(int64_t reducedHeight, int64_t reducedBaseLength, std::pair<int64_t, int64_t>& multiples) const
+{
+    if (reducedHeight < 1 || reducedHeight > options.maxHeight)
+    {
+        return false;
+    }
+
+    // Check if the height to base ratio is acceptable. (k * h) / (k * b) rounds to the same
+    // double as h / b, so this decides for every multiple at once. The pairs outside the window
+    // are counted by CountUnvisitedPairs.
+    double heightToBaseRatio = (double) reducedHeight / (double) reducedBaseLength;
+    if (heightToBaseRatio < options.minHeightToBaseRatio || heightToBaseRatio > options.maxHeightToBaseRatio)
+    {
+        return false;
+    }
+
+    // Check if the ratio of the height to base length is the same as Khufu:
+    if (reducedHeight == options.excludedHeightToBaseRatio.first && reducedBaseLength == options.excludedHeightToBaseRatio.second)
+    {
+        Metrics::Count(Metrics::Counter::KHUFU_RATIO_REJECTED_PAIRS, CountMultiples(FindDimensionMultiples(reducedHeight, reducedBaseLength)));
+        return false;
+    }
+
+    multiples = FindMultiples(reducedHeight, reducedBaseLength);
+    if (multiples.first > multiples.second)
+    {
+        return false;
+    }
+
+    Metrics::Count(Metrics::Counter::ACCEPTED_RATIOS);
+    Metrics::Count(Metrics::Counter::ACCEPTED_PAIRS, CountMultiples(multiples));
+    return true;
+}
+
+void SweepEngine::ProcessRatios(PendingRatios& ratios, SweepAccumulator& accumulator, RecordBlock& records)
+{
+    if (options.shape == SolidShape::SQUARE_PYRAMID)
+    {
+        // Every multiple of a reduced ratio has the same closest matches, so each ratio is only evaluated once.
+        // An index has the dimensions already, so only the search is left.
+        if (options.candidateIndex == nullptr)
+        {
+            Metrics::ScopedPhase pyramidsPhase(Metrics::Phase::PYRAMIDS);
+            ratios.reducedPyramids.Calculate(ratios.reducedBaseLengths.data(), ratios.reducedHeights.data(), ratios.multiples.size());
+        }
+
+        for (size_t i = 0; i < ratios.multiples.size(); ++i)
+        {
+            Metrics::ScopedPhase closestPhase(Metrics::Phase::CLOSEST);
+            RatioEvaluation evaluation = options.candidateIndex != nullptr
+                ? EvaluateFromIndex(ratios.reducedHeights[i], ratios.reducedBaseLengths[i])
+                : RatioEvaluator::Evaluate(ratios.reducedPyramids.GetPyramid(i), options.targets);
+            closestPhase.End();
+
+            Metrics::ScopedPhase accumulatePhase(Metrics::Phase::ACCUMULATE);
+            AddRatio(ratios.reducedHeights[i], ratios.reducedBaseLengths[i], ratios.multiples[i], evaluation, accumulator, records);
+        }
+    }
+    else
+    {
+        VisitSolidShape(options.shape, options.frustumTopFraction, [&](const auto& shape)
+        {
+            ProcessSolidRatios(shape, ratios, accumulator);
+        });
+    }
+
+    ratios.reducedHeights.clear();
+    ratios.reducedBaseLengths.clear();
+    ratios.multiples.clear();
+}
+
+RatioEvaluation SweepEngine::EvaluateFromIndex(int reducedHeight, int reducedBaseLength) const
+{
+    int64_t entry = options.candidateIndex->Find(reducedHeight, reducedBaseLength);
+    if (entry < 0)
+    {
+        // Covers keeps this from happening, but the pyramid is cheap to compute anyway.
+        return RatioEvaluator::Evaluate(std::make_pair(reducedHeight, reducedBaseLength), options.targets);
+    }
+    return options.candidateIndex->Evaluate((uint64_t) entry, options.targets);
+}
+
+template <typename Shape>
+void SweepEngine::ProcessSolidRatios(const Shape& shape, const PendingRatios& ratios, SweepAccumulator& accumulator) const
+{
+    SolidClosestSearch<Shape> search(shape);
+    ClosestKernel::SearchStatistics searchStatistics;
+    double dimensions[Shape::DIMENSION_COUNT];
+    std::vector<double> relativeErrors(options.targets.GetSize());
+
+    for (size_t i = 0; i < ratios.multiples.size(); ++i)
+    {
+        Metrics::ScopedPhase pyramidsPhase(Metrics::Phase::PYRAMIDS);
+        shape.Calculate(ratios.reducedBaseLengths[i], ratios.reducedHeights[i], dimensions);
+        pyramidsPhase.End();
+
+        Metrics::ScopedPhase closestPhase(Metrics::Phase::CLOSEST);
+        Metrics::Count(Metrics::Counter::CLOSEST_SEARCHES, options.targets.GetSize());
+        double relativeErrorSum = 0.0;
+        for (size_t target = 0; target < options.targets.GetSize(); ++target)
+        {
+            double value = options.targets[target].value;
+            int candidate = search.FindClosestCandidate(dimensions, value, searchStatistics);
+            relativeErrors[target] = MathUtilities::CalculateRelativeError(search.CalculateCandidateValue(dimensions, candidate), value);
+            if (options.targets[target].inCombinedSum)
+            {
+                relativeErrorSum += relativeErrors[target];
+            }
+        }
+        closestPhase.End();
+
+        Metrics::ScopedPhase accumulatePhase(Metrics::Phase::ACCUMULATE);
+        AddRatioStatistics(ratios.reducedHeights[i], ratios.reducedBaseLengths[i], ratios.multiples[i], relativeErrorSum, [&](size_t target)
+        {
+            return relativeErrors[target];
+        }, accumulator);
+    }
+
+    accumulator.evaluatedCandidateCount += searchStatistics.evaluatedCandidateCount;
+    accumulator.prunedCandidateCount += searchStatistics.prunedCandidateCount;
+}
+
+void SweepEngine::AddRatio(int reducedHeight, int reducedBaseLength, std::pair<int64_t, int64_t> multiples, const RatioEvaluation& evaluation,
+    SweepAccumulator& accumulator, RecordBlock& records)
+{
+    int baseLength = (int) (multiples.first * reducedBaseLength);
+    int height = (int) (multiples.first * reducedHeight);
+    uint32_t count = (uint32_t) (multiples.second - multiples.first + 1);
+
+    AddRatioStatistics(reducedHeight, reducedBaseLength, multiples, evaluation.relativeErrorSum, [&](size_t i)
+    {
+        return evaluation.closest[i].relativeError;
+    }, accumulator);
+    accumulator.leaderboard.AddMultiples(baseLength, height, reducedBaseLength, reducedHeight, count, evaluation.relativeErrorSum, evaluation.closest);
+
+    if (options.recordWriter != nullptr)
+    {
+        for (uint32_t multiple = 0; multiple < count; ++multiple)
+        {
+            records.Append(baseLength + (int) (multiple * reducedBaseLength), height + (int) (multiple * reducedHeight),
+                reducedBaseLength, reducedHeight, evaluation.relativeErrorSum);
+            for (size_t i = 0; i < evaluation.closest.size(); ++i)
+            {
+                const GetClosestResult& closest = evaluation.closest[i];
+                records.SetTarget(i, closest.value, closest.relativeError, (int) closest.dimension1.first, (int) closest.dimension2.first,
+                    ClosestKernel::GetCandidate(evaluation.candidates[i]).factorIndex);
+            }
+
+            if (records.IsFull())
+            {
+                options.recordWriter->Submit(records);
+            }
+        }
+    }
+}
+
+template <typename RelativeErrors>
+void SweepEngine::AddRatioStatistics(int reducedHeight, int reducedBaseLength, std::pair<int64_t, int64_t> multiples, double relativeErrorSum,
+    const RelativeErrors& relativeErrors, SweepAccumulator& accumulator) const
+{
+    int baseLength = (int) (multiples.first * reducedBaseLength);
+    int height = (int) (multiples.first * reducedHeight);
+    uint32_t count = (uint32_t) (multiples.second - multiples.first + 1);
+
+    ++accumulator.ratioCount;
+    accumulator.AddMultiples(baseLength, height, count, relativeErrorSum, options.khufuRelativeErrorSum);
+    for (size_t i = 0; i < options.targets.GetSize(); ++i)
+    {
+        accumulator.targetStatistics[i].Add(baseLength, height, count, relativeErrors(i), options.hitTolerance, options.khufuRelativeErrors[i]);
+    }
+}
+
+std::pair<int64_t, int64_t> SweepEngine::FindDimensionMultiples(int64_t reducedHeight, int64_t reducedBaseLength) const
+{
+    int64_t minMultiple = std::max<int64_t>(1, std::max(
+        (options.minBaseLength + reducedBaseLength - 1) / reducedBaseLength,
+        (options.minHeight + reducedHeight - 1) / reducedHeight));
+    int64_t maxMultiple = std::min<int64_t>(options.maxBaseLength / reducedBaseLength, options.maxHeight / reducedHeight);
+    return std::make_pair(minMultiple, maxMultiple);
+}
+
+std::pair<int64_t, int64_t> SweepEngine::FindMultiples(int64_t reducedHeight, int64_t reducedBaseLength) const
+{
+    std::pair<int64_t, int64_t> dimensionMultiples = FindDimensionMultiples(reducedHeight, reducedBaseLength);
+    int64_t minMultiple = dimensionMultiples.first;
+    int64_t maxMultiple = dimensionMultiples.second;
+    if (minMultiple > maxMultiple)
+    {
+        return dimensionMultiples;
+    }
+
+    // The volume grows with the cube of the multiple. Start from the cube-root estimate and
+    // settle on the exact bounds with the same volume check the grid scan used.
+    double unitVolume = CalculateVolume(reducedBaseLength, reducedHeight);
+    int64_t low = std::max<int64_t>(minMultiple, (int64_t) std::cbrt(options.minVolume / unitVolume));
+    low = std::min(low, maxMultiple + 1);
+    while (low > minMultiple && CalculateVolume((low - 1) * reducedBaseLength, (low - 1) * reducedHeight) >= options.minVolume)
+    {
+        --low;
+    }
+    while (low <= maxMultiple && CalculateVolume(low * reducedBaseLength, low * reducedHeight) < options.minVolume)
+    {
+        ++low;
+    }
+
+    int64_t high = std::max(low - 1, std::min<int64_t>(maxMultiple, (int64_t) std::cbrt(options.maxVolume / unitVolume) + 1));
+    while (high < maxMultiple && CalculateVolume((high + 1) * reducedBaseLength, (high + 1) * reducedHeight) <= options.maxVolume)
+    {
+        ++high;
+    }
+    while (high >= low && CalculateVolume(high * reducedBaseLength, high * reducedHeight) > options.maxVolume)
+    {
+        --high;
+    }
+
+    return std::make_pair(low, high);
+}
+
+uint64_t SweepEngine::CountWindowPairs(int64_t lowNumerator, int64_t highNumerator, int64_t denominator) const
+{
+    double minRatio = options.minHeightToBaseRatio;
+    double maxRatio = options.maxHeightToBaseRatio;
+    uint64_t count = 0;
+    for (int64_t baseLength = std::max(1, options.minBaseLength); baseLength <= options.maxBaseLength; ++baseLength)
+    {
+        // The heights in the bounds and in [lowNumerator, highNumerator) / denominator, exactly.
+        int64_t low = std::max<int64_t>(options.minHeight, (lowNumerator * baseLength + denominator - 1) / denominator);
+        int64_t high = std::min<int64_t>(options.maxHeight, (highNumerator * baseLength + denominator - 1) / denominator - 1);
+        if (low > high)
+        {
+            continue;
+        }
+
+        // Of those, the ones inside the window by AcceptRatio's double comparison, which only
+        // moves the exact bounds by a height or so.
+        double b = (double) baseLength;
+        int64_t first = (int64_t) std::min(std::max(std::ceil(minRatio * b), (double) low), (double) high + 1.0);
+        while (first > low && (double) (first - 1) / b >= minRatio)
+        {
+            --first;
+        }
+        while (first <= high && (double) first / b < minRatio)
+        {
+            ++first;
+        }
+        int64_t last = (int64_t) std::min(std::max(std::floor(maxRatio * b), (double) first - 1.0), (double) high);
+        while (last < high && (double) (last + 1) / b <= maxRatio)
+        {
+            ++last;
+        }
+        while (last >= first && (double) last / b > maxRatio)
+        {
+            --last;
+        }
+
+        count += last >= first ? (uint64_t) (last - first + 1) : 0;
+    }
+    return count;
+}
+
+void SweepEngine::CountUnvisitedPairs(uint32_t beginSegment, uint64_t acceptedPairCount) const
+{
+    // The segments only cover the window, so the pairs outside it are counted from the bounds,
+    // once per sweep.
+    if (options.shardIndex == 0 && beginSegment == 0 && options.maxBaseLength >= options.minBaseLength && options.maxHeight >= options.minHeight)
+    {
+        uint64_t boundedPairCount = (uint64_t) (options.maxBaseLength - std::max(1, options.minBaseLength) + 1) * (uint64_t) (options.maxHeight - options.minHeight + 1);
+        Metrics::Count(Metrics::Counter::RATIO_WINDOW_REJECTED_PAIRS, boundedPairCount - CountWindowPairs(0, (int64_t) options.maxHeight + 1, 1));
+    }
+    if (beginSegment >= shardEnd)
+    {
+        return;
+    }
+
+    // Every other pair of the segments swept is accepted, has Khufu's ratio or is outside the
+    // volume band, including the pairs of the ratios past the Farey order that were never visited.
+    int64_t lowNumerator = firstSegment + beginSegment;
+    int64_t highNumerator = firstSegment + shardEnd;
+    int64_t khufuHeight = options.excludedHeightToBaseRatio.first;
+    int64_t khufuBaseLength = options.excludedHeightToBaseRatio.second;
+    uint64_t khufuPairCount = 0;
+    if (khufuHeight >= 1 && khufuHeight <= options.maxHeight && khufuBaseLength >= 1 && khufuBaseLength <= fareyOrder &&
+        lowNumerator * khufuBaseLength <= khufuHeight * segmentDenominator && khufuHeight * segmentDenominator < highNumerator * khufuBaseLength &&
+        (double) khufuHeight / (double) khufuBaseLength >= options.minHeightToBaseRatio &&
+        (double) khufuHeight / (double) khufuBaseLength <= options.maxHeightToBaseRatio)
+    {
+        khufuPairCount = CountMultiples(FindDimensionMultiples(khufuHeight, khufuBaseLength));
+    }
+
+    Metrics::Count(Metrics::Counter::VOLUME_REJECTED_PAIRS, CountWindowPairs(lowNumerator, highNumerator, segmentDenominator) - acceptedPairCount - khufuPairCount);
+}
+
+int64_t SweepEngine::GetFareyOrder() const
+{
+    return fareyOrder;
+}
+
+double SweepEngine::CalculateVolume(int64_t baseLength, int64_t height) const
+{
+    if (options.shape == SolidShape::SQUARE_PYRAMID)
+    {
+        return CalculateSquarePyramidVolume(baseLength, height);
+    }
+    return volumeFactor * (double) baseLength * (double) baseLength * (double) height;
+}
\ No newline at end of file
@@ -0,0 +1,223 @@
+#ifndef SWEEP_H_
+#define SWEEP_H_
+
+#include "Leaderboard.h"
+#include "MathUtilities.h"
+#include "PyramidBatch.h"
+#include "QuantileSketch.h"
+#include "RatioEvaluation.h"
+#include "RecordStream.h"
+#include "Solid.h"
+#include "TargetCatalog.h"
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+class CandidateIndexFile;
+
+struct SweepOptions
+{
+    int minBaseLength;
+    int maxBaseLength;
+    int minHeight;
+    int maxHeight;
+    double minVolume;
+    double maxVolume;
+    double minHeightToBaseRatio;
+    double maxHeightToBaseRatio;
+    std::pair<int, int> excludedHeightToBaseRatio;
+
+    // The solid each (base length, height) describes, and the top side of a SQUARE_FRUSTUM
+    // as a fraction of its bottom side.
+    SolidShape shape = SolidShape::SQUARE_PYRAMID;
+    double frustumTopFraction = 0.5;
+
+    TargetCatalog targets;
+    double khufuRelativeErrorSum;
+    std::vector<double> khufuRelativeErrors;
+    double hitTolerance;
+    size_t leaderboardSize;
+    int threadCount;
+
+    // Square pyramid sweeps score each ratio from this index when set; it must cover the sweep.
+    const CandidateIndexFile* candidateIndex = nullptr;
+
+    // Receives a record per pyramid when set.
+    RecordStreamWriter* recordWriter = nullptr;
+
+    // When set, the sweep snapshots its progress to this file at most every
+    // checkpointInterval seconds, and once more when it finishes.
+    std::string checkpointPath;
+    double checkpointInterval = 60.0;
+
+    // Sweep only shard shardIndex of shardCount; see SweepEngine.
+    int shardIndex = 0;
+    int shardCount = 1;
+};
+
+// How one catalog target fared across the sweep.
+struct TargetStatistics
+{
+public:
+    TargetStatistics();
+
+    MathUtilities::ExactSum relativeErrorSum;
+    QuantileSketch relativeErrorSketch;
+    int64_t hitCount;
+    int64_t moreAccurateThanKhufuCount;
+
+    int bestBaseLength;
+    int bestHeight;
+    double minRelativeError;
+
+    void Add(int baseLength, int height, uint32_t count, double relativeError, double hitTolerance, double khufuRelativeError);
+    void Merge(const TargetStatistics& other);
+
+    void Write(std::ostream& stream) const;
+    bool Read(std::istream& stream);
+};
+
+// Everything the sweep reports. Partial accumulators merge exactly, so the totals do not
+// depend on how the sweep was split across threads.
+struct SweepAccumulator
+{
+public:
+    explicit SweepAccumulator(size_t targetCount = 0, size_t leaderboardSize = 0);
+
+    int64_t pyramidCount;
+    int64_t ratioCount;
+    int64_t moreAccurateThanKhufuCount;
+    int64_t lessAccurateThanKhufuCount;
+    MathUtilities::ExactSum relativeErrorSumSum;
+    QuantileSketch relativeErrorSumSketch;
+
+    // Varying candidates the closest-match searches scored or skipped.
+    int64_t evaluatedCandidateCount;
+    int64_t prunedCandidateCount;
+
+    int winningBaseLength;
+    int winningHeight;
+    double minRelativeErrorSum;
+
+    std::vector<TargetStatistics> targetStatistics;
+    Leaderboard leaderboard;
+
+    void Add(int baseLength, int height, double relativeErrorSum, double khufuRelativeErrorSum);
+    void AddMultiples(int baseLength, int height, uint32_t count, double relativeErrorSum, double khufuRelativeErrorSum);
+    void Merge(const SweepAccumulator& other);
+
+    void Write(std::ostream& stream) const;
+    bool Read(std::istream& stream);
+};
+
+// Sweeps the coprime height:base ratios inside the ratio window in Farey order, split into
+// ratio segments that are scheduled with work stealing. For each ratio the integer multiples
+// that pass the dimension and volume bounds are found analytically, so filtered-out
+// (base length, height) pairs are never visited and each ratio is evaluated exactly once.
+//
+// Segments run in batches. Between batches no thread is working, so the merged accumulators
+// are exactly the totals of the segments before the next batch, which is what a checkpoint
+// stores. Merging is exact and order-independent, so a resumed sweep reports exactly what an
+// uninterrupted one does.
+//
+// Square pyramids go through ClosestKernel, batched and vectorized. The other shapes run the
+// same segments, multiples and accumulators with a SolidClosestSearch of their own shape
+// type, chosen once per batch of ratios; they do not feed the leaderboard or records.
+//
+// For runs across processes the segments are split into shardCount contiguous shards of
+// about equal estimated work. The split depends only on the options, so every process
+// computes the same one without talking to the others, and the partial accumulators they
+// write merge into exactly the single-process totals.
+class SweepEngine
+{
+public:
+    explicit SweepEngine(const SweepOptions& options);
+
+    // Continues from options.checkpointPath if it exists. Fails if the checkpoint is
+    // unreadable or was written by a sweep with different options, a pruned kernel where this
+    // one is exhaustive or the other way round, or different candidate index use.
+    bool Resume(std::string& error);
+    uint32_t GetResumedSegmentCount() const;
+    uint32_t GetSegmentCount() const;
+
+    SweepAccumulator Run();
+
+    // A shard's totals, tagged with the shard and the options of the sweep, including whether
+    // the kernel prunes and whether the index is used, which decide its candidate counts.
+    // Partials only merge when every shard of the same sweep is there exactly once.
+    bool WritePartial(const std::string& path, const SweepAccumulator& accumulator, std::string& error) const;
+    bool MergePartials(const std::vector<std::string>& paths, SweepAccumulator& result, std::string& error) const;
+
+    // Whether the sweep evaluates the coprime ratio, and if so the multiples of it that are
+    // inside the bounds.
+    bool AcceptRatio(int64_t reducedHeight, int64_t reducedBaseLength, std::pair<int64_t, int64_t>& multiples) const;
+    // Multiples of the coprime ratio that keep the base length and height inside their bounds.
+    std::pair<int64_t, int64_t> FindDimensionMultiples(int64_t reducedHeight, int64_t reducedBaseLength) const;
+    // The largest reduced base length AcceptRatio can accept, and so the order of the Farey
+    // sequence a walk over the ratios needs.
+    int64_t GetFareyOrder() const;
+
+private:
+    static constexpr uint32_t MIN_BATCH_SEGMENTS = 64;
+    static constexpr uint32_t BATCH_SEGMENTS_PER_THREAD = 16;
+
+    SweepOptions options;
+    int64_t firstSegment;
+    int64_t segmentDenominator;
+    uint32_t segmentCount;
+
+    // This shard's segments, [shardBegin, shardEnd), counted from firstSegment.
+    uint32_t shardBegin;
+    uint32_t shardEnd;
+
+    uint32_t nextSegment;
+    SweepAccumulator resumedAccumulator;
+
+    // The shape's volume over base length squared times height.
+    double volumeFactor;
+    int64_t fareyOrder;
+
+    double EstimateSegmentWork(int64_t segment) const;
+    std::pair<uint32_t, uint32_t> FindShardSegments(int shardIndex) const;
+    uint64_t CalculateFingerprint() const;
+    bool SaveCheckpoint(uint32_t nextSegment, const SweepAccumulator& accumulator, std::string& error) const;
+
+    // Ratios of a segment that are inside the bounds, waiting for their coprime pyramids to
+    // be computed as one batch.
+    struct PendingRatios
+    {
+        std::vector<int> reducedHeights;
+        std::vector<int> reducedBaseLengths;
+        std::vector<std::pair<int64_t, int64_t>> multiples;
+        PyramidBatch reducedPyramids;
+    };
+
+    static constexpr size_t RATIO_BATCH_SIZE = 256;
+
+    void ProcessRatioSegment(int64_t segmentNumerator, int64_t segmentDenominator, SweepAccumulator& accumulator, RecordBlock& records);
+    void ProcessRatios(PendingRatios& ratios, SweepAccumulator& accumulator, RecordBlock& records);
+    RatioEvaluation EvaluateFromIndex(int reducedHeight, int reducedBaseLength) const;
+    template <typename Shape>
+    void ProcessSolidRatios(const Shape& shape, const PendingRatios& ratios, SweepAccumulator& accumulator) const;
+    void AddRatio(int reducedHeight, int reducedBaseLength, std::pair<int64_t, int64_t> multiples, const RatioEvaluation& evaluation,
+        SweepAccumulator& accumulator, RecordBlock& records);
+    // The totals every shape adds for a ratio; relativeErrors(i) is the relative error of target i.
+    template <typename RelativeErrors>
+    void AddRatioStatistics(int reducedHeight, int reducedBaseLength, std::pair<int64_t, int64_t> multiples, double relativeErrorSum,
+        const RelativeErrors& relativeErrors, SweepAccumulator& accumulator) const;
+    // The dimension multiples that are inside the volume band too.
+    std::pair<int64_t, int64_t> FindMultiples(int64_t reducedHeight, int64_t reducedBaseLength) const;
+    double CalculateVolume(int64_t baseLength, int64_t height) const;
+    // Pairs inside the dimension bounds and the ratio window whose height to base ratio is in
+    // [lowNumerator / denominator, highNumerator / denominator), counted without visiting them.
+    uint64_t CountWindowPairs(int64_t lowNumerator, int64_t highNumerator, int64_t denominator) const;
+    // Counts the pairs the walk rejected without stepping past them, for Metrics, once the
+    // segments from beginSegment to the end of the shard are swept.
+    void CountUnvisitedPairs(uint32_t beginSegment, uint64_t acceptedPairCount) const;
+};
+
+#endif
\ No newline at end of file
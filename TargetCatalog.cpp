@@ -0,0 +1,188 @@
+#include "TargetCatalog.h"
+#include "Constants.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+
+struct BuiltInTarget
+{
+    const char* name;
+    double (*value)();
+};
+
+const BuiltInTarget builtInTargets[] =
+{
+    { "pi", const_pi },
+    { "phi", const_phi },
+    { "e", const_e },
+    { "sqrt2", const_sqrt2 },
+    { "sqrt3", const_sqrt3 },
+    { "ln2", const_ln2 },
+    { "feigenbaum_delta", const_feigenbaum_delta },
+    { "feigenbaum_alpha", const_feigenbaum_alpha },
+    { "fine_structure", const_fine_structure }
+};
+
+const char* defaultCombinedTargets[] = { "pi", "phi", "e" };
+
+}
+
+TargetCatalog::TargetCatalog()
+{
+}
+
+TargetCatalog TargetCatalog::CreateDefault()
+{
+    TargetCatalog catalog;
+    for (const BuiltInTarget& builtIn : builtInTargets)
+    {
+        catalog.Add(builtIn.name, builtIn.value());
+    }
+
+    std::string error;
+    catalog.SetCombined(std::vector<std::string>(std::begin(defaultCombinedTargets), std::end(defaultCombinedTargets)), error);
+    return catalog;
+}
+
+bool TargetCatalog::FindBuiltIn(const std::string& name, double& value)
+{
+    for (const BuiltInTarget& builtIn : builtInTargets)
+    {
+        if (name == builtIn.name)
+        {
+            value = builtIn.value();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool TargetCatalog::Load(const std::string& path, std::string& error)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = "cannot open target catalog " + path;
+        return false;
+    }
+
+    targets.clear();
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        ++lineNumber;
+        std::istringstream fields(line);
+        std::string name;
+        if (!(fields >> name) || name[0] == '#')
+        {
+            continue;
+        }
+
+        double value;
+        if (!(fields >> value) && !FindBuiltIn(name, value))
+        {
+            error = path + ":" + std::to_string(lineNumber) + ": " + name + " has no value and is not a built-in constant";
+            return false;
+        }
+
+        if (value <= 0.0)
+        {
+            error = path + ":" + std::to_string(lineNumber) + ": target values must be positive";
+            return false;
+        }
+
+        Add(name, value);
+    }
+
+    return true;
+}
+
+void TargetCatalog::Add(const std::string& name, double value)
+{
+    targets.push_back({ name, value, false });
+    UpdateSortedOrder();
+}
+
+bool TargetCatalog::SetCombined(const std::vector<std::string>& names, std::string& error)
+{
+    for (Target& target : targets)
+    {
+        target.inCombinedSum = false;
+    }
+
+    for (const std::string& name : names)
+    {
+        auto found = std::find_if(targets.begin(), targets.end(), [&](const Target& target) { return target.name == name; });
+        if (found == targets.end())
+        {
+            error = "combined target " + name + " is not in the catalog";
+            return false;
+        }
+
+        found->inCombinedSum = true;
+    }
+
+    return true;
+}
+
+size_t TargetCatalog::GetSize() const
+{
+    return targets.size();
+}
+
+const Target& TargetCatalog::operator[](size_t index) const
+{
+    return targets[index];
+}
+
+const std::vector<Target>& TargetCatalog::GetTargets() const
+{
+    return targets;
+}
+
+std::vector<double> TargetCatalog::GetValues() const
+{
+    std::vector<double> values;
+    for (const Target& target : targets)
+    {
+        values.push_back(target.value);
+    }
+    return values;
+}
+
+const std::vector<double>& TargetCatalog::GetSortedValues() const
+{
+    return sortedValues;
+}
+
+const std::vector<int>& TargetCatalog::GetSortedOrder() const
+{
+    return sortedOrder;
+}
+
+void TargetCatalog::UpdateSortedOrder()
+{
+    sortedOrder.resize(targets.size());
+    for (size_t i = 0; i < targets.size(); ++i)
+    {
+        sortedOrder[i] = (int) i;
+    }
+
+    std::stable_sort(sortedOrder.begin(), sortedOrder.end(), [this](int a, int b)
+    {
+        return targets[a].value < targets[b].value;
+    });
+
+    sortedValues.clear();
+    for (int index : sortedOrder)
+    {
+        sortedValues.push_back(targets[index].value);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef TARGET_CATALOG_H_
+#define TARGET_CATALOG_H_
+
+#include <string>
+#include <vector>
+
+struct Target
+{
+public:
+    std::string name;
+    double value;
+    bool inCombinedSum;
+};
+
+// The named constants every pyramid is scored against. Targets flagged inCombinedSum make
+// up the combined relative error sum the sweep ranks pyramids by, added in catalog order.
+class TargetCatalog
+{
+public:
+    TargetCatalog();
+
+    static TargetCatalog CreateDefault();
+    static bool FindBuiltIn(const std::string& name, double& value);
+
+    // Reads one target per line: "name value", or just "name" for a built-in constant.
+    // Blank lines and lines starting with '#' are skipped.
+    bool Load(const std::string& path, std::string& error);
+    void Add(const std::string& name, double value);
+    bool SetCombined(const std::vector<std::string>& names, std::string& error);
+
+    size_t GetSize() const;
+    const Target& operator[](size_t index) const;
+    const std::vector<Target>& GetTargets() const;
+    std::vector<double> GetValues() const;
+
+    // Target values in ascending order, and the catalog index of each.
+    const std::vector<double>& GetSortedValues() const;
+    const std::vector<int>& GetSortedOrder() const;
+
+private:
+    std::vector<Target> targets;
+    std::vector<double> sortedValues;
+    std::vector<int> sortedOrder;
+
+    void UpdateSortedOrder();
+};
+
+#endif
\ No newline at end of file
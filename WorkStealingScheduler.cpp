@@ -0,0 +1,141 @@
+#include "WorkStealingScheduler.h"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+uint64_t PackRange(uint32_t begin, uint32_t end)
+{
+    return ((uint64_t) begin << 32) | end;
+}
+
+uint32_t RangeBegin(uint64_t range)
+{
+    return (uint32_t) (range >> 32);
+}
+
+uint32_t RangeEnd(uint64_t range)
+{
+    return (uint32_t) range;
+}
+
+}
+
+WorkStealingScheduler::WorkStealingScheduler(int threadCount):
+    threadCount(threadCount > 0 ? threadCount : 1),
+    ranges(new ItemRange[this->threadCount])
+{
+}
+
+int WorkStealingScheduler::GetThreadCount() const
+{
+    return threadCount;
+}
+
+int WorkStealingScheduler::GetDefaultThreadCount()
+{
+    unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 0 ? (int) hardwareThreads : 1;
+}
+
+void WorkStealingScheduler::Run(uint32_t itemCount, const std::function<void(int threadIndex, uint32_t item)>& processItem)
+{
+    for (int i = 0; i < threadCount; ++i)
+    {
+        uint32_t begin = (uint32_t) ((uint64_t) itemCount * i / threadCount);
+        uint32_t end = (uint32_t) ((uint64_t) itemCount * (i + 1) / threadCount);
+        ranges[i].range.store(PackRange(begin, end));
+    }
+
+    if (threadCount == 1)
+    {
+        Work(0, processItem);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threadCount; ++i)
+    {
+        threads.emplace_back(&WorkStealingScheduler::Work, this, i, std::cref(processItem));
+    }
+
+    Work(0, processItem);
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void WorkStealingScheduler::Work(int threadIndex, const std::function<void(int threadIndex, uint32_t item)>& processItem)
+{
+    uint32_t item;
+    do
+    {
+        while (PopFront(threadIndex, item))
+        {
+            processItem(threadIndex, item);
+        }
+    } while (Steal(threadIndex));
+}
+
+bool WorkStealingScheduler::PopFront(int threadIndex, uint32_t& item)
+{
+    std::atomic<uint64_t>& range = ranges[threadIndex].range;
+    uint64_t current = range.load();
+
+    while (RangeBegin(current) < RangeEnd(current))
+    {
+        if (range.compare_exchange_weak(current, PackRange(RangeBegin(current) + 1, RangeEnd(current))))
+        {
+            item = RangeBegin(current);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool WorkStealingScheduler::Steal(int threadIndex)
+{
+    while (true)
+    {
+        int victim = -1;
+        uint32_t largestRemaining = 0;
+        for (int i = 0; i < threadCount; ++i)
+        {
+            uint64_t current = ranges[i].range.load();
+            uint32_t remaining = RangeEnd(current) - RangeBegin(current);
+            if (i != threadIndex && RangeBegin(current) < RangeEnd(current) && remaining > largestRemaining)
+            {
+                victim = i;
+                largestRemaining = remaining;
+            }
+        }
+
+        if (victim < 0)
+        {
+            return false;
+        }
+
+        std::atomic<uint64_t>& victimRange = ranges[victim].range;
+        uint64_t current = victimRange.load();
+        uint32_t begin = RangeBegin(current);
+        uint32_t end = RangeEnd(current);
+        if (begin >= end)
+        {
+            continue;
+        }
+
+        // Leave the victim the front half (it is working through it) and take the back half;
+        // a single remaining item is taken whole.
+        uint32_t middle = begin + (end - begin) / 2;
+        if (victimRange.compare_exchange_strong(current, PackRange(begin, middle)))
+        {
+            ranges[threadIndex].range.store(PackRange(middle, end));
+            return true;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#ifndef WORK_STEALING_SCHEDULER_H_
+#define WORK_STEALING_SCHEDULER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+// Runs a callback over the items [0, itemCount) on a fixed number of threads. Every
+// thread starts with a contiguous block of items and, once it runs dry, steals the back
+// half of the largest block another thread still holds.
+class WorkStealingScheduler
+{
+public:
+    explicit WorkStealingScheduler(int threadCount);
+
+    int GetThreadCount() const;
+    void Run(uint32_t itemCount, const std::function<void(int threadIndex, uint32_t item)>& processItem);
+
+    static int GetDefaultThreadCount();
+
+private:
+    struct alignas(64) ItemRange
+    {
+        // Packed as (begin << 32) | end so that owner pops and thief steals are single CAS operations.
+        std::atomic<uint64_t> range;
+    };
+
+    int threadCount;
+    std::unique_ptr<ItemRange[]> ranges;
+
+    void Work(int threadIndex, const std::function<void(int threadIndex, uint32_t item)>& processItem);
+    bool PopFront(int threadIndex, uint32_t& item);
+    bool Steal(int threadIndex);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,32 @@
+# Builds a candidate index for a small band and checks that the sweep reports the same with
+# --index as without it. The index answers searches without scoring every candidate, so the
+# evaluated and pruned candidate counts are left out of the comparison.
+#
+# cmake -DPROGRAM=<PyramidExperiments> -DWORK_DIR=<scratch directory> -P CheckCandidateIndex.cmake
+
+set(arguments --max-base-length 600 --max-height 600 --top 10)
+set(index "${WORK_DIR}/sweep.index")
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+
+execute_process(COMMAND "${PROGRAM}" ${arguments} --build-index "${index}" OUTPUT_QUIET ERROR_VARIABLE error RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "building the index failed: ${error}")
+endif()
+
+execute_process(COMMAND "${PROGRAM}" ${arguments} OUTPUT_VARIABLE expected RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "the direct sweep failed")
+endif()
+execute_process(COMMAND "${PROGRAM}" ${arguments} --index "${index}" OUTPUT_VARIABLE actual ERROR_VARIABLE error RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "the sweep with --index failed: ${error}")
+endif()
+
+string(REGEX REPLACE "closest-match candidates evaluated: [^\n]*\n" "" expected "${expected}")
+string(REGEX REPLACE "closest-match candidates evaluated: [^\n]*\n" "" actual "${actual}")
+if(NOT actual STREQUAL expected)
+    file(WRITE "${WORK_DIR}/direct.txt" "${expected}")
+    file(WRITE "${WORK_DIR}/indexed.txt" "${actual}")
+    message(FATAL_ERROR "the sweep with --index differs from the direct one; see ${WORK_DIR}")
+endif()
@@ -0,0 +1,35 @@
+# Runs the default sweep under every closest-match kernel the CPU supports and checks that
+# each report is the scalar kernel's. The pruned kernel skips candidates by design, so its
+# evaluated and pruned candidate counts are left out of the comparison.
+#
+# cmake -DPROGRAM=<PyramidExperiments> -P CheckKernelEquivalence.cmake
+
+set(arguments --top 10)
+execute_process(COMMAND "${PROGRAM}" ${arguments} --kernel scalar OUTPUT_VARIABLE expected RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "the scalar sweep failed")
+endif()
+string(REGEX REPLACE "closest-match candidates evaluated: [^\n]*\n" "" expectedWithoutCounts "${expected}")
+
+foreach(kernel avx2 avx512 pruned screened)
+    execute_process(COMMAND "${PROGRAM}" ${arguments} --kernel ${kernel} OUTPUT_VARIABLE actual ERROR_VARIABLE error RESULT_VARIABLE result)
+    if(error MATCHES "not supported by this CPU")
+        message(STATUS "skipping ${kernel}, which this CPU does not support")
+        continue()
+    elseif(NOT result EQUAL 0)
+        message(FATAL_ERROR "the ${kernel} sweep failed: ${error}")
+    endif()
+
+    if(kernel STREQUAL "pruned")
+        string(REGEX REPLACE "closest-match candidates evaluated: [^\n]*\n" "" actual "${actual}")
+        set(reference "${expectedWithoutCounts}")
+    else()
+        set(reference "${expected}")
+    endif()
+    if(NOT actual STREQUAL reference)
+        file(WRITE "${CMAKE_CURRENT_BINARY_DIR}/kernel-scalar.txt" "${reference}")
+        file(WRITE "${CMAKE_CURRENT_BINARY_DIR}/kernel-${kernel}.txt" "${actual}")
+        message(FATAL_ERROR "the ${kernel} report differs from the scalar one; see kernel-scalar.txt and kernel-${kernel}.txt")
+    endif()
+    message(STATUS "${kernel} matches scalar")
+endforeach()
@@ -0,0 +1,74 @@
+# Builds a candidate index for a small band, pipes a few queries to --serve on stdin and
+# checks the answers against the sweep's report: the Great Pyramid's combined and pi ranks,
+# its closest match to pi, and the pyramids within 1e-4 of pi, which are the sweep's pi hits
+# other than the Great Pyramid.
+#
+# cmake -DPROGRAM=<PyramidExperiments> -DWORK_DIR=<scratch directory> -P CheckQueryServer.cmake
+
+set(arguments --max-base-length 600 --max-height 600)
+set(index "${WORK_DIR}/sweep.index")
+set(queries "${WORK_DIR}/queries.txt")
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+
+execute_process(COMMAND "${PROGRAM}" ${arguments} --build-index "${index}" OUTPUT_QUIET ERROR_VARIABLE error RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "building the index failed: ${error}")
+endif()
+
+execute_process(COMMAND "${PROGRAM}" ${arguments} --hit-tolerance 1e-4 OUTPUT_VARIABLE sweep RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "the sweep failed")
+endif()
+
+file(WRITE "${queries}" "rank pi,phi,e\nrank pi\nclosest pi 440 280\nmatches pi 1e-4\nquit\n")
+execute_process(COMMAND "${PROGRAM}" ${arguments} --index "${index}" --serve INPUT_FILE "${queries}"
+    OUTPUT_VARIABLE answers ERROR_VARIABLE error RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "the server failed: ${error}")
+endif()
+
+# The combined rank.
+string(REGEX MATCH "Great Pyramid relative error sum: ([^\n]+)" match "${sweep}")
+set(relativeErrorSum "${CMAKE_MATCH_1}")
+string(REGEX MATCH "Great Pyramid rank by relative error sum: ([0-9]+) of ([0-9]+)" match "${sweep}")
+set(expected "ok ${CMAKE_MATCH_1} ${CMAKE_MATCH_2} ${relativeErrorSum}")
+string(REGEX MATCH "^ok [^\n]*" actual "${answers}")
+if(NOT actual STREQUAL expected)
+    message(FATAL_ERROR "rank pi,phi,e answered '${actual}', the sweep says '${expected}'")
+endif()
+
+# pi's rank, the Great Pyramid's closest match to pi and pi's matches.
+string(REGEX MATCH "\npi \\(combined\\): [^\n]*\n    Great Pyramid relative error: ([^\n]+)\n[^\n]*\n[^\n]*\n    Great Pyramid rank: ([0-9]+) of ([0-9]+)\n    hits: ([0-9]+)" match "${sweep}")
+if(match STREQUAL "")
+    message(FATAL_ERROR "the sweep's report has no pi results")
+endif()
+set(piRelativeError "${CMAKE_MATCH_1}")
+set(expectedRank "ok ${CMAKE_MATCH_2} ${CMAKE_MATCH_3} ${CMAKE_MATCH_1}")
+set(hitCount "${CMAKE_MATCH_4}")
+if(NOT piRelativeError GREATER 1e-4)
+    math(EXPR hitCount "${hitCount} - 1")
+endif()
+
+string(REGEX MATCHALL "ok [^\n]*" responses "${answers}")
+list(GET responses 1 actual)
+if(NOT actual STREQUAL expectedRank)
+    message(FATAL_ERROR "rank pi answered '${actual}', the sweep says '${expectedRank}'")
+endif()
+
+list(GET responses 2 actual)
+if(NOT actual MATCHES " ${piRelativeError}$")
+    message(FATAL_ERROR "closest pi 440 280 answered '${actual}', the sweep's Great Pyramid relative error for pi is ${piRelativeError}")
+endif()
+
+list(GET responses 3 actual)
+string(REGEX MATCHALL "\n[0-9]+ [0-9]+ [0-9]+ [0-9]+ [^\n]*" matches "${answers}")
+set(listedCount 0)
+foreach(ratio IN LISTS matches)
+    string(REGEX MATCH "[0-9]+ [0-9]+ ([0-9]+) ([0-9]+)" match "${ratio}")
+    math(EXPR listedCount "${listedCount} + ${CMAKE_MATCH_2} - ${CMAKE_MATCH_1} + 1")
+endforeach()
+if(NOT actual MATCHES "^ok ${hitCount} " OR NOT listedCount EQUAL hitCount)
+    message(FATAL_ERROR "matches pi 1e-4 answered '${actual}' listing ${listedCount} pyramids, the sweep has ${hitCount} other pi hits")
+endif()
+message(STATUS "${expected}; pi: ${expectedRank}, ${hitCount} pyramids within 1e-4")
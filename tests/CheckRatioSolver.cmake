@@ -0,0 +1,49 @@
+# Runs --solve and the full sweep for two combined target sets and checks that the solver
+# finds as many pyramids better than the Great Pyramid as the sweep does, and the sweep's
+# winner with the same relative error sum.
+#
+# cmake -DPROGRAM=<PyramidExperiments> -P CheckRatioSolver.cmake
+
+foreach(combined "pi,phi,e" "pi,e,sqrt2")
+    set(arguments --combine ${combined})
+    execute_process(COMMAND "${PROGRAM}" ${arguments} OUTPUT_VARIABLE sweep RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "the sweep of ${combined} failed")
+    endif()
+    execute_process(COMMAND "${PROGRAM}" ${arguments} --solve OUTPUT_VARIABLE solved RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "solving ${combined} failed")
+    endif()
+
+    set(betterLine "number of pyramids with a better combined relative error than the Great Pyramid: ([0-9]+)")
+    string(REGEX MATCH "${betterLine}" match "${sweep}")
+    set(sweepCount "${CMAKE_MATCH_1}")
+    string(REGEX MATCH "${betterLine}" match "${solved}")
+    set(solvedCount "${CMAKE_MATCH_1}")
+    if(sweepCount STREQUAL "" OR NOT sweepCount STREQUAL solvedCount)
+        message(FATAL_ERROR "${combined}: the sweep finds '${sweepCount}' better pyramids, the solver '${solvedCount}'")
+    endif()
+
+    string(REGEX MATCH "winning base length: ([0-9]+)\nwinning height: ([0-9]+)\nrelative error sum: ([^\n]+)" match "${sweep}")
+    set(sweepWinner "${CMAKE_MATCH_1} ${CMAKE_MATCH_2} ${CMAKE_MATCH_3}")
+
+    # Every multiple of a ratio has the same sum, so a ratio's best pyramid is its first.
+    set(solvedWinner "")
+    set(solvedSum "")
+    string(REGEX MATCHALL "\n    [0-9]+:[0-9]+, base length [0-9]+[^\n]*relative error sum [^\n]+" ratios "${solved}")
+    foreach(ratio IN LISTS ratios)
+        string(REGEX MATCH "([0-9]+):([0-9]+), base length ([0-9]+)[^\n]*relative error sum ([^\n]+)" match "${ratio}")
+        set(sum "${CMAKE_MATCH_4}")
+        set(baseLength "${CMAKE_MATCH_3}")
+        math(EXPR height "${baseLength} * ${CMAKE_MATCH_1} / ${CMAKE_MATCH_2}")
+        if(solvedSum STREQUAL "" OR sum LESS solvedSum OR (sum EQUAL solvedSum AND baseLength LESS solvedBaseLength))
+            set(solvedSum "${sum}")
+            set(solvedBaseLength "${baseLength}")
+            set(solvedWinner "${baseLength} ${height} ${sum}")
+        endif()
+    endforeach()
+    if(NOT sweepWinner STREQUAL solvedWinner)
+        message(FATAL_ERROR "${combined}: the sweep's winner is '${sweepWinner}', the solver's '${solvedWinner}'")
+    endif()
+    message(STATUS "${combined}: ${sweepCount} better pyramids, winner ${sweepWinner}")
+endforeach()
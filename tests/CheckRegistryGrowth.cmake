@@ -0,0 +1,51 @@
+# Builds a copy of the tree with the dimension registry grown by one line (GROWTH=dimension)
+# or allowedFactors grown past one float32 vector (GROWTH=factors), and checks that the
+# screened kernel still finds what the scalar one does.
+#
+# cmake -DSOURCE_DIR=<tree> -DWORK_DIR=<scratch directory> -DGROWTH=dimension|factors -P CheckRegistryGrowth.cmake
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(GLOB sources "${SOURCE_DIR}/*.cpp" "${SOURCE_DIR}/*.h")
+file(COPY ${sources} "${SOURCE_DIR}/CMakeLists.txt" DESTINATION "${WORK_DIR}/src")
+
+file(READ "${WORK_DIR}/src/Pyramid.h" pyramid)
+if(GROWTH STREQUAL "dimension")
+    # The inscribed sphere radius, a length that is not a fixed multiple of the others.
+    string(REGEX REPLACE "(    X\\(LATERAL_EDGE_LENGTH[^\n]*\n)"
+        "\\1    X(INSCRIBED_SPHERE_RADIUS, \"inscribed sphere radius\", LENGTHS, 0.5 * DIMENSION(BASE_LENGTH) * DIMENSION(HEIGHT) / (0.5 * DIMENSION(BASE_LENGTH) + DIMENSION(SLANT_LENGTH))) \\\\\n"
+        grown "${pyramid}")
+elseif(GROWTH STREQUAL "factors")
+    # Seventeen factors, still ascending.
+    string(REGEX REPLACE "std::array<double, [0-9]+> allowedFactors =[^;]*;"
+        "std::array<double, 17> allowedFactors = { 0.1, 0.125, 0.2, 0.25, 0.4, 0.5, 0.8, 1.0, 1.25, 2.0, 2.5, 4.0, 5.0, 8.0, 10.0, 16.0, 20.0 };"
+        grown "${pyramid}")
+else()
+    message(FATAL_ERROR "GROWTH must be dimension or factors")
+endif()
+if(grown STREQUAL pyramid)
+    message(FATAL_ERROR "could not apply the ${GROWTH} growth to Pyramid.h")
+endif()
+file(WRITE "${WORK_DIR}/src/Pyramid.h" "${grown}")
+
+execute_process(COMMAND "${CMAKE_COMMAND}" -S "${WORK_DIR}/src" -B "${WORK_DIR}/build" -DCMAKE_BUILD_TYPE=Release RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "configuring the grown tree failed")
+endif()
+execute_process(COMMAND "${CMAKE_COMMAND}" --build "${WORK_DIR}/build" --target PyramidExperiments RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "building the grown tree failed")
+endif()
+
+set(program "${WORK_DIR}/build/PyramidExperiments")
+execute_process(COMMAND "${program}" --kernel scalar OUTPUT_VARIABLE expected RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "the scalar sweep of the grown tree failed")
+endif()
+execute_process(COMMAND "${program}" --kernel screened OUTPUT_VARIABLE actual ERROR_VARIABLE error RESULT_VARIABLE result)
+if(error MATCHES "not supported by this CPU")
+    message(STATUS "the screened kernel is not supported by this CPU; only the build was checked")
+elseif(NOT result EQUAL 0)
+    message(FATAL_ERROR "the screened sweep of the grown tree failed: ${error}")
+elseif(NOT actual STREQUAL expected)
+    message(FATAL_ERROR "the screened and scalar sweeps of the grown tree differ")
+endif()
@@ -0,0 +1,54 @@
+# Kills a checkpointing sweep partway through, resumes it and checks that the resumed report
+# is exactly the uninterrupted one, both under the kernel that wrote the checkpoint and under
+# the scalar one, as on a machine without AVX-512. Resuming under the pruned kernel, which
+# counts candidates differently, must be refused.
+#
+# cmake -DPROGRAM=<PyramidExperiments> -DWORK_DIR=<scratch directory> -P CheckResume.cmake
+
+# A band wide enough that one thread is still sweeping when the kill comes.
+set(arguments --threads 1 --max-base-length 2000 --max-height 2000 --min-volume 0 --max-volume 1e13 --top 10)
+set(checkpoint "${WORK_DIR}/sweep.ckpt")
+set(killedCheckpoint "${WORK_DIR}/killed.ckpt")
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+
+execute_process(COMMAND "${PROGRAM}" ${arguments} OUTPUT_VARIABLE expected RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "the uninterrupted sweep failed")
+endif()
+
+execute_process(COMMAND "${PROGRAM}" ${arguments} --checkpoint "${checkpoint}" --checkpoint-interval 0 OUTPUT_QUIET TIMEOUT 1 RESULT_VARIABLE result)
+if(result EQUAL 0)
+    message(WARNING "the checkpointing sweep finished before it was killed; only resuming a finished sweep is checked")
+endif()
+if(NOT EXISTS "${checkpoint}")
+    message(FATAL_ERROR "the killed sweep left no checkpoint")
+endif()
+file(RENAME "${checkpoint}" "${killedCheckpoint}")
+
+foreach(kernel default scalar)
+    set(kernelArguments "")
+    if(NOT kernel STREQUAL "default")
+        set(kernelArguments --kernel ${kernel})
+    endif()
+
+    configure_file("${killedCheckpoint}" "${checkpoint}" COPYONLY)
+    execute_process(COMMAND "${PROGRAM}" ${arguments} ${kernelArguments} --checkpoint "${checkpoint}" --resume
+        OUTPUT_VARIABLE actual ERROR_VARIABLE error RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "the sweep resumed under the ${kernel} kernel failed: ${error}")
+    endif()
+    message(STATUS "${kernel} kernel: ${error}")
+    if(NOT actual STREQUAL expected)
+        file(WRITE "${WORK_DIR}/uninterrupted.txt" "${expected}")
+        file(WRITE "${WORK_DIR}/resumed-${kernel}.txt" "${actual}")
+        message(FATAL_ERROR "the report resumed under the ${kernel} kernel differs from the uninterrupted one; see ${WORK_DIR}")
+    endif()
+endforeach()
+
+configure_file("${killedCheckpoint}" "${checkpoint}" COPYONLY)
+execute_process(COMMAND "${PROGRAM}" ${arguments} --kernel pruned --checkpoint "${checkpoint}" --resume
+    OUTPUT_QUIET ERROR_VARIABLE error RESULT_VARIABLE result)
+if(result EQUAL 0 OR NOT error MATCHES "different options")
+    message(FATAL_ERROR "resuming under the pruned kernel was not refused: ${error}")
+endif()
@@ -0,0 +1,36 @@
+# Sweeps in three shards, merges the partials and checks that the merged report is exactly
+# the single-process one.
+#
+# cmake -DPROGRAM=<PyramidExperiments> -DWORK_DIR=<scratch directory> -P CheckShardMerge.cmake
+
+set(arguments --max-base-length 2000 --max-height 2000 --min-volume 0 --max-volume 1e13 --top 10)
+set(shardCount 3)
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+
+execute_process(COMMAND "${PROGRAM}" ${arguments} OUTPUT_VARIABLE expected RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "the single-process sweep failed")
+endif()
+
+set(partials "")
+math(EXPR lastShard "${shardCount} - 1")
+foreach(shard RANGE ${lastShard})
+    set(partial "${WORK_DIR}/shard${shard}.part")
+    execute_process(COMMAND "${PROGRAM}" ${arguments} --shard ${shard}/${shardCount} --partial "${partial}" OUTPUT_QUIET ERROR_VARIABLE error RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "shard ${shard}/${shardCount} failed: ${error}")
+    endif()
+    list(APPEND partials "${partial}")
+endforeach()
+string(REPLACE ";" "," partials "${partials}")
+
+execute_process(COMMAND "${PROGRAM}" ${arguments} --merge "${partials}" OUTPUT_VARIABLE actual ERROR_VARIABLE error RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "merging the partials failed: ${error}")
+endif()
+if(NOT actual STREQUAL expected)
+    file(WRITE "${WORK_DIR}/single.txt" "${expected}")
+    file(WRITE "${WORK_DIR}/merged.txt" "${actual}")
+    message(FATAL_ERROR "the merged report differs from the single-process one; see ${WORK_DIR}")
+endif()